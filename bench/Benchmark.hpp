@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace StrifeML
+{
+    namespace Bench
+    {
+        struct BenchmarkState
+        {
+            // Set by a benchmark that processes a known amount of data per iteration
+            double bytesPerIteration = 0;
+            double itemsPerIteration = 1;
+        };
+
+        struct BenchmarkResult
+        {
+            std::string name;
+            long long iterations = 0;
+            double nanosecondsPerIteration = 0;
+            double p50Nanoseconds = 0;
+            double p99Nanoseconds = 0;
+            double bytesPerSecond = 0;
+            double itemsPerSecond = 0;
+
+            // Anything else the benchmark measured, such as a compression ratio, reported as extra fields
+            std::vector<std::pair<std::string, double>> counters;
+        };
+
+        struct BenchmarkSettings
+        {
+            double minSeconds = 0.5;
+            std::string filter;
+            std::string outputPath;
+        };
+
+        // Runs a function repeatedly for at least minSeconds, timing it in batches so that per-iteration timer overhead
+        // stays out of the numbers, and reports one JSON object per line. Checks are reported the same way, with whether
+        // they passed instead of timings.
+        class BenchmarkRunner
+        {
+        public:
+            explicit BenchmarkRunner(const BenchmarkSettings& settings)
+                : _settings(settings)
+            {
+                if (!settings.outputPath.empty())
+                {
+                    _output = fopen(settings.outputPath.c_str(), "w");
+                }
+            }
+
+            ~BenchmarkRunner()
+            {
+                if (_output != nullptr)
+                {
+                    fclose(_output);
+                }
+            }
+
+            bool IsSelected(const std::string& name) const
+            {
+                return _settings.filter.empty() || name.find(_settings.filter) != std::string::npos;
+            }
+
+            // addCounters, if given, is called once the benchmark has run, to add counters worked out from what it did
+            template<typename TFunc>
+            void Run(
+                const std::string& name,
+                TFunc func,
+                BenchmarkState state = BenchmarkState(),
+                const std::function<void(BenchmarkResult&)>& addCounters = nullptr)
+            {
+                using Clock = std::chrono::steady_clock;
+
+                if (!IsSelected(name))
+                {
+                    return;
+                }
+
+                // Warm up and find a batch size that takes roughly a millisecond
+                long long batchSize = 1;
+                while (true)
+                {
+                    auto start = Clock::now();
+                    for (long long i = 0; i < batchSize; ++i)
+                    {
+                        func();
+                    }
+
+                    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                    if (seconds > 0.001 || batchSize >= (1ll << 30))
+                    {
+                        break;
+                    }
+
+                    batchSize *= 2;
+                }
+
+                std::vector<double> batchNanoseconds;
+                long long iterations = 0;
+                double totalSeconds = 0;
+
+                while (totalSeconds < _settings.minSeconds)
+                {
+                    auto start = Clock::now();
+                    for (long long i = 0; i < batchSize; ++i)
+                    {
+                        func();
+                    }
+
+                    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                    batchNanoseconds.push_back(seconds * 1e9 / batchSize);
+                    totalSeconds += seconds;
+                    iterations += batchSize;
+                }
+
+                std::sort(batchNanoseconds.begin(), batchNanoseconds.end());
+
+                BenchmarkResult result;
+                result.name = name;
+                result.iterations = iterations;
+                result.nanosecondsPerIteration = totalSeconds * 1e9 / iterations;
+                result.p50Nanoseconds = Percentile(batchNanoseconds, 0.5);
+                result.p99Nanoseconds = Percentile(batchNanoseconds, 0.99);
+                result.bytesPerSecond = state.bytesPerIteration * iterations / totalSeconds;
+                result.itemsPerSecond = state.itemsPerIteration * iterations / totalSeconds;
+                if (addCounters)
+                {
+                    addCounters(result);
+                }
+
+                Report(result);
+            }
+
+            // Runs a correctness check that goes with a benchmark. check returns whether it passed and can add counters
+            // describing what it checked.
+            void Check(const std::string& name, const std::function<bool(BenchmarkResult&)>& check)
+            {
+                if (!IsSelected(name))
+                {
+                    return;
+                }
+
+                BenchmarkResult result;
+                result.name = name;
+                bool passed = check(result);
+                if (!passed)
+                {
+                    ++_failedChecks;
+                }
+
+                std::string line = "{\"name\": \"" + result.name + "\", \"passed\": " + (passed ? "true" : "false");
+                AppendCounters(result, line);
+                WriteLine(line + "}\n");
+            }
+
+            void Report(const BenchmarkResult& result)
+            {
+                char fields[512];
+                snprintf(
+                    fields,
+                    sizeof(fields),
+                    "\"iterations\": %lld, \"ns_per_iteration\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, "
+                    "\"bytes_per_second\": %.0f, \"items_per_second\": %.1f",
+                    result.iterations,
+                    result.nanosecondsPerIteration,
+                    result.p50Nanoseconds,
+                    result.p99Nanoseconds,
+                    result.bytesPerSecond,
+                    result.itemsPerSecond);
+
+                std::string line = "{\"name\": \"" + result.name + "\", " + fields;
+                AppendCounters(result, line);
+                WriteLine(line + "}\n");
+            }
+
+            int FailedChecks() const { return _failedChecks; }
+
+            static double Percentile(const std::vector<double>& sortedValues, double percentile)
+            {
+                if (sortedValues.empty())
+                {
+                    return 0;
+                }
+
+                int index = std::min((int)sortedValues.size() - 1, (int)(percentile * sortedValues.size()));
+                return sortedValues[index];
+            }
+
+        private:
+            static void AppendCounters(const BenchmarkResult& result, std::string& line)
+            {
+                for (auto& counter : result.counters)
+                {
+                    char value[64];
+                    snprintf(value, sizeof(value), "%.4g", counter.second);
+                    line += ", \"" + counter.first + "\": " + value;
+                }
+            }
+
+            void WriteLine(const std::string& line)
+            {
+                // Flushed as it goes, so a crash later in the run doesn't take the results so far with it
+                fputs(line.c_str(), stdout);
+                fflush(stdout);
+                if (_output != nullptr)
+                {
+                    fputs(line.c_str(), _output);
+                    fflush(_output);
+                }
+            }
+
+            BenchmarkSettings _settings;
+            FILE* _output = nullptr;
+            int _failedChecks = 0;
+        };
+
+        inline BenchmarkSettings ParseBenchmarkSettings(int argc, char** argv)
+        {
+            BenchmarkSettings settings;
+            for (int i = 1; i + 1 < argc; i += 2)
+            {
+                std::string option = argv[i];
+                if (option == "--filter") settings.filter = argv[i + 1];
+                else if (option == "--out") settings.outputPath = argv[i + 1];
+                else if (option == "--min-time") settings.minSeconds = atof(argv[i + 1]);
+            }
+
+            return settings;
+        }
+
+        // Keeps the compiler from optimizing away a result
+        template<typename T>
+        void DoNotOptimize(const T& value)
+        {
+#ifdef _MSC_VER
+            static volatile const void* sink;
+            sink = &value;
+#else
+            asm volatile("" : : "r,m"(value) : "memory");
+#endif
+        }
+    }
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include "StrifeML.hpp"
+#include "TensorPacking.hpp"
+#include "QuantizedInference.hpp"
+
+namespace StrifeML
+{
+    namespace Bench
+    {
+        // Roughly the shape of what the game feeds its agents: a perception grid plus a little state
+        constexpr int GridRows = 40;
+        constexpr int GridCols = 40;
+
+        struct BenchInput : ISerializable
+        {
+            void Serialize(ObjectSerializer& serializer) override
+            {
+                serializer
+                    .Add(grid, "grid")
+                    .Add(velocityX, "velocityX")
+                    .Add(velocityY, "velocityY");
+            }
+
+            std::vector<float> grid = std::vector<float>(GridRows * GridCols);
+            float velocityX = 0;
+            float velocityY = 0;
+        };
+
+        struct BenchOutput : ISerializable
+        {
+            void Serialize(ObjectSerializer& serializer) override
+            {
+                serializer.Add(action, "action");
+            }
+
+            int action = 0;
+
+            // Not serialized. Lets the load generator see when each decision actually finished.
+            std::chrono::steady_clock::time_point decidedTime;
+        };
+
+        using BenchSample = Sample<BenchInput, BenchOutput>;
+
+        inline void FillRandomSample(BenchSample& sample, RandomNumberGenerator& rng, int totalActions)
+        {
+            // Mostly empty, like a real perception grid
+            std::fill(sample.input.grid.begin(), sample.input.grid.end(), 0.0f);
+            for (int i = 0; i < 40; ++i)
+            {
+                sample.input.grid[rng.RandInt(0, GridRows * GridCols - 1)] = (float)rng.RandInt(1, 15);
+            }
+
+            sample.input.velocityX = rng.RandFloat(-1, 1);
+            sample.input.velocityY = rng.RandFloat(-1, 1);
+            sample.output.action = rng.RandInt(0, totalActions - 1);
+        }
+
+        // The next frame of the same agent: a few things in view move, everything else stays put
+        inline void AdvanceSample(BenchSample& sample, RandomNumberGenerator& rng, int totalActions)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                sample.input.grid[rng.RandInt(0, GridRows * GridCols - 1)] = 0;
+                sample.input.grid[rng.RandInt(0, GridRows * GridCols - 1)] = (float)rng.RandInt(1, 15);
+            }
+
+            sample.input.velocityX = rng.RandFloat(-1, 1);
+            sample.input.velocityY = rng.RandFloat(-1, 1);
+            sample.output.action = rng.RandInt(0, totalActions - 1);
+        }
+
+        // A small MLP over the flattened grid, which is about the size of the models the game runs on CPU
+        struct TinyNetwork : NeuralNetwork<BenchInput, BenchOutput>
+        {
+            static constexpr int TotalActions = 8;
+
+            // Set before constructing networks to change the model size
+            static inline int hiddenUnits = 64;
+
+            TinyNetwork()
+                : NeuralNetwork<BenchInput, BenchOutput>(1),
+                  dense(module->register_module("dense", torch::nn::Linear(InputFeatures, hiddenUnits))),
+                  head(module->register_module("head", torch::nn::Linear(hiddenUnits, TotalActions))),
+                  optimizer(module->parameters(), torch::optim::SGDOptions(0.01))
+            {
+
+            }
+
+            torch::Tensor Forward(const torch::Tensor& input)
+            {
+                return head->forward(torch::relu(dense->forward(input)));
+            }
+
+            // Same as Forward(), but in int8 once PrepareQuantizedInference() has quantized the layers
+            torch::Tensor DecisionForward(const torch::Tensor& input)
+            {
+                return quantized.Linear(head, torch::relu(quantized.Linear(dense, input)));
+            }
+
+            bool PrepareQuantizedInference() override
+            {
+                module->eval();
+                return quantized.TryQuantize(*module);
+            }
+
+            void SetQuantizedInferenceEnabled(bool isEnabled) override
+            {
+                quantized.SetEnabled(isEnabled);
+            }
+
+            static constexpr int InputFeatures = GridRows * GridCols + 2;
+
+            static float* PackInput(const BenchInput& input, float* outPtr)
+            {
+                memcpy(outPtr, input.grid.data(), input.grid.size() * sizeof(float));
+                outPtr += input.grid.size();
+                *outPtr++ = input.velocityX;
+                *outPtr++ = input.velocityY;
+                return outPtr;
+            }
+
+            void MakeDecision(Grid<const BenchInput> input, gsl::span<BenchOutput> output) override
+            {
+                torch::NoGradGuard noGrad;
+
+                auto packed = torch::empty({ input.Rows() * input.Cols(), InputFeatures }, torch::kFloat32);
+                float* outPtr = packed.data_ptr<float>();
+                for (int i = 0; i < input.Rows(); ++i)
+                {
+                    for (int j = 0; j < input.Cols(); ++j)
+                    {
+                        outPtr = PackInput(input[i][j], outPtr);
+                    }
+                }
+
+                auto actions = DecisionForward(packed).argmax(1);
+
+                auto decidedTime = std::chrono::steady_clock::now();
+                for (int i = 0; i < (int)output.size(); ++i)
+                {
+                    output[i].action = (int)actions[i].item<int64_t>();
+                    output[i].decidedTime = decidedTime;
+                }
+
+                decisionsMade.fetch_add(1, std::memory_order_release);
+            }
+
+            // [rows, InputFeatures], in bfloat16 when training in mixed precision
+            torch::Tensor PackTrainingInput(Grid<const SampleType> input)
+            {
+                int totalRows = input.Rows() * input.Cols();
+                if (trainingPrecision != TrainingPrecision::BFloat16)
+                {
+                    auto packed = torch::empty({ totalRows, InputFeatures }, torch::kFloat32);
+                    float* outPtr = packed.data_ptr<float>();
+                    for (int i = 0; i < input.Rows(); ++i)
+                    {
+                        for (int j = 0; j < input.Cols(); ++j)
+                        {
+                            outPtr = PackInput(input[i][j].input, outPtr);
+                        }
+                    }
+
+                    return packed;
+                }
+
+                auto packed = torch::empty({ totalRows, InputFeatures }, torch::kBFloat16);
+                c10::BFloat16* outPtr = packed.data_ptr<c10::BFloat16>();
+                thread_local std::vector<float> packedRow(InputFeatures);
+                for (int i = 0; i < input.Rows(); ++i)
+                {
+                    for (int j = 0; j < input.Cols(); ++j)
+                    {
+                        PackInput(input[i][j].input, packedRow.data());
+                        ConvertToBFloat16(packedRow.data(), InputFeatures, outPtr);
+                        outPtr += InputFeatures;
+                    }
+                }
+
+                return packed;
+            }
+
+            torch::Tensor Loss(Grid<const SampleType> input)
+            {
+                auto targets = torch::empty({ input.Rows() * input.Cols() }, torch::kInt64);
+                int64_t* targetPtr = targets.data_ptr<int64_t>();
+                for (int i = 0; i < input.Rows(); ++i)
+                {
+                    for (int j = 0; j < input.Cols(); ++j)
+                    {
+                        *targetPtr++ = input[i][j].output.action;
+                    }
+                }
+
+                return torch::nn::functional::cross_entropy(Forward(PackTrainingInput(input)), targets);
+            }
+
+            void TrainBatch(Grid<const SampleType> input, TrainingBatchResult& outResult) override
+            {
+                optimizer.zero_grad();
+                auto loss = Loss(input);
+                loss.backward();
+                optimizer.step();
+                outResult.loss = loss.item<float>();
+            }
+
+            bool SupportsGradientSplit() const override { return true; }
+
+            void ComputeGradients(Grid<const SampleType> input, TrainingBatchResult& outResult) override
+            {
+                auto loss = Loss(input);
+                loss.backward();
+                outResult.loss = loss.item<float>();
+            }
+
+            void ApplyGradients() override
+            {
+                optimizer.step();
+            }
+
+            void SaveOptimizer(std::stringstream& stream) override
+            {
+                torch::save(optimizer, stream);
+            }
+
+            void LoadOptimizer(std::stringstream& stream) override
+            {
+                torch::load(optimizer, stream);
+            }
+
+            torch::nn::Linear dense;
+            torch::nn::Linear head;
+            torch::optim::SGD optimizer;
+            QuantizedLinearLayers quantized;
+
+            // Counts MakeDecision() calls across every network, since deciders swap networks as new ones are published
+            static inline std::atomic<long long> decisionsMade { 0 };
+        };
+    }
+}
@@ -0,0 +1,299 @@
+#include "Benchmark.hpp"
+#include "BenchmarkTypes.hpp"
+
+#include <mutex>
+
+using namespace StrifeML;
+using namespace StrifeML::Bench;
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadGeneratorSettings
+{
+    int agentCount = 64;
+    int hiddenUnits = 64;
+    int sequenceLength = 1;
+    int batchSize = 32;
+    float trainsPerSecond = 10;
+    float framesPerSecond = 60;
+    float durationSeconds = 10;
+    int maxTrainingWorkers = 1;
+    std::string outputPath;
+    std::string metricsPath;
+};
+
+struct LoadTrainer : Trainer<TinyNetwork>
+{
+    LoadTrainer(const LoadGeneratorSettings& settings)
+        : Trainer<TinyNetwork>(settings.batchSize, settings.trainsPerSecond, settings.sequenceLength, 1)
+    {
+        samples = sampleRepository.CreateSampleSet("agents");
+        samplesByAction = samples
+            ->CreateGroupedView<int>()
+            ->GroupBy([](const SampleType& sample) { return sample.output.action; });
+    }
+
+    void ReceiveSample(const SampleType& sample) override
+    {
+        samples->AddSample(sample);
+    }
+
+    bool TrySelectSequenceSamples(gsl::span<SampleType> outSequence) override
+    {
+        return samplesByAction->TryPickRandomSequence(outSequence);
+    }
+
+    void OnCreateNewNetwork(std::shared_ptr<NetworkType> newNetwork) override
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        networkCreatedTimes[newNetwork.get()] = Clock::now();
+    }
+
+    void OnTrainingComplete(const TrainingBatchResult& result) override
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        ++completedBatches;
+        batchTrainSeconds.push_back(result.timings.assemblySeconds + result.timings.trainSeconds);
+        publishSeconds.push_back(result.timings.publishSeconds);
+    }
+
+    SampleSet<SampleType>* samples;
+    GroupedSampleView<SampleType, int>* samplesByAction;
+
+    std::mutex statsMutex;
+    std::unordered_map<const TinyNetwork*, Clock::time_point> networkCreatedTimes;
+    std::vector<double> batchTrainSeconds;
+    std::vector<double> publishSeconds;
+    int completedBatches = 0;
+};
+
+struct Agent
+{
+    Agent(int sequenceLength)
+        : input(sequenceLength),
+          output(1)
+    {
+
+    }
+
+    MlUtil::SharedArray<BenchInput> input;
+    MlUtil::SharedArray<BenchOutput> output;
+};
+
+static LoadGeneratorSettings ParseSettings(int argc, char** argv)
+{
+    LoadGeneratorSettings settings;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i];
+        const char* value = argv[i + 1];
+
+        if (option == "--agents") settings.agentCount = atoi(value);
+        else if (option == "--hidden-units") settings.hiddenUnits = atoi(value);
+        else if (option == "--sequence-length") settings.sequenceLength = atoi(value);
+        else if (option == "--batch-size") settings.batchSize = atoi(value);
+        else if (option == "--trains-per-second") settings.trainsPerSecond = (float)atof(value);
+        else if (option == "--fps") settings.framesPerSecond = (float)atof(value);
+        else if (option == "--seconds") settings.durationSeconds = (float)atof(value);
+        else if (option == "--training-workers") settings.maxTrainingWorkers = atoi(value);
+        else if (option == "--out") settings.outputPath = value;
+        else if (option == "--metrics-out") settings.metricsPath = value;
+        else fprintf(stderr, "Unknown option %s\n", option.c_str());
+    }
+
+    return settings;
+}
+
+static double Milliseconds(Clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Simulates the game: every frame each agent asks the decider for an action and then submits what it saw as a sample,
+// while the trainer trains and publishes in the background
+int main(int argc, char** argv)
+{
+    auto settings = ParseSettings(argc, argv);
+    TinyNetwork::hiddenUnits = settings.hiddenUnits;
+    Metrics::SetEnabled(!settings.metricsPath.empty());
+
+    WorkSchedulerSettings schedulerSettings;
+    schedulerSettings.maxTrainingWorkers = settings.maxTrainingWorkers;
+    WorkScheduler::GetInstance()->Configure(schedulerSettings);
+
+    auto trainer = std::make_shared<LoadTrainer>(settings);
+    auto decider = std::make_shared<Decider<TinyNetwork>>();
+    auto networkContext = std::make_shared<NetworkContext<TinyNetwork>>(decider.get(), trainer.get(), settings.sequenceLength);
+
+    trainer->network = std::make_shared<TinyNetwork>();
+    trainer->networkContext = networkContext;
+    decider->networkContext = networkContext;
+    trainer->StartRunning();
+
+    RandomNumberGenerator rng(2);
+    std::vector<Agent> agents;
+    for (int i = 0; i < settings.agentCount; ++i)
+    {
+        agents.emplace_back(settings.sequenceLength);
+    }
+
+    std::vector<double> decisionMilliseconds;
+    std::vector<double> addSampleMilliseconds;
+    std::vector<double> pickupMilliseconds;
+    int totalFrames = 0;
+    int overrunFrames = 0;
+    long long totalSamples = 0;
+
+    auto frameDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / settings.framesPerSecond));
+    auto startTime = Clock::now();
+    auto endTime = startTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(settings.durationSeconds));
+    auto nextFrameTime = startTime;
+
+    TinyNetwork::SampleType sample;
+
+    while (Clock::now() < endTime)
+    {
+        long long decisionsBefore = TinyNetwork::decisionsMade;
+        std::vector<Clock::time_point> submitTimes(agents.size());
+
+        for (int i = 0; i < (int)agents.size(); ++i)
+        {
+            auto& agent = agents[i];
+            for (int j = 0; j < settings.sequenceLength; ++j)
+            {
+                BenchSample randomSample;
+                FillRandomSample(randomSample, rng, TinyNetwork::TotalActions);
+                agent.input.data.get()[j] = randomSample.input;
+            }
+
+            auto previousNetwork = decider->network;
+            submitTimes[i] = Clock::now();
+            decider->MakeDecision(agent.input, agent.output, settings.sequenceLength, 1);
+
+            // How long a loaded network waits before a decider picks it up. Saving and loading it is publish_ms.
+            if (decider->network != previousNetwork)
+            {
+                std::lock_guard<std::mutex> lock(trainer->statsMutex);
+                auto createdTime = trainer->networkCreatedTimes.find(decider->network.get());
+                if (createdTime != trainer->networkCreatedTimes.end())
+                {
+                    pickupMilliseconds.push_back(Milliseconds(submitTimes[i] - createdTime->second));
+                    trainer->networkCreatedTimes.erase(createdTime);
+                }
+            }
+        }
+
+        // Like the game, wait for this frame's decisions before acting on them
+        while (TinyNetwork::decisionsMade.load(std::memory_order_acquire) < decisionsBefore + (long long)agents.size())
+        {
+            std::this_thread::yield();
+        }
+
+        for (int i = 0; i < (int)agents.size(); ++i)
+        {
+            auto& agent = agents[i];
+            decisionMilliseconds.push_back(Milliseconds(agent.output.data.get()[0].decidedTime - submitTimes[i]));
+
+            sample.input = agent.input.data.get()[settings.sequenceLength - 1];
+            sample.output = agent.output.data.get()[0];
+
+            auto addStart = Clock::now();
+            trainer->AddSample(sample);
+            addSampleMilliseconds.push_back(Milliseconds(Clock::now() - addStart));
+            ++totalSamples;
+        }
+
+        ++totalFrames;
+        nextFrameTime += frameDuration;
+
+        auto now = Clock::now();
+        if (now > nextFrameTime)
+        {
+            ++overrunFrames;
+            nextFrameTime = now;
+        }
+        else
+        {
+            std::this_thread::sleep_until(nextFrameTime);
+        }
+    }
+
+    double elapsedSeconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+
+    TaskScheduler::GetInstance()->Stop();
+    while (trainer->isBatchRunning)
+    {
+        std::this_thread::yield();
+    }
+
+    std::vector<double> batchTrainSeconds;
+    std::vector<double> publishSeconds;
+    int completedBatches;
+    {
+        std::lock_guard<std::mutex> lock(trainer->statsMutex);
+        batchTrainSeconds = trainer->batchTrainSeconds;
+        publishSeconds = trainer->publishSeconds;
+        completedBatches = trainer->completedBatches;
+    }
+
+    for (auto* values : { &decisionMilliseconds, &addSampleMilliseconds, &pickupMilliseconds, &batchTrainSeconds, &publishSeconds })
+    {
+        std::sort(values->begin(), values->end());
+    }
+
+    auto percentile = BenchmarkRunner::Percentile;
+
+    char report[2048];
+    snprintf(
+        report,
+        sizeof(report),
+        "{\"agents\": %d, \"hidden_units\": %d, \"sequence_length\": %d, \"batch_size\": %d, \"trains_per_second\": %.1f, "
+        "\"seconds\": %.2f, \"frames\": %d, \"overrun_frames\": %d, "
+        "\"decision_ms_p50\": %.3f, \"decision_ms_p90\": %.3f, \"decision_ms_p99\": %.3f, \"decision_ms_max\": %.3f, "
+        "\"add_sample_us_p50\": %.2f, \"add_sample_us_p99\": %.2f, "
+        "\"samples_per_second\": %.1f, \"batches_per_second\": %.2f, \"batch_train_ms_p50\": %.3f, \"batch_train_ms_p99\": %.3f, "
+        "\"publish_ms_p50\": %.3f, \"publish_ms_p99\": %.3f, \"network_pickup_ms_p50\": %.3f, \"network_pickup_ms_p99\": %.3f, "
+        "\"skipped_train_ticks\": %d}\n",
+        settings.agentCount,
+        settings.hiddenUnits,
+        settings.sequenceLength,
+        settings.batchSize,
+        settings.trainsPerSecond,
+        elapsedSeconds,
+        totalFrames,
+        overrunFrames,
+        percentile(decisionMilliseconds, 0.5),
+        percentile(decisionMilliseconds, 0.9),
+        percentile(decisionMilliseconds, 0.99),
+        decisionMilliseconds.empty() ? 0 : decisionMilliseconds.back(),
+        percentile(addSampleMilliseconds, 0.5) * 1000,
+        percentile(addSampleMilliseconds, 0.99) * 1000,
+        totalSamples / elapsedSeconds,
+        completedBatches / elapsedSeconds,
+        percentile(batchTrainSeconds, 0.5) * 1000,
+        percentile(batchTrainSeconds, 0.99) * 1000,
+        percentile(publishSeconds, 0.5) * 1000,
+        percentile(publishSeconds, 0.99) * 1000,
+        percentile(pickupMilliseconds, 0.5),
+        percentile(pickupMilliseconds, 0.99),
+        trainer->skippedTicks.load());
+
+    fputs(report, stdout);
+
+    if (!settings.outputPath.empty())
+    {
+        FILE* output = fopen(settings.outputPath.c_str(), "w");
+        if (output != nullptr)
+        {
+            fputs(report, output);
+            fclose(output);
+        }
+    }
+
+    if (!settings.metricsPath.empty())
+    {
+        MetricsRegistry::GetInstance()->TryWriteTextFile(settings.metricsPath);
+    }
+
+    return 0;
+}
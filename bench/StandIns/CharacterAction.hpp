@@ -0,0 +1,11 @@
+#pragma once
+
+// Stand-in for the game's character actions
+enum class CharacterAction
+{
+    Nothing,
+    Left,
+    Right,
+    Jump,
+    TotalActions
+};
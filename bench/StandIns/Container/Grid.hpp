@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstring>
+
+// Stand-in for the engine's Grid, a non-owning row-major view over rows * cols cells
+template<typename T>
+class Grid
+{
+public:
+    Grid() = default;
+
+    Grid(int rows, int cols, T* data)
+        : _rows(rows),
+          _cols(cols),
+          _data(data)
+    {
+
+    }
+
+    void Set(int cols, int rows, T* data)
+    {
+        _rows = rows;
+        _cols = cols;
+        _data = data;
+    }
+
+    T* operator[](int row) const
+    {
+        return _data + row * _cols;
+    }
+
+    template<typename TOther>
+    void FastCopyUnsafe(Grid<TOther>& outGrid) const
+    {
+        memcpy(outGrid[0], _data, _rows * _cols * sizeof(T));
+    }
+
+    int Rows() const { return _rows; }
+    int Cols() const { return _cols; }
+
+private:
+    int _rows = 0;
+    int _cols = 0;
+    T* _data = nullptr;
+};
+
+// Stand-in for the engine's FixedSizeGrid, which owns its cells
+template<typename T, int NumRows, int NumCols>
+class FixedSizeGrid
+{
+public:
+    T* operator[](int row) { return _cells[row]; }
+    const T* operator[](int row) const { return _cells[row]; }
+
+    int Rows() const { return NumRows; }
+    int Cols() const { return NumCols; }
+
+private:
+    T _cells[NumRows][NumCols] { };
+};
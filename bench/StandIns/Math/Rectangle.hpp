@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Math/Vector2.hpp"
+
+// Stand-in for the engine's rectangles
+template<typename T>
+struct RectangleTemplate
+{
+    RectangleTemplate() = default;
+
+    RectangleTemplate(T x_, T y_, T width_, T height_)
+        : x(x_),
+          y(y_),
+          width(width_),
+          height(height_)
+    {
+
+    }
+
+    T Left() const { return x; }
+    T Top() const { return y; }
+    T Right() const { return x + width; }
+    T Bottom() const { return y + height; }
+
+    T x = 0;
+    T y = 0;
+    T width = 0;
+    T height = 0;
+};
+
+using Rectangle = RectangleTemplate<float>;
+using Rectanglei = RectangleTemplate<int>;
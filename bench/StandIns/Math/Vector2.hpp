@@ -0,0 +1,22 @@
+#pragma once
+
+// Stand-in for the engine's Vector2
+struct Vector2
+{
+    Vector2() = default;
+
+    Vector2(float x_, float y_)
+        : x(x_),
+          y(y_)
+    {
+
+    }
+
+    Vector2 operator+(const Vector2& rhs) const { return Vector2(x + rhs.x, y + rhs.y); }
+    Vector2 operator-(const Vector2& rhs) const { return Vector2(x - rhs.x, y - rhs.y); }
+    Vector2 operator*(float scale) const { return Vector2(x * scale, y * scale); }
+    Vector2 operator/(float scale) const { return Vector2(x / scale, y / scale); }
+
+    float x = 0;
+    float y = 0;
+};
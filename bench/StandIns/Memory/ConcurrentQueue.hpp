@@ -0,0 +1,33 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+
+// Stand-in for the engine's ConcurrentQueue
+template<typename T>
+class ConcurrentQueue
+{
+public:
+    void Enqueue(const T& value)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _values.push_back(value);
+    }
+
+    bool TryDequeue(T& outValue)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_values.empty())
+        {
+            return false;
+        }
+
+        outValue = _values.front();
+        _values.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex _mutex;
+    std::deque<T> _values;
+};
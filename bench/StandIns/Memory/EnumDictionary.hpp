@@ -0,0 +1,11 @@
+#pragma once
+
+// Stand-in for the engine's EnumDictionary
+template<typename TEnum, typename TValue, int Size>
+struct EnumDictionary
+{
+    TValue& operator[](TEnum key) { return values[(int)key]; }
+    const TValue& operator[](TEnum key) const { return values[(int)key]; }
+
+    TValue values[Size];
+};
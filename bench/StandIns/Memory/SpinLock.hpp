@@ -0,0 +1,25 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+// Stand-in for the engine's SpinLock
+class SpinLock
+{
+public:
+    void Lock()
+    {
+        while (_flag.test_and_set(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void Unlock()
+    {
+        _flag.clear(std::memory_order_release);
+    }
+
+private:
+    std::atomic_flag _flag = ATOMIC_FLAG_INIT;
+};
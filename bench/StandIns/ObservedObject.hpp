@@ -0,0 +1,11 @@
+#pragma once
+
+// Stand-in for the game's perceivable objects
+enum class ObservedObject
+{
+    Nothing,
+    Wall,
+    Enemy,
+    Friend,
+    TotalObjects
+};
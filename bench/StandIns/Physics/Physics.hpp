@@ -0,0 +1,3 @@
+#pragma once
+
+// Stand-in for the engine's physics. Only the scene stand-in's colliders are needed, see Scene/Scene.hpp.
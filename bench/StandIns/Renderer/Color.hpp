@@ -0,0 +1,10 @@
+#pragma once
+
+// Stand-in for the engine's Color
+struct Color
+{
+    unsigned char r = 0;
+    unsigned char g = 0;
+    unsigned char b = 0;
+    unsigned char a = 255;
+};
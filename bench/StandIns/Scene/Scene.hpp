@@ -0,0 +1,12 @@
+#pragma once
+
+#include <vector>
+#include "GridCellRectangle.hpp"
+
+// Stand-in for the engine's Scene. Perception only needs the colliders, which are kept in world cells. The benchmarks
+// define the scene query that ExperienceManager's perception runs on it.
+class Scene
+{
+public:
+    std::vector<GridCellRectangle> colliders;
+};
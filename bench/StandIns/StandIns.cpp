@@ -0,0 +1,145 @@
+#include "Thread/TaskScheduler.hpp"
+#include "Thread/ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    for (int i = 0; i < threadCount; ++i)
+    {
+        _threads.emplace_back([this] { RunWorker(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _isStopping = true;
+    }
+
+    _hasWork.notify_all();
+    for (auto& thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+ThreadPool* ThreadPool::GetInstance()
+{
+    static ThreadPool instance(std::max(1, (int)std::thread::hardware_concurrency()));
+    return &instance;
+}
+
+void ThreadPool::StartItem(std::shared_ptr<IThreadPoolWorkItem> workItem)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(std::move(workItem));
+    }
+
+    _hasWork.notify_one();
+}
+
+void ThreadPool::RunWorker()
+{
+    while (true)
+    {
+        std::shared_ptr<IThreadPoolWorkItem> workItem;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _hasWork.wait(lock, [this] { return _isStopping || !_queue.empty(); });
+
+            if (_queue.empty())
+            {
+                return;
+            }
+
+            workItem = std::move(_queue.front());
+            _queue.pop_front();
+        }
+
+        workItem->Execute();
+    }
+}
+
+TaskScheduler::TaskScheduler()
+    : _thread([this] { Run(); })
+{
+
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _isStopping = true;
+    }
+
+    _changed.notify_all();
+    _thread.join();
+}
+
+TaskScheduler* TaskScheduler::GetInstance()
+{
+    static TaskScheduler instance;
+    return &instance;
+}
+
+void TaskScheduler::Start(std::shared_ptr<ScheduledTask> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto delay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(task->runTime));
+        _tasks.push_back({ task, std::chrono::steady_clock::now() + delay });
+    }
+
+    _changed.notify_all();
+}
+
+void TaskScheduler::Stop()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tasks.clear();
+}
+
+void TaskScheduler::Run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (!_isStopping)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto nextWakeTime = now + std::chrono::milliseconds(100);
+
+        for (int i = 0; i < (int)_tasks.size(); ++i)
+        {
+            auto& pending = _tasks[i];
+            if (pending.nextRunTime <= now)
+            {
+                ThreadPool::GetInstance()->StartItem(pending.task->workItem);
+
+                if (pending.task->recurringTime <= 0)
+                {
+                    _tasks.erase(_tasks.begin() + i);
+                    --i;
+                    continue;
+                }
+
+                pending.nextRunTime += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<float>(pending.task->recurringTime));
+
+                // Don't try to catch up on runs that were missed
+                if (pending.nextRunTime < now)
+                {
+                    pending.nextRunTime = now;
+                }
+            }
+
+            nextWakeTime = std::min(nextWakeTime, pending.nextRunTime);
+        }
+
+        _changed.wait_until(lock, nextWakeTime);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Thread/ThreadPool.hpp"
+
+// Stand-in for the engine's task scheduler. runTime is the delay in seconds before the first run, and a task with a
+// non-zero recurringTime is started again every recurringTime seconds.
+struct ScheduledTask
+{
+    std::shared_ptr<IThreadPoolWorkItem> workItem;
+    float runTime = 0;
+    float recurringTime = 0;
+};
+
+class TaskScheduler
+{
+public:
+    TaskScheduler();
+    ~TaskScheduler();
+
+    static TaskScheduler* GetInstance();
+
+    void Start(std::shared_ptr<ScheduledTask> task);
+
+    // Stops all recurring tasks
+    void Stop();
+
+private:
+    struct PendingTask
+    {
+        std::shared_ptr<ScheduledTask> task;
+        std::chrono::steady_clock::time_point nextRunTime;
+    };
+
+    void Run();
+
+    std::vector<PendingTask> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::thread _thread;
+    bool _isStopping = false;
+};
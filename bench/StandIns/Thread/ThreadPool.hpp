@@ -0,0 +1,48 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Memory/SpinLock.hpp"
+
+// Stand-ins for the engine's thread pool. Only the parts Strife.ML uses are provided.
+class IThreadPoolWorkItem
+{
+public:
+    virtual ~IThreadPoolWorkItem() = default;
+    virtual void Execute() = 0;
+};
+
+template<typename TResult>
+class ThreadPoolWorkItem : public IThreadPoolWorkItem
+{
+public:
+    const TResult& Result() const { return _result; }
+
+protected:
+    TResult _result;
+};
+
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    static ThreadPool* GetInstance();
+
+    void StartItem(std::shared_ptr<IThreadPoolWorkItem> workItem);
+
+private:
+    void RunWorker();
+
+    std::vector<std::thread> _threads;
+    std::deque<std::shared_ptr<IThreadPoolWorkItem>> _queue;
+    std::mutex _mutex;
+    std::condition_variable _hasWork;
+    bool _isStopping = false;
+};
@@ -0,0 +1,1211 @@
+#include "Benchmark.hpp"
+#include "BenchmarkTypes.hpp"
+#include "GridCellSpatialHash.hpp"
+#include "ExperienceFile.hpp"
+
+#ifdef STRIFEML_BENCH_STANDINS
+#include "Scene/Scene.hpp"
+#include "ExperienceManager.hpp"
+
+// The engine's scene query, for the stand-in scene
+void ExperienceManager::GetPerceptionGridRectangles(Scene* scene, const GridCellRectangle& cellArea, std::vector<GridCellRectangle>& outRectangles)
+{
+    for (auto& collider : scene->colliders)
+    {
+        if (!collider.Intersection(cellArea).IsEmpty())
+        {
+            outRectangles.push_back(collider);
+        }
+    }
+}
+#endif
+
+using namespace StrifeML;
+using namespace StrifeML::Bench;
+
+static void BenchmarkSampleSet(BenchmarkRunner& runner)
+{
+    RandomNumberGenerator rng(1);
+    BenchSample sample;
+    FillRandomSample(sample, rng, TinyNetwork::TotalActions);
+
+    {
+        SampleRepository<BenchSample> repository(rng);
+        auto sampleSet = repository.CreateSampleSet("add");
+        sampleSet->CreateGroupedView<int>()->GroupBy([](const BenchSample& s) { return s.output.action; });
+
+        BenchmarkState state;
+        state.bytesPerIteration = sizeof(float) * sample.input.grid.size();
+        runner.Run("SampleSet.AddSample", [&] { DoNotOptimize(sampleSet->AddSample(sample)); }, state);
+    }
+
+    {
+        SampleRepository<BenchSample> repository(rng);
+        auto sampleSet = repository.CreateSampleSet("get");
+        const int totalSamples = 10000;
+        for (int i = 0; i < totalSamples; ++i)
+        {
+            FillRandomSample(sample, rng, TinyNetwork::TotalActions);
+            sampleSet->AddSample(sample);
+        }
+
+        BenchSample outSample;
+        int sampleId = 0;
+        BenchmarkState state;
+        state.bytesPerIteration = sizeof(float) * sample.input.grid.size();
+        runner.Run("SampleSet.TryGetSampleById", [&]
+        {
+            DoNotOptimize(sampleSet->TryGetSampleById(sampleId, outSample));
+            sampleId = (sampleId + 1) % totalSamples;
+        }, state);
+    }
+
+    // A full reservoir set should hold a uniform selection of everything added, so the samples it keeps should average out
+    // to the middle of the order they were added in. Checked both when the set's own maxBytes fills it and when the
+    // repository's budget does.
+    for (bool isRepositoryBudget : { false, true })
+    {
+        std::string name = isRepositoryBudget ? "repository-budget" : "set-max-bytes";
+        runner.Check("SampleSet.Reservoir/" + name + "/keeps-uniform-selection", [&](BenchmarkResult& result)
+        {
+            const int totalSamples = 20000;
+            const int keptSamples = 500;
+
+            RandomNumberGenerator reservoirRng(5);
+            SampleRepository<BenchSample> repository(reservoirRng);
+
+            std::vector<unsigned char> bytes;
+            ObjectSerializer serializer(bytes, false);
+            sample.input.Serialize(serializer);
+            sample.output.Serialize(serializer);
+            uint64_t maxBytes = bytes.size() * keptSamples;
+
+            SampleSetOptions<BenchSample> options;
+            options.eviction = SampleEvictionPolicy::Reservoir;
+            options.maxBytes = isRepositoryBudget ? 0 : maxBytes;
+            auto sampleSet = repository.CreateSampleSet("reservoir", options);
+            repository.SetMemoryBudget(isRepositoryBudget ? maxBytes : 0);
+
+            // Rejected samples don't take an id, so each sample records its place in the order in its velocity instead
+            BenchSample addedSample = sample;
+            for (int i = 0; i < totalSamples; ++i)
+            {
+                addedSample.input.velocityX = (float)i;
+                sampleSet->AddSample(addedSample);
+            }
+
+            BenchSample outSample;
+            double orderSum = 0;
+            int liveSamples = 0;
+            for (int sampleId = 0; sampleId < sampleSet->SampleCount(); ++sampleId)
+            {
+                if (sampleSet->TryGetSampleById(sampleId, outSample))
+                {
+                    orderSum += outSample.input.velocityX;
+                    ++liveSamples;
+                }
+            }
+
+            // A uniform selection of 500 out of 20000 averages within about 260 of the middle, one standard deviation
+            double meanOrder = orderSum / std::max(1, liveSamples);
+            result.counters.emplace_back("kept_samples", liveSamples);
+            result.counters.emplace_back("mean_order", meanOrder);
+            result.counters.emplace_back("uniform_mean_order", totalSamples / 2);
+            return liveSamples > 0 && std::abs(meanOrder - totalSamples / 2) < totalSamples * 0.05;
+        });
+    }
+}
+
+static void BenchmarkSampleCodec(BenchmarkRunner& runner)
+{
+    const int totalSamples = 10000;
+    const int sequenceLength = 4;
+
+    for (bool isCompressed : { false, true })
+    {
+        RandomNumberGenerator rng(4);
+        SampleRepository<BenchSample> repository(rng);
+        SampleSetOptions<BenchSample> options;
+        options.codec.isEnabled = isCompressed;
+        auto sampleSet = repository.CreateSampleSet("codec", options);
+        std::string suffix = isCompressed ? "/compressed" : "/raw";
+
+        BenchSample sample;
+        FillRandomSample(sample, rng, TinyNetwork::TotalActions);
+        for (int i = 0; i < totalSamples; ++i)
+        {
+            AdvanceSample(sample, rng, TinyNetwork::TotalActions);
+            sampleSet->AddSample(sample);
+        }
+
+        // Measured on the samples above, before the benchmark adds more
+        double storedBytes = (double)sampleSet->TotalBytes();
+        double rawBytes = (double)sampleSet->UncompressedBytes();
+
+        BenchmarkState state;
+        state.bytesPerIteration = sizeof(float) * sample.input.grid.size();
+        runner.Run("SampleSet.AddSample" + suffix, [&]
+        {
+            AdvanceSample(sample, rng, TinyNetwork::TotalActions);
+            DoNotOptimize(sampleSet->AddSample(sample));
+        }, state, [&](BenchmarkResult& result)
+        {
+            result.counters.emplace_back("bytes_per_sample", storedBytes / totalSamples);
+            result.counters.emplace_back("compression_ratio", rawBytes / storedBytes);
+        });
+
+        // Sequences are read in order, which is what the decoded sample cache is for
+        std::vector<BenchSample> sequence(sequenceLength);
+        state.itemsPerIteration = sequenceLength;
+        state.bytesPerIteration *= sequenceLength;
+        runner.Run("SampleSet.ReadSequence" + suffix, [&]
+        {
+            int endSampleId = rng.RandInt(sequenceLength - 1, totalSamples - 1);
+            for (int i = 0; i < sequenceLength; ++i)
+            {
+                DoNotOptimize(sampleSet->TryGetSampleById(endSampleId - (sequenceLength - 1 - i), sequence[i]));
+            }
+        }, state);
+    }
+}
+
+static void BenchmarkGroupedSampleView(BenchmarkRunner& runner)
+{
+    const int sequenceLength = 4;
+
+    for (int groupCount : { 1, 8, 64 })
+    {
+        RandomNumberGenerator rng(2);
+        SampleRepository<BenchSample> repository(rng);
+        auto sampleSet = repository.CreateSampleSet("groups");
+        auto view = sampleSet->CreateGroupedView<int>()->GroupBy([=](const BenchSample& s) { return s.output.action % groupCount; });
+
+        BenchSample sample;
+        for (int i = 0; i < 10000; ++i)
+        {
+            FillRandomSample(sample, rng, 64);
+            sampleSet->AddSample(sample);
+        }
+
+        std::vector<BenchSample> sequence(sequenceLength);
+        BenchmarkState state;
+        state.itemsPerIteration = sequenceLength;
+        runner.Run("GroupedSampleView.TryPickRandomSequence/groups:" + std::to_string(groupCount), [&]
+        {
+            DoNotOptimize(view->TryPickRandomSequence(gsl::span<BenchSample>(sequence.data(), sequence.size())));
+        }, state);
+
+        // Only the picks, a batch at a time, one row after another and then in one go
+        const int batchSize = 32;
+        SequenceBatchBuilder<BenchSample> builder;
+        BenchmarkState batchState;
+        batchState.itemsPerIteration = batchSize;
+        runner.Run("GroupedSampleView.PickBatch/per-row/groups:" + std::to_string(groupCount), [&]
+        {
+            builder.Begin(sequenceLength);
+            for (int row = 0; row < batchSize; ++row)
+            {
+                view->TryPickRandomSequence(sequenceLength, builder);
+            }
+        }, batchState);
+
+        runner.Run("GroupedSampleView.PickBatch/bulk/groups:" + std::to_string(groupCount), [&]
+        {
+            builder.Begin(sequenceLength);
+            DoNotOptimize(view->TryPickRandomSequences(sequenceLength, batchSize, builder));
+        }, batchState);
+    }
+}
+
+static void BenchmarkObjectSerializer(BenchmarkRunner& runner)
+{
+    RandomNumberGenerator rng(3);
+    BenchSample sample;
+    FillRandomSample(sample, rng, TinyNetwork::TotalActions);
+
+    std::vector<unsigned char> bytes;
+    {
+        ObjectSerializer serializer(bytes, false);
+        sample.input.Serialize(serializer);
+    }
+
+    BenchmarkState state;
+    state.bytesPerIteration = (double)bytes.size();
+
+    std::vector<unsigned char> writeBytes;
+    runner.Run("ObjectSerializer.Write", [&]
+    {
+        writeBytes.clear();
+        ObjectSerializer serializer(writeBytes, false);
+        sample.input.Serialize(serializer);
+        DoNotOptimize(writeBytes.data());
+    }, state);
+
+    BenchInput readInput;
+    runner.Run("ObjectSerializer.Read", [&]
+    {
+        ObjectSerializer serializer(bytes, true);
+        readInput.Serialize(serializer);
+        DoNotOptimize(serializer.hadError);
+    }, state);
+}
+
+static void BenchmarkSequenceBatch(BenchmarkRunner& runner)
+{
+    const int batchSize = 32;
+    const int sequenceLength = 32;
+    auto selector = [](const BenchSample& s) { return std::array<float, 2> { s.input.velocityX, s.input.velocityY }; };
+
+    for (int totalSamples : { 1000, 10000 })
+    {
+        RandomNumberGenerator rng(9);
+        SampleRepository<BenchSample> repository(rng);
+        auto sampleSet = repository.CreateSampleSet("sequences");
+        auto view = sampleSet->CreateGroupedView<int>()->GroupBy([](const BenchSample&) { return 0; });
+
+        BenchSample sample;
+        FillRandomSample(sample, rng, TinyNetwork::TotalActions);
+        for (int i = 0; i < totalSamples; ++i)
+        {
+            AdvanceSample(sample, rng, TinyNetwork::TotalActions);
+            sampleSet->AddSample(sample);
+        }
+
+        BenchmarkState state;
+        state.itemsPerIteration = batchSize * sequenceLength;
+        auto suffix = "/samples:" + std::to_string(totalSamples);
+
+        std::vector<BenchSample> batchSamples(batchSize * sequenceLength);
+        Grid<BenchSample> batch(batchSize, sequenceLength, batchSamples.data());
+        runner.Run("SequenceBatch.PerRow" + suffix, [&]
+        {
+            for (int row = 0; row < batchSize; ++row)
+            {
+                view->TryPickRandomSequence(gsl::span<BenchSample>(batch[row], sequenceLength));
+            }
+
+            DoNotOptimize(PackIntoTensor(Grid<const BenchSample>(batchSize, sequenceLength, batchSamples.data()), selector));
+        }, state);
+
+        SequenceBatchBuilder<BenchSample> builder;
+        int64_t framesDeserialized = 0;
+        int64_t batches = 0;
+        runner.Run("SequenceBatch.SharedFrames" + suffix, [&]
+        {
+            builder.Begin(sequenceLength);
+            for (int row = 0; row < batchSize; ++row)
+            {
+                view->TryPickRandomSequence(sequenceLength, builder);
+            }
+
+            builder.TryBuild();
+            DoNotOptimize(PackIntoTensor(builder.Batch(), selector));
+
+            framesDeserialized += builder.FramesDeserialized();
+            ++batches;
+        }, state, [&](BenchmarkResult& result)
+        {
+            result.counters.emplace_back("frames_deserialized_per_batch", (double)framesDeserialized / batches);
+            result.counters.emplace_back("frames_per_batch", batchSize * sequenceLength);
+        });
+    }
+}
+
+static void BenchmarkPackIntoTensor(BenchmarkRunner& runner)
+{
+    BenchmarkState state;
+    state.bytesPerIteration = GridRows * GridCols * sizeof(float);
+
+    FixedSizeGrid<float, GridRows, GridCols> fixedSizeGrid;
+    runner.Run("PackIntoTensor/FixedSizeGrid", [&] { DoNotOptimize(PackIntoTensor(fixedSizeGrid)); }, state);
+
+    std::vector<float> gridData(GridRows * GridCols);
+    Grid<float> grid(GridRows, GridCols, gridData.data());
+    runner.Run("PackIntoTensor/Grid", [&] { DoNotOptimize(PackIntoTensor(grid)); }, state);
+
+    std::array<float, GridRows * GridCols> array { };
+    runner.Run("PackIntoTensor/array", [&] { DoNotOptimize(PackIntoTensor(array)); }, state);
+
+    gsl::span<float> span(gridData.data(), gridData.size());
+    runner.Run("PackIntoTensor/span", [&] { DoNotOptimize(PackIntoTensor(span)); }, state);
+
+    const int batchSize = 32;
+    std::vector<BenchSample> samples(batchSize);
+    BenchmarkState selectorState;
+    selectorState.itemsPerIteration = batchSize;
+
+    Grid<const BenchSample> sampleGrid(1, batchSize, samples.data());
+    runner.Run("PackIntoTensor/Grid+selector", [&]
+    {
+        DoNotOptimize(PackIntoTensor(sampleGrid, [](const BenchSample& s) { return std::array<float, 2> { s.input.velocityX, s.input.velocityY }; }));
+    }, selectorState);
+
+    gsl::span<const BenchSample> sampleSpan(samples.data(), samples.size());
+    runner.Run("PackIntoTensor/span+selector", [&]
+    {
+        DoNotOptimize(PackIntoTensor(sampleSpan, [](const BenchSample& s) { return s.input.velocityX; }));
+    }, selectorState);
+}
+
+static void BenchmarkPerceptionGrid(BenchmarkRunner& runner)
+{
+    // What the game rasterizes per agent per frame: a few dozen collider rectangles of up to 16 object types
+    struct GridRectangle { int x, y, width, height, value; };
+
+    RandomNumberGenerator rng(5);
+    std::vector<GridRectangle> rectangles(40);
+    for (auto& rectangle : rectangles)
+    {
+        rectangle = { rng.RandInt(0, GridCols - 1), rng.RandInt(0, GridRows - 1), rng.RandInt(1, 8), rng.RandInt(1, 8), rng.RandInt(1, 15) };
+    }
+
+    BenchmarkState state;
+    state.itemsPerIteration = (double)rectangles.size();
+
+    std::vector<long long> denseData(GridRows * GridCols);
+    Grid<long long> denseGrid(GridRows, GridCols, denseData.data());
+    runner.Run("PerceptionGrid.Rasterize/dense", [&]
+    {
+        std::fill(denseData.begin(), denseData.end(), 0);
+        for (auto& rectangle : rectangles)
+        {
+            for (int i = rectangle.y; i < std::min(rectangle.y + rectangle.height, GridRows); ++i)
+            {
+                for (int j = rectangle.x; j < std::min(rectangle.x + rectangle.width, GridCols); ++j)
+                {
+                    denseGrid[i][j] = rectangle.value;
+                }
+            }
+        }
+
+        DoNotOptimize(denseData.data());
+    }, state);
+
+    using BenchBitGrid = BitPlaneGrid<GridRows, GridCols, 16>;
+    BenchBitGrid bitGrid;
+    runner.Run("PerceptionGrid.Rasterize/bit-plane", [&]
+    {
+        bitGrid.Clear();
+        for (auto& rectangle : rectangles)
+        {
+            bitGrid.FillRectangle(rectangle.x, rectangle.y, rectangle.width, rectangle.height, rectangle.value);
+        }
+
+        DoNotOptimize(&bitGrid);
+    }, state);
+
+    BenchmarkState copyState;
+    copyState.bytesPerIteration = (double)(GridRows * GridCols * sizeof(long long));
+
+    std::vector<long long> denseCopy(GridRows * GridCols);
+    runner.Run("PerceptionGrid.Copy/dense", [&]
+    {
+        memcpy(denseCopy.data(), denseData.data(), denseData.size() * sizeof(long long));
+        DoNotOptimize(denseCopy.data());
+    }, copyState);
+
+    BenchBitGrid bitGridCopy;
+    runner.Run("PerceptionGrid.Copy/bit-plane", [&]
+    {
+        bitGridCopy = bitGrid;
+        DoNotOptimize(&bitGridCopy);
+    }, copyState);
+
+    BenchmarkState expandState;
+    expandState.bytesPerIteration = (double)(GridRows * GridCols * sizeof(float));
+
+    std::vector<float> dense(GridRows * GridCols);
+    runner.Run("PerceptionGrid.ExpandToDense", [&]
+    {
+        bitGrid.ExpandToDense(dense.data());
+        DoNotOptimize(dense.data());
+    }, expandState);
+
+    std::vector<float> oneHot(16 * GridRows * GridCols);
+    expandState.bytesPerIteration *= 16;
+    runner.Run("PerceptionGrid.ExpandToOneHot", [&]
+    {
+        bitGrid.ExpandToOneHot(oneHot.data());
+        DoNotOptimize(oneHot.data());
+    }, expandState);
+}
+
+static void BenchmarkBatchedPerception(BenchmarkRunner& runner)
+{
+    // 64 agents fighting over the same part of a level, each with a 40x40 cell window
+    RandomNumberGenerator rng(7);
+    std::vector<GridCellRectangle> level;
+    for (int i = 0; i < 20000; ++i)
+    {
+        level.emplace_back(rng.RandInt(0, 999), rng.RandInt(0, 999), rng.RandInt(1, 12), rng.RandInt(1, 6), rng.RandInt(1, 15));
+    }
+
+    std::vector<GridCellRectangle> windows;
+    for (int i = 0; i < 64; ++i)
+    {
+        windows.emplace_back(rng.RandInt(400, 520), rng.RandInt(400, 520), GridCols, GridRows, 0);
+    }
+
+    std::vector<std::vector<GridCellRectangle>> agentRectangles(windows.size());
+
+    BenchmarkState state;
+    state.itemsPerIteration = (double)windows.size();
+
+    // What every agent pays when it queries on its own: go through the level and clip what overlaps its window
+    runner.Run("Perception.PerAgentQuery", [&]
+    {
+        for (int agent = 0; agent < (int)windows.size(); ++agent)
+        {
+            agentRectangles[agent].clear();
+            for (auto& rectangle : level)
+            {
+                auto clipped = rectangle.Intersection(windows[agent]);
+                if (!clipped.IsEmpty())
+                {
+                    agentRectangles[agent].push_back(clipped);
+                }
+            }
+        }
+
+        DoNotOptimize(agentRectangles.data());
+    }, state);
+
+    GridCellSpatialHash spatialHash(GridCols / 2);
+    std::vector<GridCellRectangle> sharedRectangles;
+    std::vector<int> scratch;
+    runner.Run("Perception.BatchedQuery", [&]
+    {
+        GridCellRectangle area = windows[0];
+        for (auto& window : windows)
+        {
+            int right = std::max(area.Right(), window.Right());
+            int bottom = std::max(area.Bottom(), window.Bottom());
+            area.x = std::min(area.x, window.x);
+            area.y = std::min(area.y, window.y);
+            area.width = right - area.x;
+            area.height = bottom - area.y;
+        }
+
+        sharedRectangles.clear();
+        for (auto& rectangle : level)
+        {
+            auto clipped = rectangle.Intersection(area);
+            if (!clipped.IsEmpty())
+            {
+                sharedRectangles.push_back(rectangle);
+            }
+        }
+
+        spatialHash.Build(sharedRectangles);
+        for (int agent = 0; agent < (int)windows.size(); ++agent)
+        {
+            agentRectangles[agent].clear();
+            spatialHash.Query(windows[agent], agentRectangles[agent], scratch);
+        }
+
+        DoNotOptimize(agentRectangles.data());
+    }, state);
+
+#ifdef STRIFEML_BENCH_STANDINS
+    static_assert(GridCols == PerceptionGridCols && GridRows == PerceptionGridRows, "Windows must be the size perception uses");
+
+    // The same query through ExperienceManager, which spreads the agents over the thread pool
+    Scene scene;
+    scene.colliders = level;
+    std::vector<Vector2> topLeftPositions;
+    for (auto& window : windows)
+    {
+        topLeftPositions.emplace_back(window.x * PerceptionGridCellSize, window.y * PerceptionGridCellSize);
+    }
+
+    std::vector<std::vector<GridCellRectangle>> sampledRectangles;
+    runner.Run("Perception.SamplePerceptionGrids", [&]
+    {
+        ExperienceManager::SamplePerceptionGrids(&scene, topLeftPositions, sampledRectangles);
+        DoNotOptimize(sampledRectangles.data());
+    }, state);
+
+    // Which agents the pool threads get differs from call to call, so this samples a number of times
+    runner.Check("Perception.SamplePerceptionGrids/matches-per-agent", [&](BenchmarkResult& result)
+    {
+        std::vector<std::vector<GridCellRectangle>> expectedRectangles(windows.size());
+        long long totalRectangles = 0;
+        for (int agent = 0; agent < (int)windows.size(); ++agent)
+        {
+            for (auto& rectangle : level)
+            {
+                auto clipped = rectangle.Intersection(windows[agent]);
+                if (!clipped.IsEmpty())
+                {
+                    expectedRectangles[agent].push_back(clipped);
+                }
+            }
+
+            totalRectangles += (long long)expectedRectangles[agent].size();
+        }
+
+        const int totalCalls = 200;
+        int mismatchedAgents = 0;
+        for (int call = 0; call < totalCalls; ++call)
+        {
+            ExperienceManager::SamplePerceptionGrids(&scene, topLeftPositions, sampledRectangles);
+            for (int agent = 0; agent < (int)windows.size(); ++agent)
+            {
+                mismatchedAgents += sampledRectangles[agent] == expectedRectangles[agent] ? 0 : 1;
+            }
+        }
+
+        result.counters.emplace_back("agents", (double)windows.size());
+        result.counters.emplace_back("calls", totalCalls);
+        result.counters.emplace_back("mismatched_agents", mismatchedAgents);
+        result.counters.emplace_back("rectangles_per_agent", (double)totalRectangles / windows.size());
+        return mismatchedAgents == 0 && totalRectangles > 0;
+    });
+#endif
+}
+
+static void BenchmarkExperienceFile(BenchmarkRunner& runner)
+{
+    // Experiences laid out like ExperienceManager's: rectangles packed into words (4 bits of object, then 7 each of x, y,
+    // width and height) in the order a scan of the window finds them. Level geometry comes in runs of tiles of the same
+    // object and size, with the odd rectangle that's different.
+    const int totalExperiences = 100000;
+    RandomNumberGenerator rng(8);
+    std::vector<unsigned int> words;
+    std::vector<int> experienceStarts;
+    for (int i = 0; i < totalExperiences; ++i)
+    {
+        experienceStarts.push_back((int)words.size());
+        int totalRectangles = rng.RandInt(4, 24);
+        int object = 1;
+        int x = 0;
+        int width = 1;
+        int height = 1;
+        for (int j = 0; j < totalRectangles; ++j)
+        {
+            if (rng.RandInt(0, 3) == 0)
+            {
+                object = rng.RandInt(1, 15);
+                width = rng.RandInt(1, 8);
+                height = rng.RandInt(1, 4);
+                x = rng.RandInt(0, GridCols - width);
+            }
+            else
+            {
+                x = (x + width) % GridCols;
+            }
+
+            int y = j * GridRows / totalRectangles;
+            words.push_back((unsigned int)object
+                | ((unsigned int)x << 4)
+                | ((unsigned int)y << 11)
+                | ((unsigned int)width << 18)
+                | ((unsigned int)height << 25));
+        }
+    }
+
+    experienceStarts.push_back((int)words.size());
+
+    const std::string path = "bench_experiences.bin";
+    auto writeAll = [&]
+    {
+        ExperienceFileWriter writer(path, 0);
+        for (int i = 0; i < totalExperiences; ++i)
+        {
+            writer.WriteExperience(&words[experienceStarts[i]], experienceStarts[i + 1] - experienceStarts[i], (float)i, 0);
+        }
+
+        return writer.Close();
+    };
+
+    BenchmarkState state;
+    state.itemsPerIteration = totalExperiences;
+
+    // What the file would be without the varint deltas: every word plus the experience's start index, count and velocity
+    state.bytesPerIteration = (double)(words.size() * sizeof(unsigned int) + totalExperiences * 16);
+
+    runner.Run("ExperienceFile.Save", [&]
+    {
+        DoNotOptimize(writeAll());
+    }, state);
+
+    writeAll();
+    double fileBytes = (double)ExperienceFileReader::TryOpen(path)->Size();
+    runner.Run("ExperienceFile.Load", [&]
+    {
+        auto reader = ExperienceFileReader::TryOpen(path);
+        uint64_t totalRectangles = 0;
+        reader->ForEachExperience([&](const unsigned int* rectangleWords, int count, float, float)
+        {
+            totalRectangles += count + rectangleWords[0];
+        });
+
+        DoNotOptimize(totalRectangles);
+    }, state, [&](BenchmarkResult& result)
+    {
+        result.counters.emplace_back("bytes_per_experience", fileBytes / totalExperiences);
+        result.counters.emplace_back("compression_ratio", state.bytesPerIteration / fileBytes);
+    });
+
+    remove(path.c_str());
+
+    // Damaged files have to be turned away without throwing, creating anything or allocating what a corrupt count asks for
+    runner.Check("ExperienceFile.RejectsDamagedFiles", [&](BenchmarkResult& result)
+    {
+        const std::string damagedPath = "bench_damaged_experiences.bin";
+        auto writeBytes = [&](const std::vector<unsigned char>& bytes)
+        {
+            FILE* file = fopen(damagedPath.c_str(), "wb");
+            fwrite(bytes.data(), 1, bytes.size(), file);
+            fclose(file);
+        };
+
+        // One experience with enough rectangles that its count takes two varint bytes
+        {
+            ExperienceFileWriter writer(damagedPath, 0);
+            writer.WriteExperience(words.data(), 200, 1, 2);
+            writer.Close();
+        }
+
+        std::vector<unsigned char> validBytes(ExperienceFileReader::TryOpen(damagedPath)->Size());
+        FILE* validFile = fopen(damagedPath.c_str(), "rb");
+        validBytes.resize(fread(validBytes.data(), 1, validBytes.size(), validFile));
+        fclose(validFile);
+
+        int rejected = 0;
+        int cases = 0;
+        auto expectRejected = [&](bool wasRejected)
+        {
+            ++cases;
+            rejected += wasRejected ? 1 : 0;
+        };
+
+        auto readAll = [&]
+        {
+            auto reader = ExperienceFileReader::TryOpen(damagedPath);
+            return reader != nullptr && reader->ForEachExperience([](const unsigned int*, int, float, float) { });
+        };
+
+        remove(damagedPath.c_str());
+        expectRejected(ExperienceFileReader::TryOpen(damagedPath) == nullptr);
+        FILE* created = fopen(damagedPath.c_str(), "rb");
+        expectRejected(created == nullptr);
+        if (created != nullptr)
+        {
+            fclose(created);
+        }
+
+        writeBytes({ });
+        expectRejected(!readAll());
+
+        writeBytes(std::vector<unsigned char>(validBytes.begin(), validBytes.begin() + sizeof(ExperienceFileHeader) / 2));
+        expectRejected(!readAll());
+
+        writeBytes(std::vector<unsigned char>(validBytes.begin(), validBytes.begin() + validBytes.size() / 2));
+        expectRejected(!readAll());
+
+        // A rectangle count of 16383 in the same two bytes
+        auto corruptCount = validBytes;
+        corruptCount[sizeof(ExperienceFileHeader)] = 0xFF;
+        corruptCount[sizeof(ExperienceFileHeader) + 1] = 0x7F;
+        writeBytes(corruptCount);
+        expectRejected(!readAll());
+
+        writeBytes(validBytes);
+        bool validFileReads = readAll();
+        remove(damagedPath.c_str());
+
+        result.counters.emplace_back("damaged_files", cases);
+        result.counters.emplace_back("rejected", rejected);
+        return rejected == cases && validFileReads;
+    });
+}
+
+static void BenchmarkNetworkSwap(BenchmarkRunner& runner)
+{
+    auto network = std::make_shared<TinyNetwork>();
+
+    std::stringstream savedNetwork;
+    TorchSave(network->module, savedNetwork);
+    auto serializedNetwork = savedNetwork.str();
+
+    BenchmarkState state;
+    state.bytesPerIteration = (double)serializedNetwork.size();
+
+    runner.Run("TorchSave", [&]
+    {
+        std::stringstream stream;
+        TorchSave(network->module, stream);
+        DoNotOptimize(stream.tellp());
+    }, state);
+
+    runner.Run("TorchLoad", [&]
+    {
+        std::stringstream stream(serializedNetwork);
+        auto newNetwork = std::make_shared<TinyNetwork>();
+        TorchLoad(newNetwork->module, stream);
+        DoNotOptimize(newNetwork.get());
+    }, state);
+}
+
+static void BenchmarkDecider(BenchmarkRunner& runner)
+{
+    for (int batchSize : { 1, 32 })
+    {
+        auto decider = std::make_shared<Decider<TinyNetwork>>();
+        decider->networkContext = std::make_shared<NetworkContext<TinyNetwork>>(decider.get(), nullptr, 1);
+
+        MlUtil::SharedArray<BenchInput> input(batchSize);
+        MlUtil::SharedArray<BenchOutput> output(batchSize);
+
+        BenchmarkState state;
+        state.itemsPerIteration = batchSize;
+        runner.Run("Decider.MakeDecision/batch:" + std::to_string(batchSize), [&]
+        {
+            long long decisionsBefore = TinyNetwork::decisionsMade;
+            decider->MakeDecision(input, output, 1, batchSize);
+
+            while (TinyNetwork::decisionsMade.load(std::memory_order_acquire) == decisionsBefore)
+            {
+                std::this_thread::yield();
+            }
+        }, state);
+    }
+}
+
+static void BenchmarkQuantizedInference(BenchmarkRunner& runner)
+{
+    TinyNetwork network;
+    if (!network.PrepareQuantizedInference())
+    {
+        return;
+    }
+
+    auto addQuantizedCounters = [&](BenchmarkResult& result)
+    {
+        result.counters.emplace_back("quantized_layers", network.quantized.TotalLayers());
+        result.counters.emplace_back("unpacked_int8_bytes", (double)network.quantized.UnpackedBytes());
+    };
+
+    RandomNumberGenerator rng(7);
+    BenchSample sample;
+
+    for (int batchSize : { 1, 32 })
+    {
+        std::vector<BenchInput> inputs(batchSize);
+        for (auto& input : inputs)
+        {
+            FillRandomSample(sample, rng, TinyNetwork::TotalActions);
+            input = sample.input;
+        }
+
+        std::vector<BenchOutput> fp32Outputs(batchSize);
+        std::vector<BenchOutput> int8Outputs(batchSize);
+        Grid<const BenchInput> grid(batchSize, 1, inputs.data());
+
+        BenchmarkState state;
+        state.itemsPerIteration = batchSize;
+
+        network.SetQuantizedInferenceEnabled(false);
+        runner.Run("MakeDecision/fp32/batch:" + std::to_string(batchSize), [&]
+        {
+            network.MakeDecision(grid, gsl::span<BenchOutput>(fp32Outputs));
+        }, state);
+
+        network.SetQuantizedInferenceEnabled(true);
+        runner.Run("MakeDecision/int8/batch:" + std::to_string(batchSize), [&]
+        {
+            network.MakeDecision(grid, gsl::span<BenchOutput>(int8Outputs));
+        }, state, addQuantizedCounters);
+
+        // Held to the same agreement the network context asks of a quantized network before deciders use it
+        runner.Check("MakeDecision/int8/batch:" + std::to_string(batchSize) + "/agrees-with-fp32", [&](BenchmarkResult& result)
+        {
+            network.SetQuantizedInferenceEnabled(false);
+            network.MakeDecision(grid, gsl::span<BenchOutput>(fp32Outputs));
+            network.SetQuantizedInferenceEnabled(true);
+            network.MakeDecision(grid, gsl::span<BenchOutput>(int8Outputs));
+
+            int matches = 0;
+            for (int i = 0; i < batchSize; ++i)
+            {
+                matches += fp32Outputs[i].action == int8Outputs[i].action ? 1 : 0;
+            }
+
+            float agreement = (float)matches / batchSize;
+            result.counters.emplace_back("agreement", agreement);
+            return agreement >= QuantizedInferenceOptions<BenchOutput>().minAgreement;
+        });
+    }
+}
+
+static void BenchmarkMixedPrecision(BenchmarkRunner& runner)
+{
+    const int batchSize = 64;
+    const int totalSamples = 4096;
+    const int lossSteps = 500;
+
+    // A task the network can actually learn: the action is the quadrant the velocity points into
+    RandomNumberGenerator rng(11);
+    std::vector<BenchSample> samples(totalSamples);
+    for (auto& sample : samples)
+    {
+        FillRandomSample(sample, rng, TinyNetwork::TotalActions);
+        sample.output.action = (sample.input.velocityX > 0 ? 1 : 0) + (sample.input.velocityY > 0 ? 2 : 0);
+    }
+
+    int batchStart = 0;
+    auto trainStep = [&](TinyNetwork& network, TrainingPrecision precision, TrainingBatchResult& result)
+    {
+        MixedPrecisionScope mixedPrecision(precision);
+        network.TrainBatch(Grid<const BenchSample>(batchSize, 1, &samples[batchStart]), result);
+        batchStart = (batchStart + batchSize) % totalSamples;
+    };
+
+    for (auto precision : { TrainingPrecision::Float32, TrainingPrecision::BFloat16 })
+    {
+        std::string name = precision == TrainingPrecision::BFloat16 ? "bf16" : "fp32";
+        TinyNetwork network;
+        network.trainingPrecision = precision;
+        TrainingBatchResult result;
+
+        BenchmarkState state;
+        state.itemsPerIteration = batchSize;
+        runner.Run("TrainBatch/" + name + "/batch:" + std::to_string(batchSize), [&]
+        {
+            trainStep(network, precision, result);
+            DoNotOptimize(result.loss);
+        }, state);
+    }
+
+    // bf16 only changes how the forward pass is computed, so it should learn the task about as well as fp32 does
+    runner.Check("TrainBatch/bf16/loss-matches-fp32", [&](BenchmarkResult& result)
+    {
+        auto trainLoss = [&](TrainingPrecision precision)
+        {
+            // Same seed and data for both precisions, so the losses are comparable
+            torch::manual_seed(1);
+            TinyNetwork network;
+            network.trainingPrecision = precision;
+            batchStart = 0;
+
+            float finalLoss = 0;
+            for (int step = 0; step < lossSteps; ++step)
+            {
+                TrainingBatchResult batchResult;
+                trainStep(network, precision, batchResult);
+                if (step >= lossSteps - 50)
+                {
+                    finalLoss += batchResult.loss / 50;
+                }
+            }
+
+            return finalLoss;
+        };
+
+        float fp32Loss = trainLoss(TrainingPrecision::Float32);
+        float bf16Loss = trainLoss(TrainingPrecision::BFloat16);
+        result.counters.emplace_back("fp32_loss", fp32Loss);
+        result.counters.emplace_back("bf16_loss", bf16Loss);
+        result.counters.emplace_back("batches", lossSteps);
+        return std::isfinite(bf16Loss) && bf16Loss <= fp32Loss * 1.1f + 0.01f;
+    });
+}
+
+static void BenchmarkTrainingBatch(BenchmarkRunner& runner)
+{
+    struct ThrowingNetwork : TinyNetwork
+    {
+        void TrainBatch(Grid<const SampleType> input, TrainingBatchResult& outResult) override
+        {
+            if (throwsNextBatch)
+            {
+                throwsNextBatch = false;
+                throw StrifeException("Training failed");
+            }
+
+            TinyNetwork::TrainBatch(input, outResult);
+        }
+
+        bool throwsNextBatch = true;
+    };
+
+    struct FixedSampleTrainer : Trainer<TinyNetwork>
+    {
+        FixedSampleTrainer()
+            : Trainer<TinyNetwork>(32, 1, 1, 1)
+        {
+            RandomNumberGenerator sampleRng(1);
+            FillRandomSample(sample, sampleRng, TinyNetwork::TotalActions);
+        }
+
+        bool TrySelectSequenceSamples(gsl::span<SampleType> outSequence) override
+        {
+            std::fill(outSequence.begin(), outSequence.end(), sample);
+            return true;
+        }
+
+        SampleType sample;
+    };
+
+    // A batch that throws must still end, or every later tick is skipped as if that batch were still running
+    runner.Check("TrainingBatch.RecoversFromThrowingBatch", [&](BenchmarkResult& result)
+    {
+        auto trainer = std::make_shared<FixedSampleTrainer>();
+        trainer->network = std::make_shared<ThrowingNetwork>();
+        trainer->isTraining = true;
+
+        RunTrainingBatchWorkItem<TinyNetwork> batch(trainer);
+        bool threw = false;
+        try
+        {
+            batch.Execute();
+        }
+        catch (const StrifeException&)
+        {
+            threw = true;
+        }
+
+        batch.Execute();
+        result.counters.emplace_back("batches_trained", (double)trainer->batchesTrained);
+        result.counters.emplace_back("skipped_ticks", trainer->skippedTicks);
+        return threw && trainer->batchesTrained == 1 && trainer->skippedTicks == 0;
+    });
+}
+
+static void BenchmarkCheckpoint(BenchmarkRunner& runner)
+{
+    struct CheckpointTrainer : Trainer<TinyNetwork>
+    {
+        CheckpointTrainer(const std::string& name, int batchesPerCheckpoint)
+            : Trainer<TinyNetwork>(32, 1, 1, 1)
+        {
+            network = std::make_shared<TinyNetwork>();
+            agents = sampleRepository.CreateSampleSet("agents");
+            checkpoints.isEnabled = true;
+            checkpoints.directory = ".";
+            checkpoints.name = name;
+            checkpoints.batchesPerCheckpoint = batchesPerCheckpoint;
+        }
+
+        SampleSet<SampleType>* agents;
+    };
+
+    auto removeCheckpoints = [](const CheckpointSettings& settings)
+    {
+        for (int slot = 0; slot < settings.keepCount; ++slot)
+        {
+            remove((settings.directory + "/" + settings.name + "-" + std::to_string(slot) + ".checkpoint").c_str());
+        }
+    };
+
+    auto trainer = std::make_shared<CheckpointTrainer>("bench", 1);
+    std::stringstream serializedNetwork;
+    TorchSave(trainer->network->module, serializedNetwork);
+
+    // What the training thread pays per checkpoint, mostly SaveOptimizer(); the file is written in the background. Reported
+    // next to the network save every published batch already pays.
+    BenchmarkState state;
+    state.bytesPerIteration = (double)serializedNetwork.str().size();
+    runner.Run("Checkpoint.Take", [&]
+    {
+        ++trainer->batchesTrained;
+        trainer->CheckpointIfDue(serializedNetwork);
+    }, state, [&](BenchmarkResult& result)
+    {
+        const int publishSaves = 16;
+        auto publishStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < publishSaves; ++i)
+        {
+            std::stringstream publishStream;
+            TorchSave(trainer->network->module, publishStream);
+        }
+
+        double publishNanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - publishStart).count() / publishSaves;
+        result.counters.emplace_back("publish_save_ns", publishNanoseconds);
+        result.counters.emplace_back("pause_per_publish_save", publishNanoseconds > 0 ? result.nanosecondsPerIteration / publishNanoseconds : 0);
+
+        trainer->checkpointWriter->Flush();
+        result.counters.emplace_back("checkpoints_taken", (double)trainer->batchesTrained);
+        result.counters.emplace_back("checkpoints_written", (double)trainer->checkpointWriter->CheckpointsWritten());
+    });
+
+    // Resume needs a checkpoint on disk even when Checkpoint.Take was filtered out
+    ++trainer->batchesTrained;
+    trainer->CheckpointIfDue(serializedNetwork);
+    trainer->checkpointWriter->Flush();
+
+    auto resumedTrainer = std::make_shared<CheckpointTrainer>("bench", 1);
+    runner.Run("Checkpoint.Resume", [&]
+    {
+        DoNotOptimize(resumedTrainer->TryResumeFromCheckpoint());
+    }, state);
+
+    trainer = nullptr;
+    removeCheckpoints(resumedTrainer->checkpoints);
+
+    // A resumed trainer has to carry on with the counters and random streams of the newest checkpoint, not where training
+    // stopped after it
+    runner.Check("Checkpoint.ResumesTrainerState", [&](BenchmarkResult& result)
+    {
+        const int totalBatches = 9;
+        int64_t checkpointedBatches = 0;
+        int checkpointedSkippedTicks = 0;
+        uint64_t nextRandom = 0;
+        uint64_t nextSampleSetRandom = 0;
+
+        auto checkpointedTrainer = std::make_shared<CheckpointTrainer>("bench-resume", 2);
+        for (int batch = 0; batch < totalBatches; ++batch)
+        {
+            checkpointedTrainer->rng.NextUInt64();
+            checkpointedTrainer->agents->GetRandomNumberGenerator().NextUInt64();
+            checkpointedTrainer->skippedTicks = batch;
+
+            TrainingBatchResult batchResult;
+            checkpointedTrainer->NotifyTrainingComplete(serializedNetwork, batchResult);
+            checkpointedTrainer->CheckpointIfDue(serializedNetwork);
+            if (checkpointedTrainer->batchesTrained % checkpointedTrainer->checkpoints.batchesPerCheckpoint == 0)
+            {
+                checkpointedTrainer->checkpointWriter->Flush();
+                checkpointedBatches = checkpointedTrainer->batchesTrained;
+                checkpointedSkippedTicks = batch;
+
+                auto rng = checkpointedTrainer->rng;
+                nextRandom = rng.NextUInt64();
+                auto sampleSetRng = checkpointedTrainer->agents->GetRandomNumberGenerator();
+                nextSampleSetRandom = sampleSetRng.NextUInt64();
+            }
+        }
+
+        auto settings = checkpointedTrainer->checkpoints;
+        checkpointedTrainer = nullptr;
+
+        auto resumed = std::make_shared<CheckpointTrainer>("bench-resume", 2);
+        bool passed = resumed->TryResumeFromCheckpoint()
+            && resumed->batchesTrained == checkpointedBatches
+            && resumed->skippedTicks == checkpointedSkippedTicks
+            && resumed->rng.NextUInt64() == nextRandom
+            && resumed->agents->GetRandomNumberGenerator().NextUInt64() == nextSampleSetRandom;
+
+        result.counters.emplace_back("batches_trained", totalBatches);
+        result.counters.emplace_back("batches_resumed", (double)resumed->batchesTrained);
+        resumed = nullptr;
+        removeCheckpoints(settings);
+        return passed;
+    });
+
+    // A damaged newest checkpoint has to be passed over for the one before it, whether the damage is in the payload, the
+    // header or a torn write, and nothing is resumed from if every slot is damaged
+    runner.Check("Checkpoint.RejectsDamagedCheckpoints", [&](BenchmarkResult& result)
+    {
+        CheckpointSettings settings;
+        settings.isEnabled = true;
+        settings.name = "bench-damaged";
+        settings.keepCount = 2;
+
+        auto slotPath = [&](int slot)
+        {
+            return settings.directory + "/" + settings.name + "-" + std::to_string(slot) + ".checkpoint";
+        };
+
+        // Batches 1 and 2 in slots 0 and 1
+        auto writeCheckpoints = [&]
+        {
+            removeCheckpoints(settings);
+            CheckpointWriter writer(settings);
+            for (int batch = 1; batch <= 2; ++batch)
+            {
+                auto checkpoint = std::make_shared<Checkpoint>();
+                checkpoint->batchesTrained = batch;
+                checkpoint->SetPart("network", serializedNetwork.str());
+                writer.Write(checkpoint);
+                writer.Flush();
+            }
+        };
+
+        auto overwriteByte = [&](int slot, long offset)
+        {
+            FILE* file = fopen(slotPath(slot).c_str(), "r+b");
+            fseek(file, offset, SEEK_SET);
+            int byte = fgetc(file);
+            fseek(file, offset, SEEK_SET);
+            fputc(byte ^ 0x5A, file);
+            fclose(file);
+        };
+
+        auto truncateSlot = [&](int slot, size_t size)
+        {
+            FILE* file = fopen(slotPath(slot).c_str(), "rb");
+            std::vector<unsigned char> bytes(size);
+            bytes.resize(fread(bytes.data(), 1, size, file));
+            fclose(file);
+
+            file = fopen(slotPath(slot).c_str(), "wb");
+            fwrite(bytes.data(), 1, bytes.size(), file);
+            fclose(file);
+        };
+
+        auto newestBatch = [&]() -> int64_t
+        {
+            Checkpoint checkpoint;
+            return CheckpointWriter::TryReadNewest(settings, checkpoint) ? (int64_t)checkpoint.batchesTrained : -1;
+        };
+
+        int failedCases = 0;
+        int totalCases = 0;
+        auto expectNewest = [&](int64_t expectedBatch)
+        {
+            ++totalCases;
+            failedCases += newestBatch() == expectedBatch ? 0 : 1;
+        };
+
+        writeCheckpoints();
+        expectNewest(2);
+
+        overwriteByte(1, sizeof(CheckpointHeader) + 8);
+        expectNewest(1);
+
+        writeCheckpoints();
+        overwriteByte(1, offsetof(CheckpointHeader, batchesTrained));
+        expectNewest(1);
+
+        writeCheckpoints();
+        overwriteByte(1, offsetof(CheckpointHeader, payloadBytes) + 4);
+        expectNewest(1);
+
+        writeCheckpoints();
+        truncateSlot(1, sizeof(CheckpointHeader) + 16);
+        expectNewest(1);
+
+        truncateSlot(0, sizeof(CheckpointHeader) / 2);
+        expectNewest(-1);
+
+        removeCheckpoints(settings);
+        result.counters.emplace_back("cases", totalCases);
+        result.counters.emplace_back("failed_cases", failedCases);
+        return failedCases == 0;
+    });
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkRunner runner(ParseBenchmarkSettings(argc, argv));
+
+    BenchmarkSampleSet(runner);
+    BenchmarkSampleCodec(runner);
+    BenchmarkGroupedSampleView(runner);
+    BenchmarkSequenceBatch(runner);
+    BenchmarkObjectSerializer(runner);
+    BenchmarkPackIntoTensor(runner);
+    BenchmarkPerceptionGrid(runner);
+    BenchmarkBatchedPerception(runner);
+    BenchmarkExperienceFile(runner);
+    BenchmarkNetworkSwap(runner);
+    BenchmarkDecider(runner);
+    BenchmarkQuantizedInference(runner);
+    BenchmarkMixedPrecision(runner);
+    BenchmarkTrainingBatch(runner);
+    BenchmarkCheckpoint(runner);
+
+    return runner.FailedChecks() == 0 ? 0 : 1;
+}
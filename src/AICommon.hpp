@@ -6,6 +6,7 @@
 
 #include "Memory/Grid.hpp"
 #include "Math/Vector2.hpp"
+#include "BitPlaneGrid.hpp"
 #include "Memory/ConcurrentQueue.hpp"
 
 const int PerceptionGridRows = 40;
@@ -79,6 +80,12 @@ private:
 	unsigned int _value;
 };
 
+// The 4-bit observed object of each cell as four planes of 40-bit row masks. See BitPlaneGrid.
+using PerceptionBitGrid = BitPlaneGrid<
+	PerceptionGridRows,
+	PerceptionGridCols,
+	1 << CompressedPerceptionGridRectangle::ObservedObjectBits>;
+
 
 struct Sample
 {
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// A grid of small integer values stored as bit planes: plane k has a row mask per row with bit c set where bit k of the value in
+// column c is set. A 40x40 grid of 4-bit values is four planes of 40 masks, 1.25KB instead of 12.8KB as a Grid<long long>.
+//
+// Filling a rectangle is one OR or AND-NOT per plane per row instead of a write per cell, and it overwrites whatever was there,
+// the same as filling a dense grid. The mask of cells holding a particular value, which is what one-hot encoding needs, is a
+// few ANDs away (see ValueMask()). Expanding into a dense or one-hot buffer is left until the grid is packed for the network, and
+// works a byte of row mask at a time.
+template<int Rows, int Cols, int TotalValues>
+class BitPlaneGrid
+{
+public:
+	using RowMask = uint64_t;
+
+	static_assert(Cols <= 64, "Each row has to fit in a 64-bit mask");
+	static_assert(TotalValues >= 2 && TotalValues <= 256, "Expansion works with values that fit in a byte");
+
+	static constexpr int BitsPerValue()
+	{
+		int bits = 1;
+		while ((1 << bits) < TotalValues)
+		{
+			++bits;
+		}
+
+		return bits;
+	}
+
+	static constexpr int TotalPlanes = BitsPerValue();
+	static constexpr RowMask AllColumns = Cols == 64 ? ~RowMask(0) : (RowMask(1) << Cols) - 1;
+
+	void Clear()
+	{
+		memset(_planes, 0, sizeof(_planes));
+	}
+
+	// Clipped to the grid
+	void FillRectangle(int x, int y, int width, int height, int value)
+	{
+		int left = x < 0 ? 0 : x;
+		int top = y < 0 ? 0 : y;
+		int right = x + width > Cols ? Cols : x + width;
+		int bottom = y + height > Rows ? Rows : y + height;
+
+		if (left >= right || top >= bottom)
+		{
+			return;
+		}
+
+		FillRows(top, bottom, ColumnMask(left, right), value);
+	}
+
+	// Sets the cells in columns to value for every row in [top, bottom)
+	void FillRows(int top, int bottom, RowMask columns, int value)
+	{
+		RowMask setColumns[TotalPlanes];
+		for (int plane = 0; plane < TotalPlanes; ++plane)
+		{
+			setColumns[plane] = ((value >> plane) & 1) ? columns : 0;
+		}
+
+		for (int row = top; row < bottom; ++row)
+		{
+			for (int plane = 0; plane < TotalPlanes; ++plane)
+			{
+				_planes[plane][row] = (_planes[plane][row] & ~columns) | setColumns[plane];
+			}
+		}
+	}
+
+	int Get(int row, int col) const
+	{
+		int value = 0;
+		for (int plane = 0; plane < TotalPlanes; ++plane)
+		{
+			value |= static_cast<int>((_planes[plane][row] >> col) & 1) << plane;
+		}
+
+		return value;
+	}
+
+	// The cells in row that hold value
+	RowMask ValueMask(int value, int row) const
+	{
+		RowMask mask = AllColumns;
+		for (int plane = 0; plane < TotalPlanes; ++plane)
+		{
+			mask &= ((value >> plane) & 1)
+				? _planes[plane][row]
+				: ~_planes[plane][row];
+		}
+
+		return mask;
+	}
+
+	// The cells in row that hold anything other than 0
+	RowMask Occupied(int row) const
+	{
+		RowMask occupied = 0;
+		for (int plane = 0; plane < TotalPlanes; ++plane)
+		{
+			occupied |= _planes[plane][row];
+		}
+
+		return occupied;
+	}
+
+	RowMask PlaneRow(int plane, int row) const
+	{
+		return _planes[plane][row];
+	}
+
+	RowMask& PlaneRow(int plane, int row)
+	{
+		return _planes[plane][row];
+	}
+
+	// Writes Rows * Cols values in row-major order
+	template<typename T>
+	void ExpandToDense(T* outValues) const
+	{
+		unsigned char cells[PaddedCols];
+		for (int row = 0; row < Rows; ++row, outValues += Cols)
+		{
+			for (int col = 0; col < Cols; col += 8)
+			{
+				uint64_t cellBytes = 0;
+				for (int plane = 0; plane < TotalPlanes; ++plane)
+				{
+					cellBytes |= SpreadByte(_planes[plane][row] >> col) << plane;
+				}
+
+				memcpy(cells + col, &cellBytes, sizeof(cellBytes));
+			}
+
+			WriteRow(cells, outValues);
+		}
+	}
+
+	// Writes TotalValues channels of Rows * Cols, so channel v is 1 wherever the cell holds v and 0 everywhere else
+	template<typename T>
+	void ExpandToOneHot(T* outChannels) const
+	{
+		unsigned char cells[PaddedCols];
+		for (int value = 0; value < TotalValues; ++value)
+		{
+			for (int row = 0; row < Rows; ++row, outChannels += Cols)
+			{
+				RowMask mask = ValueMask(value, row);
+				for (int col = 0; col < Cols; col += 8)
+				{
+					uint64_t cellBytes = SpreadByte(mask >> col);
+					memcpy(cells + col, &cellBytes, sizeof(cellBytes));
+				}
+
+				WriteRow(cells, outChannels);
+			}
+		}
+	}
+
+	bool operator==(const BitPlaneGrid& rhs) const
+	{
+		return memcmp(_planes, rhs._planes, sizeof(_planes)) == 0;
+	}
+
+	bool operator!=(const BitPlaneGrid& rhs) const
+	{
+		return !(*this == rhs);
+	}
+
+private:
+	static constexpr int PaddedCols = (Cols + 7) / 8 * 8;
+
+	// Byte i of _spreadTable.bytes[b], in memory order, is bit i of b. Spread bytes hold 0 or 1, so shifting them left by less than
+	// 8 bits never carries into the next byte whatever the endianness.
+	struct SpreadTable
+	{
+		constexpr SpreadTable()
+			: bytes()
+		{
+			for (int b = 0; b < 256; ++b)
+			{
+				for (int i = 0; i < 8; ++i)
+				{
+					bytes[b][i] = static_cast<unsigned char>((b >> i) & 1);
+				}
+			}
+		}
+
+		unsigned char bytes[256][8];
+	};
+
+	static constexpr SpreadTable _spreadTable { };
+
+	static uint64_t SpreadByte(RowMask mask)
+	{
+		uint64_t spread;
+		memcpy(&spread, _spreadTable.bytes[mask & 0xFF], sizeof(spread));
+		return spread;
+	}
+
+	// One long conversion loop per row rather than one per eight cells, so it vectorizes
+	template<typename T>
+	static void WriteRow(const unsigned char* cells, T* outRow)
+	{
+		for (int col = 0; col < Cols; ++col)
+		{
+			outRow[col] = static_cast<T>(cells[col]);
+		}
+	}
+
+	static RowMask ColumnMask(int left, int right)
+	{
+		RowMask belowRight = right == 64 ? ~RowMask(0) : (RowMask(1) << right) - 1;
+		RowMask belowLeft = (RowMask(1) << left) - 1;
+		return belowRight & ~belowLeft;
+	}
+
+	RowMask _planes[TotalPlanes][Rows] { };
+};
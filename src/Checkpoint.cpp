@@ -0,0 +1,299 @@
+#include "StrifeML.hpp"
+
+namespace StrifeML
+{
+    // FNV-1a, eight bytes at a time folded into four independent lanes so it isn't limited by one multiply per byte
+    static uint64_t ChecksumBytes(const unsigned char* data, size_t size)
+    {
+        const uint64_t prime = 0x100000001B3ull;
+        uint64_t lanes[4] = { 0xCBF29CE484222325ull, 0x84222325CBF29CE4ull, 0x9CE484222325CBF2ull, 0x2325CBF29CE48422ull };
+
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                uint64_t word;
+                memcpy(&word, data + i + lane * 8, sizeof(word));
+                lanes[lane] = (lanes[lane] ^ word) * prime;
+            }
+        }
+
+        uint64_t hash = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+        for (; i < size; ++i)
+        {
+            hash = (hash ^ data[i]) * prime;
+        }
+
+        return (hash ^ size) * prime;
+    }
+
+    // Covers the header as well as the payload, so a checkpoint whose index or counters were corrupted isn't resumed from
+    static uint64_t ChecksumCheckpoint(const CheckpointHeader& header, const unsigned char* payload, size_t payloadSize)
+    {
+        CheckpointHeader headerWithoutChecksum = header;
+        headerWithoutChecksum.checksum = 0;
+
+        uint64_t headerChecksum = ChecksumBytes(reinterpret_cast<const unsigned char*>(&headerWithoutChecksum), sizeof(headerWithoutChecksum));
+        return (ChecksumBytes(payload, payloadSize) ^ headerChecksum) * 0x100000001B3ull;
+    }
+
+    static std::string GetSlotPath(const CheckpointSettings& settings, int slot)
+    {
+        return settings.directory + "/" + settings.name + "-" + std::to_string(slot) + ".checkpoint";
+    }
+
+    static bool TryReadHeader(FILE* file, CheckpointHeader& outHeader)
+    {
+        return fread(&outHeader, sizeof(outHeader), 1, file) == 1
+            && outHeader.magic == CheckpointHeader::Magic
+            && outHeader.version == CheckpointHeader::CurrentVersion;
+    }
+
+    static bool TryReadCheckpoint(const std::string& path, CheckpointHeader& outHeader, Checkpoint& outCheckpoint)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        // The header's payload size is checked against the file before anything is allocated for it, since a corrupted
+        // size could be anything
+        long fileSize = -1;
+        if (fseek(file, 0, SEEK_END) == 0)
+        {
+            fileSize = ftell(file);
+        }
+
+        std::vector<unsigned char> payload;
+        bool successful = fileSize >= (long)sizeof(CheckpointHeader)
+            && fseek(file, 0, SEEK_SET) == 0
+            && TryReadHeader(file, outHeader)
+            && outHeader.payloadBytes == (uint64_t)fileSize - sizeof(CheckpointHeader);
+
+        if (successful)
+        {
+            payload.resize(outHeader.payloadBytes);
+            successful = fread(payload.data(), 1, payload.size(), file) == payload.size()
+                && ChecksumCheckpoint(outHeader, payload.data(), payload.size()) == outHeader.checksum;
+        }
+
+        fclose(file);
+        if (!successful)
+        {
+            return false;
+        }
+
+        outCheckpoint = Checkpoint();
+        outCheckpoint.batchesTrained = outHeader.batchesTrained;
+
+        size_t offset = 0;
+        while (offset < payload.size())
+        {
+            uint32_t nameLength;
+            uint64_t size;
+            if (payload.size() - offset < sizeof(nameLength))
+            {
+                return false;
+            }
+
+            memcpy(&nameLength, &payload[offset], sizeof(nameLength));
+            offset += sizeof(nameLength);
+            if (payload.size() - offset < (uint64_t)nameLength + sizeof(size))
+            {
+                return false;
+            }
+
+            std::string name((const char*)&payload[offset], nameLength);
+            offset += nameLength;
+            memcpy(&size, &payload[offset], sizeof(size));
+            offset += sizeof(size);
+            if (payload.size() - offset < size)
+            {
+                return false;
+            }
+
+            outCheckpoint.SetPart(name, std::string((const char*)&payload[offset], size));
+            offset += size;
+        }
+
+        return true;
+    }
+
+    CheckpointWriter::CheckpointWriter(const CheckpointSettings& settings)
+        : _settings(settings)
+    {
+        _settings.keepCount = std::max(1, _settings.keepCount);
+
+        auto metrics = MetricsRegistry::GetInstance();
+        auto labels = MetricLabel("checkpoint", settings.name);
+        _writtenCounter = metrics->GetCounter("strifeml_checkpoints_written_total", "Checkpoints written to disk", labels);
+        _replacedCounter = metrics->GetCounter("strifeml_checkpoints_replaced_total", "Checkpoints replaced by a newer one before they were written", labels);
+        _failedCounter = metrics->GetCounter("strifeml_checkpoints_failed_total", "Checkpoints that couldn't be written", labels);
+        _bytesCounter = metrics->GetCounter("strifeml_checkpoint_bytes_total", "Bytes of checkpoints written", labels);
+        _writeLatency = metrics->GetHistogram("strifeml_checkpoint_write_seconds", "Time to write a checkpoint to disk", labels);
+
+        // Carry on from the newest slot, so a restarted trainer doesn't overwrite the checkpoint it just resumed from
+        for (int slot = 0; slot < _settings.keepCount; ++slot)
+        {
+            FILE* file = fopen(GetSlotPath(_settings, slot).c_str(), "rb");
+            if (file == nullptr)
+            {
+                continue;
+            }
+
+            CheckpointHeader header;
+            if (TryReadHeader(file, header) && header.index + 1 > _nextIndex)
+            {
+                _nextIndex = header.index + 1;
+            }
+
+            fclose(file);
+        }
+
+        _thread = std::thread([this] { RunWriter(); });
+    }
+
+    CheckpointWriter::~CheckpointWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _isStopping = true;
+        }
+
+        _checkpointAdded.notify_one();
+        _thread.join();
+    }
+
+    void CheckpointWriter::Write(std::shared_ptr<const Checkpoint> checkpoint)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_pending != nullptr)
+            {
+                _replacedCounter->Add();
+            }
+
+            _pending = std::move(checkpoint);
+        }
+
+        _checkpointAdded.notify_one();
+    }
+
+    void CheckpointWriter::Flush()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _checkpointWritten.wait(lock, [this] { return _pending == nullptr && !_isWriting; });
+    }
+
+    bool CheckpointWriter::TryReadNewest(const CheckpointSettings& settings, Checkpoint& outCheckpoint)
+    {
+        // Slots are few, so read them all and keep the newest one that checks out
+        bool foundCheckpoint = false;
+        uint64_t newestIndex = 0;
+        Checkpoint checkpoint;
+        for (int slot = 0; slot < std::max(1, settings.keepCount); ++slot)
+        {
+            CheckpointHeader header;
+            if (TryReadCheckpoint(GetSlotPath(settings, slot), header, checkpoint) && (!foundCheckpoint || header.index > newestIndex))
+            {
+                outCheckpoint = std::move(checkpoint);
+                newestIndex = header.index;
+                foundCheckpoint = true;
+            }
+        }
+
+        return foundCheckpoint;
+    }
+
+    void CheckpointWriter::RunWriter()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _checkpointAdded.wait(lock, [this] { return _pending != nullptr || _isStopping; });
+
+            // Whatever is waiting when the writer is stopped still gets written, since it's the newest state there is
+            if (_pending == nullptr)
+            {
+                return;
+            }
+
+            auto checkpoint = std::move(_pending);
+            _pending = nullptr;
+            _isWriting = true;
+            lock.unlock();
+
+            ScopedLatencyTimer writeTimer(_writeLatency);
+            if (TryWriteCheckpoint(*checkpoint))
+            {
+                _writtenCounter->Add();
+                _checkpointsWritten.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                _failedCounter->Add();
+            }
+
+            lock.lock();
+            _isWriting = false;
+            _checkpointWritten.notify_all();
+        }
+    }
+
+    bool CheckpointWriter::TryWriteCheckpoint(const Checkpoint& checkpoint)
+    {
+        _payload.clear();
+        for (auto& partPair : checkpoint.parts)
+        {
+            uint32_t nameLength = (uint32_t)partPair.first.size();
+            uint64_t size = partPair.second.size();
+            auto append = [this](const void* data, size_t dataSize)
+            {
+                auto bytes = reinterpret_cast<const unsigned char*>(data);
+                _payload.insert(_payload.end(), bytes, bytes + dataSize);
+            };
+
+            append(&nameLength, sizeof(nameLength));
+            append(partPair.first.data(), nameLength);
+            append(&size, sizeof(size));
+            append(partPair.second.data(), size);
+        }
+
+        CheckpointHeader header;
+        header.index = _nextIndex;
+        header.batchesTrained = checkpoint.batchesTrained;
+        header.payloadBytes = _payload.size();
+        header.checksum = ChecksumCheckpoint(header, _payload.data(), _payload.size());
+
+        // Written to the side and swapped in, so the slot only ever holds a complete checkpoint or the one before it
+        auto path = GetSlotPath(_settings, (int)(_nextIndex % _settings.keepCount));
+        auto temporaryPath = path + ".tmp";
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        bool wroteAll = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(_payload.data(), 1, _payload.size(), file) == _payload.size();
+        wroteAll = fclose(file) == 0 && wroteAll;
+
+        if (!wroteAll)
+        {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+
+        if (!TryReplaceFile(temporaryPath, path))
+        {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+
+        ++_nextIndex;
+        _bytesCounter->Add((int64_t)(sizeof(header) + _payload.size()));
+        return true;
+    }
+}
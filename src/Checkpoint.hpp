@@ -0,0 +1,126 @@
+#pragma once
+
+namespace StrifeML
+{
+    struct CheckpointSettings
+    {
+        bool isEnabled = false;
+        std::string directory = ".";
+        std::string name = "trainer";
+
+        // Published networks between checkpoints
+        int batchesPerCheckpoint = 100;
+
+        // Checkpoints kept on disk. They're written to keepCount slots in turn, so each one replaces the oldest.
+        int keepCount = 3;
+    };
+
+    // A checkpoint file is laid out as:
+    //
+    //   CheckpointHeader
+    //   the parts, each a uint32_t name length, the name, a uint64_t size and the bytes
+    //
+    // The checksum covers the rest of the header and everything after it, and payloadBytes has to match the file's size, so
+    // a torn or corrupted checkpoint is never resumed from.
+    struct CheckpointHeader
+    {
+        static constexpr uint32_t Magic = 0x54504B43;
+
+        // 2 added the header to the checksum
+        static constexpr uint32_t CurrentVersion = 2;
+
+        uint32_t magic = Magic;
+        uint32_t version = CurrentVersion;
+
+        // Counts every checkpoint ever written under the name, so the newest of the slots is the one with the highest index
+        uint64_t index = 0;
+
+        uint64_t batchesTrained = 0;
+        uint64_t payloadBytes = 0;
+        uint64_t checksum = 0;
+    };
+
+    // Everything needed to pick training back up, as named opaque parts made by whoever owns each piece of state. Once handed
+    // to a CheckpointWriter it's never modified, so writing it out doesn't need to stop training.
+    struct Checkpoint
+    {
+        void SetPart(const std::string& name, std::string bytes)
+        {
+            parts[name] = std::move(bytes);
+        }
+
+        const std::string* TryGetPart(const std::string& name) const
+        {
+            auto it = parts.find(name);
+            return it != parts.end() ? &it->second : nullptr;
+        }
+
+        // A single number stored as a part of its own, so every value is named and sized instead of laid out by a struct
+        template<typename T>
+        void SetValuePart(const std::string& name, T value)
+        {
+            static_assert(std::is_arithmetic<T>::value, "Value parts hold a single number");
+            SetPart(name, std::string((const char*)&value, sizeof(value)));
+        }
+
+        // Leaves outValue alone and returns false if the part is missing or isn't the size of a T
+        template<typename T>
+        bool TryGetValuePart(const std::string& name, T& outValue) const
+        {
+            auto part = TryGetPart(name);
+            if (part == nullptr || part->size() != sizeof(T))
+            {
+                return false;
+            }
+
+            memcpy(&outValue, part->data(), sizeof(T));
+            return true;
+        }
+
+        uint64_t batchesTrained = 0;
+        std::map<std::string, std::string> parts;
+    };
+
+    // Writes checkpoints on a thread of its own. Write() never blocks: if a checkpoint is still being written when the next
+    // one arrives, the waiting one is replaced, since only the newest matters.
+    class CheckpointWriter
+    {
+    public:
+        explicit CheckpointWriter(const CheckpointSettings& settings);
+        ~CheckpointWriter();
+
+        void Write(std::shared_ptr<const Checkpoint> checkpoint);
+
+        // Waits until every checkpoint handed to Write() so far is on disk or has been replaced by a newer one
+        void Flush();
+
+        // Reads the newest checkpoint that's intact, falling back to older ones. Returns false if there are none.
+        static bool TryReadNewest(const CheckpointSettings& settings, Checkpoint& outCheckpoint);
+
+        int64_t CheckpointsWritten() const { return _checkpointsWritten.load(std::memory_order_relaxed); }
+
+    private:
+        void RunWriter();
+        bool TryWriteCheckpoint(const Checkpoint& checkpoint);
+
+        CheckpointSettings _settings;
+        uint64_t _nextIndex = 0;
+
+        std::mutex _mutex;
+        std::condition_variable _checkpointAdded;
+        std::condition_variable _checkpointWritten;
+        std::shared_ptr<const Checkpoint> _pending;
+        bool _isWriting = false;
+        bool _isStopping = false;
+        std::vector<unsigned char> _payload;
+        std::thread _thread;
+
+        std::atomic<int64_t> _checkpointsWritten { 0 };
+
+        MetricCounter* _writtenCounter;
+        MetricCounter* _replacedCounter;
+        MetricCounter* _failedCounter;
+        MetricCounter* _bytesCounter;
+        LatencyHistogram* _writeLatency;
+    };
+}
@@ -0,0 +1,65 @@
+#include "StrifeML.hpp"
+
+namespace StrifeML
+{
+    static constexpr int MaxRunLength = 128;
+
+    void ZeroRunEncode(const unsigned char* data, size_t size, std::vector<unsigned char>& outEncoded)
+    {
+        size_t i = 0;
+        while (i < size)
+        {
+            size_t runEnd = i;
+            while (runEnd < size && runEnd - i < MaxRunLength && data[runEnd] == 0)
+            {
+                ++runEnd;
+            }
+
+            // A single zero costs the same as a literal byte, and breaking a literal run for it costs more
+            if (runEnd - i >= 2)
+            {
+                outEncoded.push_back((unsigned char)(127 + (runEnd - i)));
+                i = runEnd;
+                continue;
+            }
+
+            size_t literalEnd = i;
+            while (literalEnd < size
+                && literalEnd - i < MaxRunLength
+                && !(data[literalEnd] == 0 && literalEnd + 1 < size && data[literalEnd + 1] == 0))
+            {
+                ++literalEnd;
+            }
+
+            outEncoded.push_back((unsigned char)(literalEnd - i - 1));
+            outEncoded.insert(outEncoded.end(), data + i, data + literalEnd);
+            i = literalEnd;
+        }
+    }
+
+    bool ZeroRunDecode(const unsigned char* encoded, size_t size, std::vector<unsigned char>& outDecoded)
+    {
+        size_t i = 0;
+        while (i < size)
+        {
+            unsigned char control = encoded[i++];
+            if (control >= 128)
+            {
+                outDecoded.resize(outDecoded.size() + (control - 127), 0);
+            }
+            else
+            {
+                size_t literalLength = (size_t)control + 1;
+                if (i + literalLength > size)
+                {
+                    return false;
+                }
+
+                outDecoded.insert(outDecoded.end(), encoded + i, encoded + i + literalLength);
+                i += literalLength;
+            }
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+namespace StrifeML
+{
+    // Byte-oriented run-length encoding of zeros. Samples are mostly zeroed grids and padding, so this gets most of the
+    // size reduction of a general purpose compressor at a fraction of the cost. Each token is a control byte followed by
+    // its payload:
+    //
+    //   0..127   a literal run of control + 1 bytes, which follow
+    //   128..255 a run of control - 127 zero bytes, with no payload
+    //
+    // Appends to outEncoded rather than replacing it.
+    void ZeroRunEncode(const unsigned char* data, size_t size, std::vector<unsigned char>& outEncoded);
+
+    // Appends the decoded bytes to outDecoded. Returns false if the input is truncated.
+    bool ZeroRunDecode(const unsigned char* encoded, size_t size, std::vector<unsigned char>& outDecoded);
+
+    static constexpr int MaxVarintSize = 10;
+
+    // LEB128: seven bits per byte, lowest first, with the high bit set on every byte but the last. Writes at most
+    // MaxVarintSize bytes and returns the end of what it wrote. The varint functions are inline since they're called per value.
+    inline unsigned char* VarintEncode(uint64_t value, unsigned char* out)
+    {
+        while (value >= 0x80)
+        {
+            *out++ = (unsigned char)(value | 0x80);
+            value >>= 7;
+        }
+
+        *out++ = (unsigned char)value;
+        return out;
+    }
+
+    // Reads one varint and moves data past it. Returns false if it runs past end or is longer than a uint64_t.
+    inline bool VarintDecode(const unsigned char*& data, const unsigned char* end, uint64_t& outValue)
+    {
+        // Most values fit in a byte or two, so check for those before the general loop
+        if (end - data >= 2)
+        {
+            if ((data[0] & 0x80) == 0)
+            {
+                outValue = data[0];
+                data += 1;
+                return true;
+            }
+
+            if ((data[1] & 0x80) == 0)
+            {
+                outValue = (uint64_t)(data[0] & 0x7F) | ((uint64_t)data[1] << 7);
+                data += 2;
+                return true;
+            }
+        }
+
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64 && data < end; shift += 7)
+        {
+            unsigned char byte = *data++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                outValue = value;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Maps small negative numbers to small positive ones (0, -1, 1, -2... to 0, 1, 2, 3...) so deltas varint encode well
+    inline uint64_t ZigZagEncode(int64_t value)
+    {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+
+    inline int64_t ZigZagDecode(uint64_t value)
+    {
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+}
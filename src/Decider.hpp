@@ -17,12 +17,21 @@ namespace StrifeML
         Decider()
         {
             static_assert(std::is_base_of_v<INeuralNetwork, TNeuralNetwork>, "Neural network must inherit from INeuralNetwork<>");
+
+            auto metrics = MetricsRegistry::GetInstance();
+            decisionsCounter = metrics->GetCounter("strifeml_decider_decisions_total", "Calls to Decider::MakeDecision");
+            queueWaitLatency = metrics->GetHistogram("strifeml_decider_queue_wait_seconds", "Time decisions spend queued on the thread pool");
+            computeLatency = metrics->GetHistogram("strifeml_decider_compute_seconds", "Time spent running the network for a decision");
         }
 
         auto MakeDecision(MlUtil::SharedArray<InputType> input, MlUtil::SharedArray<OutputType> output, int sequenceLength, int batchSize);
 
         std::shared_ptr<TNeuralNetwork> network = std::make_shared<TNeuralNetwork>();
         std::shared_ptr<NetworkContext<TNeuralNetwork>> networkContext;
+
+        MetricCounter* decisionsCounter;
+        LatencyHistogram* queueWaitLatency;
+        LatencyHistogram* computeLatency;
     };
 
     template<typename TNetwork>
@@ -48,6 +57,12 @@ namespace StrifeML
 
         void Execute() override
         {
+            if (Metrics::IsEnabled() && queueWaitLatency != nullptr)
+            {
+                queueWaitLatency->Record(std::chrono::steady_clock::now() - submitTime);
+            }
+
+            ScopedLatencyTimer computeTimer(computeLatency);
             network->MakeDecision(
                 Grid<const InputType>(batchSize, sequenceLength, input.data.get()),
                 gsl::span<OutputType>(output.data.get(), batchSize));
@@ -58,6 +73,10 @@ namespace StrifeML
         MlUtil::SharedArray<OutputType> output;
         int sequenceLength;
         int batchSize;
+
+        std::chrono::steady_clock::time_point submitTime;
+        LatencyHistogram* queueWaitLatency = nullptr;
+        LatencyHistogram* computeLatency = nullptr;
     };
 
     template <typename TNeuralNetwork>
@@ -70,8 +89,16 @@ namespace StrifeML
         }
 
         auto workItem = std::make_shared<MakeDecisionWorkItem<TNeuralNetwork>>(network, input, output, sequenceLength, batchSize);
-        auto threadPool = ThreadPool::GetInstance();
-        threadPool->StartItem(workItem);
+        decisionsCounter->Add();
+
+        if (Metrics::IsEnabled())
+        {
+            workItem->submitTime = std::chrono::steady_clock::now();
+            workItem->queueWaitLatency = queueWaitLatency;
+            workItem->computeLatency = computeLatency;
+        }
+
+        WorkScheduler::GetInstance()->StartItem(workItem, WorkLane::Decision);
         return workItem;
     }
 }
\ No newline at end of file
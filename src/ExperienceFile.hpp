@@ -0,0 +1,453 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Compression.hpp"
+#include "SharedMemory.hpp"
+
+// On-disk format for saved experiences, written a chunk at a time and read back by memory-mapping the file:
+//
+//   ExperienceFileHeader
+//   chunks, each a run of experiences or of the sample ids recorded for one action
+//   uint32 chunk count, then an ExperienceFileChunk per chunk, starting at header.indexOffset
+//
+// An experience is varint(rectangle count), its velocity as two raw floats, and then each rectangle word as a varint of the
+// zigzagged difference from the previous word. Rectangles in an experience are in scan order, so consecutive words mostly
+// differ in a few low bits and most take one or two bytes instead of four. Sample ids are zigzagged deltas the same way.
+struct ExperienceFileHeader
+{
+	static constexpr uint32_t Magic = 0x46584553;
+	static constexpr uint32_t CurrentVersion = 1;
+
+	uint32_t magic = Magic;
+	uint32_t version = CurrentVersion;
+	uint32_t firstExperienceId = 0;
+	uint32_t totalExperiences = 0;
+	uint64_t indexOffset = 0;
+};
+
+enum class ExperienceFileChunkType : uint32_t
+{
+	Experiences = 1,
+	SampleIds = 2,
+};
+
+struct ExperienceFileChunk
+{
+	ExperienceFileChunkType type;
+	uint32_t count;
+
+	// The id of the chunk's first experience, or the action for sample ids
+	uint32_t key;
+	uint32_t reserved;
+
+	uint64_t offset;
+	uint64_t size;
+};
+
+class ExperienceFileWriter
+{
+public:
+	static const int ExperiencesPerChunk = 4096;
+
+	// Writes to a temporary file next to path, which replaces path in Close(), so a save that fails part of the way through
+	// leaves whatever was there before
+	ExperienceFileWriter(const std::string& path, uint32_t firstExperienceId)
+		: _path(path),
+		_temporaryPath(path + ".tmp")
+	{
+		_header.firstExperienceId = firstExperienceId;
+		_nextChunkExperienceId = firstExperienceId;
+		_file = fopen(_temporaryPath.c_str(), "wb");
+		WriteBytes(&_header, sizeof(_header));
+	}
+
+	ExperienceFileWriter(const ExperienceFileWriter&) = delete;
+	ExperienceFileWriter& operator=(const ExperienceFileWriter&) = delete;
+
+	~ExperienceFileWriter()
+	{
+		if (_file != nullptr)
+		{
+			fclose(_file);
+			remove(_temporaryPath.c_str());
+		}
+	}
+
+	void WriteExperience(const unsigned int* rectangleWords, int totalRectangles, float velocityX, float velocityY)
+	{
+		unsigned char* out = Reserve(StrifeML::MaxVarintSize * (totalRectangles + 1) + 2 * sizeof(float));
+		out = StrifeML::VarintEncode(static_cast<uint64_t>(totalRectangles), out);
+
+		memcpy(out, &velocityX, sizeof(float));
+		memcpy(out + sizeof(float), &velocityY, sizeof(float));
+		out += 2 * sizeof(float);
+
+		int64_t previousWord = 0;
+		for (int i = 0; i < totalRectangles; ++i)
+		{
+			out = StrifeML::VarintEncode(StrifeML::ZigZagEncode(static_cast<int64_t>(rectangleWords[i]) - previousWord), out);
+			previousWord = rectangleWords[i];
+		}
+
+		_chunkBytes.resize(out - _chunkBytes.data());
+
+		++_header.totalExperiences;
+		if (++_chunkCount == ExperiencesPerChunk)
+		{
+			FlushExperienceChunk();
+		}
+	}
+
+	void WriteSampleIds(uint32_t action, const std::vector<int>& ids)
+	{
+		FlushExperienceChunk();
+
+		unsigned char* out = Reserve(StrifeML::MaxVarintSize * ids.size());
+
+		int64_t previousId = 0;
+		for (int id : ids)
+		{
+			out = StrifeML::VarintEncode(StrifeML::ZigZagEncode(id - previousId), out);
+			previousId = id;
+		}
+
+		_chunkBytes.resize(out - _chunkBytes.data());
+
+		WriteChunk(ExperienceFileChunkType::SampleIds, static_cast<uint32_t>(ids.size()), action);
+	}
+
+	// Returns false if anything failed to write
+	bool Close()
+	{
+		if (_file == nullptr)
+		{
+			return false;
+		}
+
+		FlushExperienceChunk();
+
+		_header.indexOffset = _bytesWritten;
+		uint32_t totalChunks = static_cast<uint32_t>(_chunks.size());
+		WriteBytes(&totalChunks, sizeof(totalChunks));
+		WriteBytes(_chunks.data(), _chunks.size() * sizeof(ExperienceFileChunk));
+
+		bool succeeded = !_hadError
+			&& fseek(_file, 0, SEEK_SET) == 0
+			&& fwrite(&_header, sizeof(_header), 1, _file) == 1;
+
+		succeeded = fclose(_file) == 0 && succeeded;
+		_file = nullptr;
+
+		if (!succeeded)
+		{
+			remove(_temporaryPath.c_str());
+			return false;
+		}
+
+		// Swapped in rather than removed and renamed, so a crash here leaves the previous save in place
+		return StrifeML::TryReplaceFile(_temporaryPath, _path);
+	}
+
+	uint32_t FirstExperienceId() const { return _header.firstExperienceId; }
+	uint64_t BytesWritten() const { return _bytesWritten; }
+	uint32_t TotalExperiences() const { return _header.totalExperiences; }
+
+private:
+	// Grows the chunk by size bytes and returns where they start. Encoders write through the pointer and then shrink the chunk
+	// back to what they used, which is a lot faster than appending a byte at a time.
+	unsigned char* Reserve(size_t size)
+	{
+		size_t used = _chunkBytes.size();
+		_chunkBytes.resize(used + size);
+		return _chunkBytes.data() + used;
+	}
+
+	void FlushExperienceChunk()
+	{
+		if (_chunkCount != 0)
+		{
+			WriteChunk(ExperienceFileChunkType::Experiences, _chunkCount, _nextChunkExperienceId);
+			_nextChunkExperienceId += _chunkCount;
+			_chunkCount = 0;
+		}
+	}
+
+	void WriteChunk(ExperienceFileChunkType type, uint32_t count, uint32_t key)
+	{
+		ExperienceFileChunk chunk;
+		chunk.type = type;
+		chunk.count = count;
+		chunk.key = key;
+		chunk.reserved = 0;
+		chunk.offset = _bytesWritten;
+		chunk.size = _chunkBytes.size();
+		_chunks.push_back(chunk);
+
+		WriteBytes(_chunkBytes.data(), _chunkBytes.size());
+		_chunkBytes.clear();
+	}
+
+	void WriteBytes(const void* data, size_t size)
+	{
+		if (_file == nullptr || (size != 0 && fwrite(data, size, 1, _file) != 1))
+		{
+			_hadError = true;
+		}
+
+		_bytesWritten += size;
+	}
+
+	std::string _path;
+	std::string _temporaryPath;
+	FILE* _file = nullptr;
+	bool _hadError = false;
+	uint64_t _bytesWritten = 0;
+
+	ExperienceFileHeader _header;
+	std::vector<ExperienceFileChunk> _chunks;
+	std::vector<unsigned char> _chunkBytes;
+	uint32_t _chunkCount = 0;
+	uint32_t _nextChunkExperienceId = 0;
+};
+
+// Maps a saved file and decodes it in place. Only the chunk index is read up front. Where each experience starts inside a
+// chunk is worked out the first time something in that chunk is read at random, and ForEachExperience() never needs it.
+// Not safe to use from several threads at once.
+class ExperienceFileReader
+{
+public:
+	// Returns null if path doesn't exist or isn't a valid file of this version. The file is only ever read.
+	static std::unique_ptr<ExperienceFileReader> TryOpen(const std::string& path)
+	{
+		auto file = StrifeML::MappedFile::TryOpenReadOnly(path);
+		if (file == nullptr || file->Size() < sizeof(ExperienceFileHeader))
+		{
+			return nullptr;
+		}
+
+		std::unique_ptr<ExperienceFileReader> reader(new ExperienceFileReader());
+		reader->_file = std::move(file);
+
+		return reader->TryReadIndex()
+			? std::move(reader)
+			: nullptr;
+	}
+
+	uint32_t FirstExperienceId() const { return _header.firstExperienceId; }
+	uint32_t TotalExperiences() const { return _header.totalExperiences; }
+	uint64_t Size() const { return _file->Size(); }
+
+	// Calls func(rectangleWords, totalRectangles, velocityX, velocityY) for every experience in order. Returns false if the
+	// file is corrupt, in which case func has been called for the experiences before the corruption.
+	template<typename TFunc>
+	bool ForEachExperience(TFunc func)
+	{
+		for (int chunkIndex : _experienceChunks)
+		{
+			auto& chunk = _chunks[chunkIndex];
+			const unsigned char* data = _file->Data() + chunk.offset;
+			const unsigned char* end = data + chunk.size;
+
+			for (uint32_t i = 0; i < chunk.count; ++i)
+			{
+				float velocityX;
+				float velocityY;
+				if (!TryDecodeExperience(data, end, velocityX, velocityY))
+				{
+					return false;
+				}
+
+				func(_words.data(), static_cast<int>(_words.size()), velocityX, velocityY);
+			}
+		}
+
+		return true;
+	}
+
+	// index counts from the first experience in the file
+	bool TryReadExperience(uint32_t index, std::vector<unsigned int>& outRectangleWords, float& outVelocityX, float& outVelocityY)
+	{
+		if (index >= _header.totalExperiences)
+		{
+			return false;
+		}
+
+		int chunkNumber = static_cast<int>(index / ExperienceFileWriter::ExperiencesPerChunk);
+		auto& chunk = _chunks[_experienceChunks[chunkNumber]];
+		auto& offsets = _experienceOffsets[chunkNumber];
+
+		if (offsets.empty() && !TryIndexChunk(chunk, offsets))
+		{
+			return false;
+		}
+
+		const unsigned char* data = _file->Data() + chunk.offset + offsets[index % ExperienceFileWriter::ExperiencesPerChunk];
+		if (!TryDecodeExperience(data, _file->Data() + chunk.offset + chunk.size, outVelocityX, outVelocityY))
+		{
+			return false;
+		}
+
+		outRectangleWords = _words;
+		return true;
+	}
+
+	// Appends the sample ids saved for action
+	bool TryReadSampleIds(uint32_t action, std::vector<int>& outIds) const
+	{
+		for (auto& chunk : _chunks)
+		{
+			if (chunk.type != ExperienceFileChunkType::SampleIds || chunk.key != action)
+			{
+				continue;
+			}
+
+			const unsigned char* data = _file->Data() + chunk.offset;
+			const unsigned char* end = data + chunk.size;
+
+			int64_t id = 0;
+			for (uint32_t i = 0; i < chunk.count; ++i)
+			{
+				uint64_t delta;
+				if (!StrifeML::VarintDecode(data, end, delta))
+				{
+					return false;
+				}
+
+				id += StrifeML::ZigZagDecode(delta);
+				outIds.push_back(static_cast<int>(id));
+			}
+		}
+
+		return true;
+	}
+
+private:
+	ExperienceFileReader() = default;
+
+	bool TryReadIndex()
+	{
+		if (_file->Size() < sizeof(ExperienceFileHeader))
+		{
+			return false;
+		}
+
+		memcpy(&_header, _file->Data(), sizeof(_header));
+		if (_header.magic != ExperienceFileHeader::Magic
+			|| _header.version != ExperienceFileHeader::CurrentVersion
+			|| _header.indexOffset > _file->Size() - sizeof(uint32_t))
+		{
+			return false;
+		}
+
+		uint32_t totalChunks;
+		memcpy(&totalChunks, _file->Data() + _header.indexOffset, sizeof(totalChunks));
+
+		uint64_t chunksOffset = _header.indexOffset + sizeof(uint32_t);
+		if (chunksOffset + static_cast<uint64_t>(totalChunks) * sizeof(ExperienceFileChunk) > _file->Size())
+		{
+			return false;
+		}
+
+		_chunks.resize(totalChunks);
+		memcpy(_chunks.data(), _file->Data() + chunksOffset, totalChunks * sizeof(ExperienceFileChunk));
+
+		uint32_t totalExperiences = 0;
+		for (int i = 0; i < (int)_chunks.size(); ++i)
+		{
+			auto& chunk = _chunks[i];
+			if (chunk.offset > _header.indexOffset || chunk.size > _header.indexOffset - chunk.offset)
+			{
+				return false;
+			}
+
+			if (chunk.type == ExperienceFileChunkType::Experiences)
+			{
+				// Random access assumes every chunk but the last is full
+				if (totalExperiences % ExperienceFileWriter::ExperiencesPerChunk != 0)
+				{
+					return false;
+				}
+
+				_experienceChunks.push_back(i);
+				totalExperiences += chunk.count;
+			}
+		}
+
+		_experienceOffsets.resize(_experienceChunks.size());
+		return totalExperiences == _header.totalExperiences;
+	}
+
+	bool TryIndexChunk(const ExperienceFileChunk& chunk, std::vector<uint32_t>& outOffsets)
+	{
+		const unsigned char* start = _file->Data() + chunk.offset;
+		const unsigned char* data = start;
+		const unsigned char* end = start + chunk.size;
+
+		outOffsets.reserve(chunk.count);
+		for (uint32_t i = 0; i < chunk.count; ++i)
+		{
+			outOffsets.push_back(static_cast<uint32_t>(data - start));
+
+			float velocityX;
+			float velocityY;
+			if (!TryDecodeExperience(data, end, velocityX, velocityY))
+			{
+				outOffsets.clear();
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Decodes into _words and moves data past the experience
+	bool TryDecodeExperience(const unsigned char*& data, const unsigned char* end, float& outVelocityX, float& outVelocityY)
+	{
+		uint64_t totalRectangles;
+		if (!StrifeML::VarintDecode(data, end, totalRectangles)
+			|| end - data < static_cast<ptrdiff_t>(2 * sizeof(float)))
+		{
+			return false;
+		}
+
+		memcpy(&outVelocityX, data, sizeof(float));
+		memcpy(&outVelocityY, data + sizeof(float), sizeof(float));
+		data += 2 * sizeof(float);
+
+		// Every word takes at least a byte, so a corrupt count can't make this allocate more than the chunk could hold
+		if (totalRectangles > static_cast<uint64_t>(end - data))
+		{
+			return false;
+		}
+
+		_words.resize(totalRectangles);
+
+		int64_t word = 0;
+		for (uint64_t i = 0; i < totalRectangles; ++i)
+		{
+			uint64_t delta;
+			if (!StrifeML::VarintDecode(data, end, delta))
+			{
+				return false;
+			}
+
+			word += StrifeML::ZigZagDecode(delta);
+			_words[i] = static_cast<unsigned int>(word);
+		}
+
+		return true;
+	}
+
+	std::unique_ptr<StrifeML::MappedFile> _file;
+	ExperienceFileHeader _header;
+	std::vector<ExperienceFileChunk> _chunks;
+	std::vector<int> _experienceChunks;
+	std::vector<std::vector<uint32_t>> _experienceOffsets;
+	std::vector<unsigned int> _words;
+};
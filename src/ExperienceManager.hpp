@@ -1,9 +1,20 @@
 #pragma once
 
 #include "Memory/Grid.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <Memory/SpinLock.hpp>
+#include <cstdarg>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <random>
+#include <string>
+#include <thread>
 #include <Renderer/Color.hpp>
 #include "Math/Vector2.hpp"
 #include "Math/Rectangle.hpp"
@@ -13,7 +24,13 @@
 #include "CharacterAction.hpp"
 #include "gsl/span"
 #include "Memory/EnumDictionary.hpp"
-#include "Memory/FixedSizeVector.hpp"
+#include "SegmentedRingBuffer.hpp"
+#include "GridCellSpatialHash.hpp"
+#include "ExperienceFile.hpp"
+#include "Thread/ThreadPool.hpp"
+#include "Memory/SpinLock.hpp"
+#include "WorkScheduler.hpp"
+#include "MlUtil.hpp"
 
 class Scene;
 class BinaryStreamReader;
@@ -36,8 +53,9 @@ constexpr int TotalColumnHeight()
 
 struct CompressedExperience
 {
-	CompressedExperience(int perceptionGridDataStartIndex_, Vector2 velocity_)
+	CompressedExperience(unsigned int perceptionGridDataStartIndex_, int totalRectangles_, Vector2 velocity_)
 		: perceptionGridDataStartIndex(perceptionGridDataStartIndex_),
+		totalRectangles(totalRectangles_),
 	    velocity(velocity_)
 	{
 
@@ -45,7 +63,12 @@ struct CompressedExperience
 
 	CompressedExperience() = default;
 
-	int perceptionGridDataStartIndex;
+	// Wraps around, like every index into the rectangle ring
+	unsigned int perceptionGridDataStartIndex;
+
+	// Stored rather than taken from the next experience's start index, since experiences created at the same time can
+	// claim their rectangle ranges in a different order than their ids
+	int totalRectangles;
 	Vector2 velocity;
 };
 
@@ -64,15 +87,40 @@ struct PerceptionGridRectangle
 	ObservedObject observedObject;
 };
 
+// Progress of ExperienceManager::SaveInBackground(). Everything but isComplete is only valid once isComplete is set.
+struct ExperienceSaveJob
+{
+	void Wait() const
+	{
+		while (!isComplete.load(std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	std::atomic<bool> isComplete { false };
+	bool succeeded = false;
+	int totalExperiences = 0;
+	uint64_t bytesWritten = 0;
+	float seconds = 0;
+};
+
 class ExperienceManager
 {
 public:
-	static const int MaxExperiences = 100000;
-	static const int PerceptionGridDataSize = MaxExperiences * 8;
+	// Experiences and rectangle words live in segments that are allocated as they're needed, so these are limits on how much
+	// can be live at once rather than memory that is reserved up front
+	static const unsigned int ExperienceSegmentSize = 4096;
+	static const unsigned int MaxExperienceSegments = 1024;
+	static const unsigned int PerceptionGridDataSegmentSize = 32768;
+	static const unsigned int MaxPerceptionGridDataSegments = 1024;
+
+	static const int MaxExperiences = ExperienceSegmentSize * MaxExperienceSegments;
+	static const int PerceptionGridDataSize = PerceptionGridDataSegmentSize * MaxPerceptionGridDataSegments;
 
 	ExperienceManager();
 
-	// Returns an experience id
+	// Returns an experience id, or -1 if there is no room left. Safe to call from any number of threads at once.
 	int CreateExperience(const std::vector<CompressedPerceptionGridRectangle>& rectangles, Vector2 velocity);
 
 	void DecompressPerceptionGrid(const CompressedExperience* experience, Grid<long long>& outGrid) const;
@@ -84,13 +132,78 @@ public:
 
     static void RenderPerceptionGrid(Grid<long long>& grid, const Vector2 topLeftPosition, Renderer* renderer, float scale = 1);
 
+	// The same as the Grid<long long> versions, but each rectangle is a few row mask operations instead of a write per cell.
+	// Expand the grid with ExpandToDense() or ExpandToOneHot() when packing it for the network. The grid is rebuilt on every
+	// call: a scrolling grid that redraws only what changed measured 2.0-2.8x slower than this rebuild for a walking agent.
+	void DecompressPerceptionGrid(const CompressedExperience* experience, PerceptionBitGrid& outGrid) const;
+	void DecompressExperience(int experienceId, PerceptionBitGrid& outGrid, Vector2& outVelocity) const;
+	static void SamplePerceptionGrid(Scene* scene, const Vector2 topLeftPosition, PerceptionBitGrid& outGrid);
+	static void FillGridWithRectangle(PerceptionBitGrid& grid, const CompressedPerceptionGridRectangle& rect);
+
+	// Perception for every agent at once. Instead of a scene query per agent, there's one over the area all of the windows
+	// cover, bucketed into a spatial hash that each agent's window then reads from, with the agents spread over the thread
+	// pool in the decision lane, since decisions are waiting on them. Windows are snapped to the cell grid, and the
+	// rectangles are in world cells. Agents that are far apart make the shared query cover the space between them, so
+	// batch agents that are near each other.
+	static void SamplePerceptionGrids(
+		Scene* scene,
+		gsl::span<const Vector2> topLeftPositions,
+		std::vector<std::vector<GridCellRectangle>>& outRectangles);
+
+	// The same, but each agent's rectangles are relative to its window like the single agent overload
+	static void SamplePerceptionGrids(
+		Scene* scene,
+		gsl::span<const Vector2> topLeftPositions,
+		std::vector<std::vector<CompressedPerceptionGridRectangle>>& outRectangles);
+
+	// Frees every segment that only holds discarded experiences so it can be reused. Producers can keep creating experiences
+	// while this runs, but it must not run at the same time as another discard, Reset(), or reads of the discarded experiences.
 	void DiscardExperiencesBefore(int experienceId);
-	int TotalExperiences() const { return _nextFreeExperience; }
 
+	// What CreateExperience() and DiscardExperiencesBefore() are built on. Producers that already have their rectangles as
+	// words can append them with getRectangleWord(i) instead of building a vector first.
+	template<typename TGetRectangleWord>
+	int AppendExperience(unsigned int totalRectangles, Vector2 velocity, TGetRectangleWord getRectangleWord);
+	void ReleaseExperiencesBefore(int experienceId);
+
+	// Discards everything and starts ids over from 0. Must not run while experiences are being created.
+	void Reset();
+
+	// Only counts published experiences, so every id below this is complete
+	int TotalExperiences() const { return static_cast<int>(_totalPublishedExperiences.load(std::memory_order_acquire)); }
+
+	int FirstLiveExperience() const { return static_cast<int>(_firstLive.load(std::memory_order_acquire) >> 32); }
+	bool IsLive(int experienceId) const { return experienceId >= FirstLiveExperience() && experienceId < TotalExperiences(); }
+
+	// Writes the live experiences to path in the format described in ExperienceFile.hpp, and only replaces what was there once
+	// the whole file has been written. Producers can keep creating experiences and discards can keep running (though they stop
+	// short of what is being saved); anything published after the save starts isn't included. writeExtra, if given, is called
+	// once the experiences have been written, to add chunks of its own.
+	bool Save(const std::string& path, const std::function<void(ExperienceFileWriter&)>& writeExtra = nullptr) const;
+
+	// The same, but the file is written on the thread pool, which is also where writeExtra is called. The manager has to
+	// outlive the job, and Reset() and Load() must not run until it's complete.
+	std::shared_ptr<ExperienceSaveJob> SaveInBackground(
+		const std::string& path,
+		std::function<void(ExperienceFileWriter&)> writeExtra = nullptr) const;
+
+	// Replaces everything with the experiences in reader, numbered from 0. Must not run while experiences are being created.
+	// If the file turns out to be corrupt or too big to hold, returns false and leaves the manager empty.
+	bool Load(ExperienceFileReader& reader);
+
+	// Superseded by Save() and Load(), which only write what's live and don't need the whole file in memory
 	void Serialize(BinaryStreamWriter& writer) const;
 	int Deserialize(BinaryStreamReader& reader);
 
 private:
+	friend struct SaveExperiencesWorkItem;
+
+	struct ExperienceSlot
+	{
+		CompressedExperience experience;
+		std::atomic<bool> isPublished;
+	};
+
 	static int TotalPerceptionGridRectangles(const CompressedExperience* experience);
 	static PerceptionGridRectangle DecompressRectangle(const CompressedPerceptionGridRectangle& compressedRect);
 	static void FillGridWithRectangle(Grid<long long>& grid, const PerceptionGridRectangle& rect);
@@ -100,40 +213,621 @@ private:
 		Vector2 topLeftPosition,
 		gsl::span<PerceptionGridRectangle> storage);
 
+	// Every collider overlapping cellArea, in world cells and in the order the single window query rasterizes them
+	static void GetPerceptionGridRectangles(Scene* scene, const GridCellRectangle& cellArea, std::vector<GridCellRectangle>& outRectangles);
+
+	static GridCellRectangle GetPerceptionWindow(const Vector2 topLeftPosition);
+	static void BuildPerceptionSpatialHash(Scene* scene, gsl::span<const Vector2> topLeftPositions, GridCellSpatialHash& outSpatialHash);
+
 	void FillColliders(Grid<long long>& outGrid, const CompressedExperience* const experience) const;
 
 	CompressedPerceptionGridRectangle GetCompressedGridRectangle(int rectangleId) const;
 	const CompressedExperience* GetExperience(int experienceId) const;
 	CompressedExperience* GetExperience(int experienceId);
 
-	unsigned int _compressedPerceptionGridData[PerceptionGridDataSize];
-	CompressedExperience _experiences[MaxExperiences];
+	static unsigned long long PackIndexes(unsigned int experienceId, unsigned int perceptionGridDataIndex)
+	{
+		return (static_cast<unsigned long long>(experienceId) << 32) | perceptionGridDataIndex;
+	}
+
+	void PublishExperience(unsigned int experienceId);
+
+	// Stops discards from going past the first live experience until the matching UnpinForSave(), and returns the range to save
+	void PinForSave(unsigned int& outFirstExperience, unsigned int& outEndExperience) const;
+	void UnpinForSave() const;
+	void WriteSave(
+		const std::string& path,
+		unsigned int firstExperience,
+		unsigned int endExperience,
+		const std::function<void(ExperienceFileWriter&)>& writeExtra,
+		ExperienceSaveJob& job) const;
+
+	SegmentedRingBuffer<ExperienceSlot, ExperienceSegmentSize, MaxExperienceSegments> _experiences;
+	SegmentedRingBuffer<unsigned int, PerceptionGridDataSegmentSize, MaxPerceptionGridDataSegments> _perceptionGridData;
+
+	// Both hold an experience id in the high 32 bits and a rectangle word index in the low 32 bits. Claiming the slot and the
+	// rectangle words in one step keeps rectangle ranges in id order, which is what lets a discard free the rectangle words
+	// below the first live experience. Producers fill in what they claimed without a lock and then publish the slot.
+	std::atomic<unsigned long long> _nextFree { 0 };
+	std::atomic<unsigned long long> _firstLive { 0 };
 
-	int _nextFreePerceptionGridDataIndex = 0;
-	int _nextFreeExperience = 0;
-	SpinLock _createLock;
+	// Only moves past a slot once it and every slot before it are published
+	std::atomic<unsigned int> _totalPublishedExperiences { 0 };
+
+	// Held for the whole of a discard, so a save either pins the range before a discard starts or sees where it left off
+	mutable SpinLock _discardLock;
+	mutable int _totalSavePins = 0;
+	mutable unsigned int _savePinnedExperience = 0;
 
     static Color _objectColors[static_cast<int>(ObservedObject::TotalObjects)];
 };
 
+template<typename TGetRectangleWord>
+int ExperienceManager::AppendExperience(unsigned int totalRectangles, Vector2 velocity, TGetRectangleWord getRectangleWord)
+{
+	unsigned long long nextFree = _nextFree.load(std::memory_order_relaxed);
+	unsigned int experienceId;
+	unsigned int perceptionGridDataStartIndex;
+
+	do
+	{
+		experienceId = static_cast<unsigned int>(nextFree >> 32);
+		perceptionGridDataStartIndex = static_cast<unsigned int>(nextFree);
+
+		unsigned long long firstLive = _firstLive.load(std::memory_order_acquire);
+		if (!_experiences.CanHold(static_cast<unsigned int>(firstLive >> 32), experienceId + 1)
+			|| !_perceptionGridData.CanHold(static_cast<unsigned int>(firstLive), perceptionGridDataStartIndex + totalRectangles))
+		{
+			return -1;
+		}
+	} while (!_nextFree.compare_exchange_weak(
+		nextFree,
+		PackIndexes(experienceId + 1, perceptionGridDataStartIndex + totalRectangles),
+		std::memory_order_acq_rel,
+		std::memory_order_relaxed));
+
+	_experiences.EnsureAllocated(experienceId);
+	if (totalRectangles > 0)
+	{
+		_perceptionGridData.EnsureAllocated(perceptionGridDataStartIndex);
+		_perceptionGridData.EnsureAllocated(perceptionGridDataStartIndex + totalRectangles - 1);
+	}
+
+	for (unsigned int i = 0; i < totalRectangles; ++i)
+	{
+		_perceptionGridData[perceptionGridDataStartIndex + i] = getRectangleWord(i);
+	}
+
+	_experiences[experienceId].experience = CompressedExperience(perceptionGridDataStartIndex, totalRectangles, velocity);
+	PublishExperience(experienceId);
+
+	return static_cast<int>(experienceId);
+}
+
+inline void ExperienceManager::PublishExperience(unsigned int experienceId)
+{
+	_experiences[experienceId].isPublished.store(true, std::memory_order_seq_cst);
+
+	// Whoever publishes the slot at the front moves the count past it and past any later slots that finished first. The
+	// flag store above and the flag loads below are sequentially consistent so that when two producers finish at the same
+	// time, at least one of them sees the other's slot as published. A slot is only looked at once it has been claimed, since
+	// before that its segment may not exist yet.
+	unsigned int totalPublished = _totalPublishedExperiences.load(std::memory_order_seq_cst);
+	while (true)
+	{
+		unsigned int totalClaimed = static_cast<unsigned int>(_nextFree.load(std::memory_order_acquire) >> 32);
+		if (totalPublished == totalClaimed)
+		{
+			break;
+		}
+
+		ExperienceSlot* slot = _experiences.TryGet(totalPublished);
+		if (slot == nullptr || !slot->isPublished.load(std::memory_order_seq_cst))
+		{
+			break;
+		}
+
+		if (_totalPublishedExperiences.compare_exchange_weak(totalPublished, totalPublished + 1, std::memory_order_seq_cst))
+		{
+			++totalPublished;
+		}
+	}
+}
+
+inline void ExperienceManager::DecompressPerceptionGrid(const CompressedExperience* experience, PerceptionBitGrid& outGrid) const
+{
+	outGrid.Clear();
+
+	for (int i = 0; i < experience->totalRectangles; ++i)
+	{
+		FillGridWithRectangle(outGrid, _perceptionGridData[experience->perceptionGridDataStartIndex + i]);
+	}
+}
+
+inline void ExperienceManager::DecompressExperience(int experienceId, PerceptionBitGrid& outGrid, Vector2& outVelocity) const
+{
+	auto experience = &_experiences[experienceId].experience;
+	DecompressPerceptionGrid(experience, outGrid);
+	outVelocity = experience->velocity;
+}
+
+inline void ExperienceManager::SamplePerceptionGrid(Scene* scene, const Vector2 topLeftPosition, PerceptionBitGrid& outGrid)
+{
+	thread_local std::vector<CompressedPerceptionGridRectangle> rectangles;
+
+	rectangles.clear();
+	SamplePerceptionGrid(scene, topLeftPosition, rectangles);
+
+	outGrid.Clear();
+	for (auto& rectangle : rectangles)
+	{
+		FillGridWithRectangle(outGrid, rectangle);
+	}
+}
+
+inline GridCellRectangle ExperienceManager::GetPerceptionWindow(const Vector2 topLeftPosition)
+{
+	return GridCellRectangle(
+		static_cast<int>(std::floor(topLeftPosition.x / PerceptionGridCellSize)),
+		static_cast<int>(std::floor(topLeftPosition.y / PerceptionGridCellSize)),
+		PerceptionGridCols,
+		PerceptionGridRows,
+		0);
+}
+
+inline void ExperienceManager::BuildPerceptionSpatialHash(Scene* scene, gsl::span<const Vector2> topLeftPositions, GridCellSpatialHash& outSpatialHash)
+{
+	thread_local std::vector<GridCellRectangle> colliders;
+
+	auto area = GetPerceptionWindow(topLeftPositions[0]);
+	for (auto& topLeftPosition : topLeftPositions)
+	{
+		auto window = GetPerceptionWindow(topLeftPosition);
+		int right = std::max(area.Right(), window.Right());
+		int bottom = std::max(area.Bottom(), window.Bottom());
+		area.x = std::min(area.x, window.x);
+		area.y = std::min(area.y, window.y);
+		area.width = right - area.x;
+		area.height = bottom - area.y;
+	}
+
+	colliders.clear();
+	GetPerceptionGridRectangles(scene, area, colliders);
+	outSpatialHash.Build(colliders);
+}
+
+inline void ExperienceManager::SamplePerceptionGrids(
+	Scene* scene,
+	gsl::span<const Vector2> topLeftPositions,
+	std::vector<std::vector<GridCellRectangle>>& outRectangles)
+{
+	int totalAgents = static_cast<int>(topLeftPositions.size());
+	outRectangles.resize(totalAgents);
+	if (totalAgents == 0)
+	{
+		return;
+	}
+
+	// Kept per calling thread so its buckets are reused from call to call. The agents read it through the reference, since
+	// naming the thread_local inside the loop would give each pool thread its own, empty, hash.
+	thread_local GridCellSpatialHash callerSpatialHash(PerceptionGridCols / 2);
+	GridCellSpatialHash& spatialHash = callerSpatialHash;
+	BuildPerceptionSpatialHash(scene, topLeftPositions, spatialHash);
+
+	StrifeML::MlUtil::ParallelForShards(totalAgents, [&spatialHash, &outRectangles, topLeftPositions](int agent)
+	{
+		thread_local std::vector<int> scratch;
+
+		outRectangles[agent].clear();
+		spatialHash.Query(GetPerceptionWindow(topLeftPositions[agent]), outRectangles[agent], scratch);
+	}, StrifeML::WorkLane::Decision);
+}
+
+inline void ExperienceManager::SamplePerceptionGrids(
+	Scene* scene,
+	gsl::span<const Vector2> topLeftPositions,
+	std::vector<std::vector<CompressedPerceptionGridRectangle>>& outRectangles)
+{
+	int totalAgents = static_cast<int>(topLeftPositions.size());
+	outRectangles.resize(totalAgents);
+	if (totalAgents == 0)
+	{
+		return;
+	}
+
+	thread_local GridCellSpatialHash callerSpatialHash(PerceptionGridCols / 2);
+	GridCellSpatialHash& spatialHash = callerSpatialHash;
+	BuildPerceptionSpatialHash(scene, topLeftPositions, spatialHash);
+
+	StrifeML::MlUtil::ParallelForShards(totalAgents, [&spatialHash, &outRectangles, topLeftPositions](int agent)
+	{
+		thread_local std::vector<int> scratch;
+		thread_local std::vector<GridCellRectangle> rectangles;
+
+		auto window = GetPerceptionWindow(topLeftPositions[agent]);
+		rectangles.clear();
+		spatialHash.Query(window, rectangles, scratch);
+
+		outRectangles[agent].clear();
+		for (auto& rectangle : rectangles)
+		{
+			outRectangles[agent].emplace_back(
+				rectangle.value,
+				rectangle.x - window.x,
+				rectangle.y - window.y,
+				rectangle.width,
+				rectangle.height);
+		}
+	}, StrifeML::WorkLane::Decision);
+}
+
+inline void ExperienceManager::FillGridWithRectangle(PerceptionBitGrid& grid, const CompressedPerceptionGridRectangle& rect)
+{
+	grid.FillRectangle(rect.X(), rect.Y(), rect.Width(), rect.Height(), rect.ObservedObject());
+}
+
+inline void ExperienceManager::ReleaseExperiencesBefore(int experienceId)
+{
+	_discardLock.Lock();
+
+	unsigned long long firstLive = _firstLive.load(std::memory_order_relaxed);
+	unsigned int firstLiveExperience = static_cast<unsigned int>(firstLive >> 32);
+	unsigned int totalPublished = _totalPublishedExperiences.load(std::memory_order_acquire);
+
+	// Only published experiences can be discarded, since producers may still be writing the rest
+	unsigned int newFirstLiveExperience = static_cast<unsigned int>(experienceId);
+	if (static_cast<int>(newFirstLiveExperience - totalPublished) > 0)
+	{
+		newFirstLiveExperience = totalPublished;
+	}
+
+	if (_totalSavePins > 0 && static_cast<int>(newFirstLiveExperience - _savePinnedExperience) > 0)
+	{
+		newFirstLiveExperience = _savePinnedExperience;
+	}
+
+	if (static_cast<int>(newFirstLiveExperience - firstLiveExperience) <= 0)
+	{
+		_discardLock.Unlock();
+		return;
+	}
+
+	// Rectangle ranges are in id order, so everything before the new first experience's range is no longer needed
+	unsigned int newFirstLivePerceptionGridData;
+	if (newFirstLiveExperience != totalPublished)
+	{
+		newFirstLivePerceptionGridData = _experiences[newFirstLiveExperience].experience.perceptionGridDataStartIndex;
+	}
+	else
+	{
+		const CompressedExperience* lastExperience = &_experiences[newFirstLiveExperience - 1].experience;
+		newFirstLivePerceptionGridData = lastExperience->perceptionGridDataStartIndex + lastExperience->totalRectangles;
+	}
+
+	_experiences.ReleaseSegments(firstLiveExperience, newFirstLiveExperience, [](ExperienceSlot& slot)
+	{
+		slot.isPublished.store(false, std::memory_order_relaxed);
+	});
+
+	_perceptionGridData.ReleaseSegments(static_cast<unsigned int>(firstLive), newFirstLivePerceptionGridData, [](unsigned int&) { });
+
+	// Released before this is stored, so a producer that sees the new first live experience never finds an old segment
+	_firstLive.store(PackIndexes(newFirstLiveExperience, newFirstLivePerceptionGridData), std::memory_order_release);
+
+	_discardLock.Unlock();
+}
+
+inline void ExperienceManager::Reset()
+{
+	_experiences.ReleaseAll([](ExperienceSlot& slot)
+	{
+		slot.isPublished.store(false, std::memory_order_relaxed);
+	});
+
+	_perceptionGridData.ReleaseAll([](unsigned int&) { });
+
+	_nextFree.store(0, std::memory_order_relaxed);
+	_totalPublishedExperiences.store(0, std::memory_order_relaxed);
+	_firstLive.store(0, std::memory_order_release);
+}
+
+inline void ExperienceManager::PinForSave(unsigned int& outFirstExperience, unsigned int& outEndExperience) const
+{
+	_discardLock.Lock();
+
+	outFirstExperience = static_cast<unsigned int>(_firstLive.load(std::memory_order_acquire) >> 32);
+	outEndExperience = _totalPublishedExperiences.load(std::memory_order_acquire);
+
+	// Discards can't pass an earlier pin, so while any save is running the first live experience is the pinned one
+	_savePinnedExperience = outFirstExperience;
+	++_totalSavePins;
+
+	_discardLock.Unlock();
+}
+
+inline void ExperienceManager::UnpinForSave() const
+{
+	_discardLock.Lock();
+	--_totalSavePins;
+	_discardLock.Unlock();
+}
+
+inline void ExperienceManager::WriteSave(
+	const std::string& path,
+	unsigned int firstExperience,
+	unsigned int endExperience,
+	const std::function<void(ExperienceFileWriter&)>& writeExtra,
+	ExperienceSaveJob& job) const
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	ExperienceFileWriter writer(path, firstExperience);
+	for (unsigned int experienceId = firstExperience; experienceId != endExperience; ++experienceId)
+	{
+		auto experience = &_experiences[experienceId].experience;
+
+		// Rectangle words are contiguous in storage unless the range crosses into the next segment
+		unsigned int startIndex = experience->perceptionGridDataStartIndex;
+		int totalRectangles = experience->totalRectangles;
+		if (totalRectangles > 0 && startIndex / PerceptionGridDataSegmentSize == (startIndex + totalRectangles - 1) / PerceptionGridDataSegmentSize)
+		{
+			writer.WriteExperience(&_perceptionGridData[startIndex], totalRectangles, experience->velocity.x, experience->velocity.y);
+		}
+		else
+		{
+			thread_local std::vector<unsigned int> rectangleWords;
+			rectangleWords.resize(totalRectangles);
+			for (int i = 0; i < totalRectangles; ++i)
+			{
+				rectangleWords[i] = _perceptionGridData[startIndex + i];
+			}
+
+			writer.WriteExperience(rectangleWords.data(), totalRectangles, experience->velocity.x, experience->velocity.y);
+		}
+	}
+
+	if (writeExtra)
+	{
+		writeExtra(writer);
+	}
+
+	job.totalExperiences = static_cast<int>(writer.TotalExperiences());
+	job.bytesWritten = writer.BytesWritten();
+	job.succeeded = writer.Close();
+	job.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+inline bool ExperienceManager::Save(const std::string& path, const std::function<void(ExperienceFileWriter&)>& writeExtra) const
+{
+	unsigned int firstExperience;
+	unsigned int endExperience;
+	PinForSave(firstExperience, endExperience);
+
+	ExperienceSaveJob job;
+	WriteSave(path, firstExperience, endExperience, writeExtra, job);
+
+	UnpinForSave();
+	return job.succeeded;
+}
+
+struct SaveExperiencesWorkItem : IThreadPoolWorkItem
+{
+	void Execute() override
+	{
+		experienceManager->WriteSave(path, firstExperience, endExperience, writeExtra, *job);
+		experienceManager->UnpinForSave();
+		job->isComplete.store(true, std::memory_order_release);
+	}
+
+	const ExperienceManager* experienceManager;
+	std::string path;
+	unsigned int firstExperience;
+	unsigned int endExperience;
+	std::function<void(ExperienceFileWriter&)> writeExtra;
+	std::shared_ptr<ExperienceSaveJob> job;
+};
+
+inline std::shared_ptr<ExperienceSaveJob> ExperienceManager::SaveInBackground(
+	const std::string& path,
+	std::function<void(ExperienceFileWriter&)> writeExtra) const
+{
+	auto workItem = std::make_shared<SaveExperiencesWorkItem>();
+	workItem->experienceManager = this;
+	workItem->path = path;
+	workItem->writeExtra = std::move(writeExtra);
+	workItem->job = std::make_shared<ExperienceSaveJob>();
+	PinForSave(workItem->firstExperience, workItem->endExperience);
+
+	auto job = workItem->job;
+	ThreadPool::GetInstance()->StartItem(workItem);
+
+	return job;
+}
+
+inline bool ExperienceManager::Load(ExperienceFileReader& reader)
+{
+	Reset();
+
+	// Nothing else is creating experiences, so they're written straight into place and published all at once at the end
+	// instead of going through CreateExperience() one at a time
+	unsigned int totalExperiences = 0;
+	unsigned int totalPerceptionGridData = 0;
+	bool fits = true;
+
+	bool isValid = reader.ForEachExperience([&](const unsigned int* rectangleWords, int totalRectangles, float velocityX, float velocityY)
+	{
+		fits = fits
+			&& _experiences.CanHold(0, totalExperiences + 1)
+			&& _perceptionGridData.CanHold(0, totalPerceptionGridData + totalRectangles);
+
+		if (!fits)
+		{
+			return;
+		}
+
+		_experiences.EnsureAllocated(totalExperiences);
+		for (int i = 0; i < totalRectangles; ++i)
+		{
+			unsigned int index = totalPerceptionGridData + i;
+			if (index % PerceptionGridDataSegmentSize == 0 || i == 0)
+			{
+				_perceptionGridData.EnsureAllocated(index);
+			}
+
+			_perceptionGridData[index] = rectangleWords[i];
+		}
+
+		auto& slot = _experiences[totalExperiences];
+		slot.experience = CompressedExperience(totalPerceptionGridData, totalRectangles, Vector2(velocityX, velocityY));
+		slot.isPublished.store(true, std::memory_order_relaxed);
+
+		++totalExperiences;
+		totalPerceptionGridData += totalRectangles;
+	});
+
+	if (!isValid || !fits)
+	{
+		Reset();
+		return false;
+	}
+
+	_nextFree.store(PackIndexes(totalExperiences, totalPerceptionGridData), std::memory_order_relaxed);
+	_totalPublishedExperiences.store(totalExperiences, std::memory_order_release);
+
+	return true;
+}
+
 struct SampleManager
 {
     void Reset();
 	void Serialize(BinaryStreamWriter& writer);
 	void Deserialize(BinaryStreamReader& reader);
 
+	// Saves the live experiences along with the samples that refer to them. See ExperienceManager::Save().
+	bool Save(const std::string& path);
+	std::shared_ptr<ExperienceSaveJob> SaveInBackground(const std::string& path);
+
+	// Experiences are numbered from 0 after loading, and the samples are renumbered to match. Nothing changes if path can't
+	// be opened or its samples don't check out; if its experiences turn out to be corrupt, everything is cleared.
+	bool Load(const std::string& path);
+
+	// Copies the samples now, so they match the experiences a save started now will pin
+	std::function<void(ExperienceFileWriter&)> GetSampleWriter();
+
     bool TryGetRandomSample(CharacterAction type, gsl::span<DecompressedExperience> outExperiences);
 	void AddSample(int experienceId, CharacterAction action);
 	bool HasSamples(CharacterAction action);
 	bool HasSamples();
 
+	// Discards the experiences and drops them from experiencesByActionType
+	void DiscardSamplesBefore(int experienceId);
+
 	ExperienceManager experienceManager;
 	EnumDictionary<
 		CharacterAction,
-		FixedSizeVector<int, ExperienceManager::MaxExperiences>,
+		std::vector<int>,
 		(int)CharacterAction::TotalActions> experiencesByActionType;
 
 	std::default_random_engine generator;
 };
 
-constexpr int TotalColumnHeight();
\ No newline at end of file
+inline void SampleManager::DiscardSamplesBefore(int experienceId)
+{
+	experienceManager.DiscardExperiencesBefore(experienceId);
+
+	int firstLiveExperience = experienceManager.FirstLiveExperience();
+	for (int i = 0; i < (int)CharacterAction::TotalActions; ++i)
+	{
+		auto& experiences = experiencesByActionType[(CharacterAction)i];
+		experiences.erase(
+			std::remove_if(experiences.begin(), experiences.end(), [=](int id) { return id < firstLiveExperience; }),
+			experiences.end());
+	}
+}
+
+constexpr int TotalColumnHeight();
+
+inline std::function<void(ExperienceFileWriter&)> SampleManager::GetSampleWriter()
+{
+	auto samples = std::make_shared<std::vector<std::vector<int>>>((int)CharacterAction::TotalActions);
+	for (int i = 0; i < (int)CharacterAction::TotalActions; ++i)
+	{
+		(*samples)[i] = experiencesByActionType[(CharacterAction)i];
+	}
+
+	return [=](ExperienceFileWriter& writer)
+	{
+		// Samples added after the copy was made refer to experiences that aren't in the file, and ones from before the pinned
+		// range to experiences that were discarded
+		int firstExperienceId = static_cast<int>(writer.FirstExperienceId());
+		int endExperienceId = firstExperienceId + static_cast<int>(writer.TotalExperiences());
+
+		for (int i = 0; i < (int)samples->size(); ++i)
+		{
+			auto& experiences = (*samples)[i];
+			experiences.erase(
+				std::remove_if(experiences.begin(), experiences.end(), [=](int id) { return id < firstExperienceId || id >= endExperienceId; }),
+				experiences.end());
+
+			writer.WriteSampleIds(static_cast<uint32_t>(i), experiences);
+		}
+	};
+}
+
+inline bool SampleManager::Save(const std::string& path)
+{
+	return experienceManager.Save(path, GetSampleWriter());
+}
+
+inline std::shared_ptr<ExperienceSaveJob> SampleManager::SaveInBackground(const std::string& path)
+{
+	return experienceManager.SaveInBackground(path, GetSampleWriter());
+}
+
+inline bool SampleManager::Load(const std::string& path)
+{
+	auto reader = ExperienceFileReader::TryOpen(path);
+	if (reader == nullptr)
+	{
+		return false;
+	}
+
+	// The samples are read and checked before anything is replaced, and only swapped in once the experiences have loaded
+	int firstExperienceId = static_cast<int>(reader->FirstExperienceId());
+	int totalExperiences = static_cast<int>(reader->TotalExperiences());
+	std::vector<std::vector<int>> loadedSamples((int)CharacterAction::TotalActions);
+	for (int i = 0; i < (int)CharacterAction::TotalActions; ++i)
+	{
+		auto& experiences = loadedSamples[i];
+		if (!reader->TryReadSampleIds(static_cast<uint32_t>(i), experiences))
+		{
+			return false;
+		}
+
+		for (int& id : experiences)
+		{
+			id -= firstExperienceId;
+			if (id < 0 || id >= totalExperiences)
+			{
+				return false;
+			}
+		}
+	}
+
+	if (!experienceManager.Load(*reader))
+	{
+		for (int i = 0; i < (int)CharacterAction::TotalActions; ++i)
+		{
+			experiencesByActionType[(CharacterAction)i].clear();
+		}
+
+		return false;
+	}
+
+	for (int i = 0; i < (int)CharacterAction::TotalActions; ++i)
+	{
+		experiencesByActionType[(CharacterAction)i].swap(loadedSamples[i]);
+	}
+
+	return true;
+}
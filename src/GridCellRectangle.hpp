@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <tuple>
+
+// A rectangle of grid cells in world space, so one list of them can be shared by windows anywhere in the level
+struct GridCellRectangle
+{
+	GridCellRectangle() = default;
+
+	GridCellRectangle(int x_, int y_, int width_, int height_, int value_)
+		: x(x_),
+		y(y_),
+		width(width_),
+		height(height_),
+		value(value_)
+	{
+
+	}
+
+	int Right() const { return x + width; }
+	int Bottom() const { return y + height; }
+	bool IsEmpty() const { return width <= 0 || height <= 0; }
+
+	// Keeps this rectangle's value
+	GridCellRectangle Intersection(const GridCellRectangle& rhs) const
+	{
+		int left = std::max(x, rhs.x);
+		int top = std::max(y, rhs.y);
+		return GridCellRectangle(left, top, std::min(Right(), rhs.Right()) - left, std::min(Bottom(), rhs.Bottom()) - top, value);
+	}
+
+	bool operator==(const GridCellRectangle& rhs) const
+	{
+		return std::tie(x, y, width, height, value) == std::tie(rhs.x, rhs.y, rhs.width, rhs.height, rhs.value);
+	}
+
+	int x = 0;
+	int y = 0;
+	int width = 0;
+	int height = 0;
+	int value = 0;
+};
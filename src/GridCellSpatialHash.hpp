@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "GridCellRectangle.hpp"
+
+// Buckets rectangles into a uniform grid of square buckets over the area they cover, so that many windows over the same part
+// of the world can each find what overlaps them without going through every rectangle. Built once, then safe to query from any
+// number of threads at once.
+class GridCellSpatialHash
+{
+public:
+	explicit GridCellSpatialHash(int bucketSize = 16)
+		: _bucketSize(bucketSize)
+	{
+
+	}
+
+	void Build(const std::vector<GridCellRectangle>& rectangles)
+	{
+		_rectangles = rectangles;
+		_bucketStarts.clear();
+		_bucketRectangles.clear();
+
+		if (_rectangles.empty())
+		{
+			_bucketsX = 0;
+			_bucketsY = 0;
+			return;
+		}
+
+		int left = _rectangles[0].x;
+		int top = _rectangles[0].y;
+		int right = _rectangles[0].Right();
+		int bottom = _rectangles[0].Bottom();
+		for (auto& rectangle : _rectangles)
+		{
+			left = std::min(left, rectangle.x);
+			top = std::min(top, rectangle.y);
+			right = std::max(right, rectangle.Right());
+			bottom = std::max(bottom, rectangle.Bottom());
+		}
+
+		_originX = left;
+		_originY = top;
+		_bucketsX = (right - left + _bucketSize - 1) / _bucketSize;
+		_bucketsY = (bottom - top + _bucketSize - 1) / _bucketSize;
+
+		// Two passes, counting and then filling, so every bucket's rectangles sit next to each other in one array
+		_bucketStarts.assign(_bucketsX * _bucketsY + 1, 0);
+		ForEachBucket([&](int bucket, int) { ++_bucketStarts[bucket + 1]; });
+
+		for (int i = 1; i < (int)_bucketStarts.size(); ++i)
+		{
+			_bucketStarts[i] += _bucketStarts[i - 1];
+		}
+
+		_bucketRectangles.resize(_bucketStarts.back());
+		std::vector<int> nextInBucket(_bucketStarts.begin(), _bucketStarts.end() - 1);
+		ForEachBucket([&](int bucket, int rectangleId) { _bucketRectangles[nextInBucket[bucket]++] = rectangleId; });
+	}
+
+	// Appends every rectangle that overlaps area, clipped to it, in the order they were given to Build()
+	void Query(const GridCellRectangle& area, std::vector<GridCellRectangle>& outRectangles, std::vector<int>& scratch) const
+	{
+		scratch.clear();
+		if (_bucketsX == 0)
+		{
+			return;
+		}
+
+		int firstBucketX = std::max(BucketX(area.x), 0);
+		int firstBucketY = std::max(BucketY(area.y), 0);
+		int lastBucketX = std::min(BucketX(area.Right() - 1), _bucketsX - 1);
+		int lastBucketY = std::min(BucketY(area.Bottom() - 1), _bucketsY - 1);
+
+		for (int bucketY = firstBucketY; bucketY <= lastBucketY; ++bucketY)
+		{
+			for (int bucketX = firstBucketX; bucketX <= lastBucketX; ++bucketX)
+			{
+				int bucket = bucketY * _bucketsX + bucketX;
+				for (int i = _bucketStarts[bucket]; i < _bucketStarts[bucket + 1]; ++i)
+				{
+					int rectangleId = _bucketRectangles[i];
+					auto clipped = _rectangles[rectangleId].Intersection(area);
+
+					// A rectangle is in every bucket it touches, so only the bucket holding the top left of the overlap reports it
+					if (!clipped.IsEmpty() && BucketX(clipped.x) == bucketX && BucketY(clipped.y) == bucketY)
+					{
+						scratch.push_back(rectangleId);
+					}
+				}
+			}
+		}
+
+		std::sort(scratch.begin(), scratch.end());
+		for (int rectangleId : scratch)
+		{
+			outRectangles.push_back(_rectangles[rectangleId].Intersection(area));
+		}
+	}
+
+	int TotalRectangles() const { return (int)_rectangles.size(); }
+
+private:
+	int BucketX(int x) const { return FloorDivide(x - _originX, _bucketSize); }
+	int BucketY(int y) const { return FloorDivide(y - _originY, _bucketSize); }
+
+	static int FloorDivide(int value, int divisor)
+	{
+		return value >= 0
+			? value / divisor
+			: -((-value + divisor - 1) / divisor);
+	}
+
+	template<typename TFunc>
+	void ForEachBucket(TFunc func) const
+	{
+		for (int rectangleId = 0; rectangleId < (int)_rectangles.size(); ++rectangleId)
+		{
+			auto& rectangle = _rectangles[rectangleId];
+			int lastBucketX = BucketX(rectangle.Right() - 1);
+			int lastBucketY = BucketY(rectangle.Bottom() - 1);
+			for (int bucketY = BucketY(rectangle.y); bucketY <= lastBucketY; ++bucketY)
+			{
+				for (int bucketX = BucketX(rectangle.x); bucketX <= lastBucketX; ++bucketX)
+				{
+					func(bucketY * _bucketsX + bucketX, rectangleId);
+				}
+			}
+		}
+	}
+
+	int _bucketSize;
+	int _originX = 0;
+	int _originY = 0;
+	int _bucketsX = 0;
+	int _bucketsY = 0;
+
+	std::vector<GridCellRectangle> _rectangles;
+	std::vector<int> _bucketStarts;
+	std::vector<int> _bucketRectangles;
+};
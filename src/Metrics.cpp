@@ -0,0 +1,302 @@
+#include "StrifeML.hpp"
+
+#include <cstdio>
+
+namespace StrifeML
+{
+    double LatencyHistogramSnapshot::Percentile(double percentile) const
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        uint64_t target = (uint64_t)(percentile * count);
+        uint64_t seen = 0;
+        for (int i = 0; i < (int)bucketCounts.size(); ++i)
+        {
+            seen += bucketCounts[i];
+            if (seen > target)
+            {
+                return LatencyHistogram::BucketUpperBoundSeconds(i);
+            }
+        }
+
+        return LatencyHistogram::BucketUpperBoundSeconds((int)bucketCounts.size() - 1);
+    }
+
+    LatencyHistogramSnapshot LatencyHistogram::Snapshot() const
+    {
+        LatencyHistogramSnapshot snapshot;
+        snapshot.bucketCounts.resize(TotalBuckets);
+
+        int64_t sumNanoseconds = 0;
+        for (auto& shard : _shards)
+        {
+            for (int i = 0; i < TotalBuckets; ++i)
+            {
+                snapshot.bucketCounts[i] += shard.buckets[i].load(std::memory_order_relaxed);
+            }
+
+            snapshot.count += shard.count.load(std::memory_order_relaxed);
+            sumNanoseconds += shard.sumNanoseconds.load(std::memory_order_relaxed);
+        }
+
+        snapshot.sumSeconds = sumNanoseconds * 1e-9;
+        return snapshot;
+    }
+
+    std::string MetricLabel(const std::string& name, const std::string& value)
+    {
+        std::string label = name + "=\"";
+        for (char c : value)
+        {
+            switch (c)
+            {
+            case '\\': label += "\\\\"; break;
+            case '"': label += "\\\""; break;
+            case '\n': label += "\\n"; break;
+            default: label += c; break;
+            }
+        }
+
+        return label + "\"";
+    }
+
+    MetricsRegistry* MetricsRegistry::GetInstance()
+    {
+        static MetricsRegistry instance;
+        return &instance;
+    }
+
+    MetricsRegistry::Metric& MetricsRegistry::GetOrAddMetric(
+        const std::string& name,
+        const std::string& help,
+        const std::string& labels,
+        MetricType type)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // Sorting by name first keeps the series of one metric next to each other when formatting
+        auto key = name + "{" + labels + "}";
+        auto it = _metricsByKey.find(key);
+        if (it != _metricsByKey.end())
+        {
+            if (it->second.type != type)
+            {
+                throw StrifeException("Metric %s was already registered with a different type", key.c_str());
+            }
+
+            return it->second;
+        }
+
+        auto& metric = _metricsByKey[key];
+        metric.name = name;
+        metric.labels = labels;
+        metric.help = help;
+        metric.type = type;
+
+        switch (type)
+        {
+        case MetricType::Counter: metric.counter = std::make_unique<MetricCounter>(); break;
+        case MetricType::Gauge: metric.gauge = std::make_unique<MetricGauge>(); break;
+        case MetricType::Histogram: metric.histogram = std::make_unique<LatencyHistogram>(); break;
+        }
+
+        return metric;
+    }
+
+    MetricCounter* MetricsRegistry::GetCounter(const std::string& name, const std::string& help, const std::string& labels)
+    {
+        return GetOrAddMetric(name, help, labels, MetricType::Counter).counter.get();
+    }
+
+    MetricGauge* MetricsRegistry::GetGauge(const std::string& name, const std::string& help, const std::string& labels)
+    {
+        return GetOrAddMetric(name, help, labels, MetricType::Gauge).gauge.get();
+    }
+
+    LatencyHistogram* MetricsRegistry::GetHistogram(const std::string& name, const std::string& help, const std::string& labels)
+    {
+        return GetOrAddMetric(name, help, labels, MetricType::Histogram).histogram.get();
+    }
+
+    std::vector<MetricSnapshot> MetricsRegistry::Snapshot()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        std::vector<MetricSnapshot> snapshots;
+        snapshots.reserve(_metricsByKey.size());
+
+        for (auto& pair : _metricsByKey)
+        {
+            auto& metric = pair.second;
+
+            MetricSnapshot snapshot;
+            snapshot.name = metric.name;
+            snapshot.labels = metric.labels;
+            snapshot.help = metric.help;
+            snapshot.type = metric.type;
+
+            switch (metric.type)
+            {
+            case MetricType::Counter: snapshot.value = (double)metric.counter->Value(); break;
+            case MetricType::Gauge: snapshot.value = (double)metric.gauge->Value(); break;
+            case MetricType::Histogram: snapshot.histogram = metric.histogram->Snapshot(); break;
+            }
+
+            snapshots.push_back(std::move(snapshot));
+        }
+
+        return snapshots;
+    }
+
+    static std::string JoinLabels(const std::string& labels, const std::string& extraLabel)
+    {
+        if (labels.empty()) return extraLabel;
+        if (extraLabel.empty()) return labels;
+        return labels + "," + extraLabel;
+    }
+
+    static void AppendSeries(std::string& output, const std::string& name, const std::string& labels, double value)
+    {
+        char valueText[64];
+        snprintf(valueText, sizeof(valueText), " %.9g\n", value);
+
+        output += name;
+        if (!labels.empty())
+        {
+            output += "{" + labels + "}";
+        }
+
+        output += valueText;
+    }
+
+    std::string MetricsRegistry::FormatText()
+    {
+        std::string output;
+        std::string previousName;
+
+        for (auto& metric : Snapshot())
+        {
+            if (metric.name != previousName)
+            {
+                const char* typeName = metric.type == MetricType::Counter ? "counter"
+                    : metric.type == MetricType::Gauge ? "gauge"
+                    : "histogram";
+
+                output += "# HELP " + metric.name + " " + metric.help + "\n";
+                output += "# TYPE " + metric.name + " " + typeName + "\n";
+                previousName = metric.name;
+            }
+
+            if (metric.type != MetricType::Histogram)
+            {
+                AppendSeries(output, metric.name, metric.labels, metric.value);
+                continue;
+            }
+
+            auto& histogram = metric.histogram;
+            uint64_t cumulativeCount = 0;
+            for (int i = 0; i < (int)histogram.bucketCounts.size(); ++i)
+            {
+                cumulativeCount += histogram.bucketCounts[i];
+
+                char bound[64];
+                snprintf(bound, sizeof(bound), "le=\"%g\"", LatencyHistogram::BucketUpperBoundSeconds(i));
+                AppendSeries(output, metric.name + "_bucket", JoinLabels(metric.labels, bound), (double)cumulativeCount);
+            }
+
+            AppendSeries(output, metric.name + "_bucket", JoinLabels(metric.labels, "le=\"+Inf\""), (double)histogram.count);
+            AppendSeries(output, metric.name + "_sum", metric.labels, histogram.sumSeconds);
+            AppendSeries(output, metric.name + "_count", metric.labels, (double)histogram.count);
+        }
+
+        return output;
+    }
+
+    bool MetricsRegistry::TryWriteTextFile(const std::string& path)
+    {
+        auto text = FormatText();
+
+        // Write to the side and then swap it in so readers never see a partial file
+        auto temporaryPath = path + ".tmp";
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        bool wroteAll = fwrite(text.data(), 1, text.size(), file) == text.size();
+        wroteAll = fclose(file) == 0 && wroteAll;
+
+        if (!wroteAll)
+        {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+
+        return TryReplaceFile(temporaryPath, path);
+    }
+
+    struct DumpMetricsWorkItem : IThreadPoolWorkItem
+    {
+        DumpMetricsWorkItem(const std::string& path_, std::shared_ptr<std::atomic<bool>> isDumping_)
+            : path(path_),
+              isDumping(isDumping_)
+        {
+
+        }
+
+        void Execute() override
+        {
+            if (*isDumping)
+            {
+                MetricsRegistry::GetInstance()->TryWritePeriodicDump(path);
+            }
+        }
+
+        std::string path;
+        std::shared_ptr<std::atomic<bool>> isDumping;
+    };
+
+    bool MetricsRegistry::TryWritePeriodicDump(const std::string& path)
+    {
+        // A dump that takes longer than the interval would otherwise have the next one writing the same temporary file
+        if (_isWritingDump.exchange(true, std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        bool wroteFile = TryWriteTextFile(path);
+        _isWritingDump.store(false, std::memory_order_release);
+        return wroteFile;
+    }
+
+    void MetricsRegistry::StartPeriodicDump(const std::string& path, float intervalSeconds)
+    {
+        StopPeriodicDump();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _isDumping = std::make_shared<std::atomic<bool>>(true);
+        _dumpTask = std::make_shared<ScheduledTask>();
+        _dumpTask->workItem = std::make_shared<DumpMetricsWorkItem>(path, _isDumping);
+        _dumpTask->recurringTime = intervalSeconds;
+        _dumpTask->runTime = intervalSeconds;
+        TaskScheduler::GetInstance()->Start(_dumpTask);
+    }
+
+    void MetricsRegistry::StopPeriodicDump()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // The scheduler has no way to cancel a recurring task, so the task keeps firing but does nothing
+        if (_isDumping != nullptr)
+        {
+            *_isDumping = false;
+            _isDumping = nullptr;
+        }
+
+        _dumpTask = nullptr;
+    }
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+// Define as 0 to compile every metric update down to nothing
+#ifndef STRIFEML_METRICS
+#define STRIFEML_METRICS 1
+#endif
+
+namespace StrifeML
+{
+    namespace Metrics
+    {
+        // Updates are spread over this many cache lines, one per thread (modulo), so threads don't contend on a metric
+        constexpr int TotalShards = 16;
+
+        inline std::atomic<bool> isEnabled { false };
+
+        // Metrics are off until enabled at runtime. While off, recording costs one relaxed load and a branch.
+        inline bool IsEnabled()
+        {
+#if STRIFEML_METRICS
+            return isEnabled.load(std::memory_order_relaxed);
+#else
+            return false;
+#endif
+        }
+
+        inline void SetEnabled(bool enabled)
+        {
+            isEnabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        inline int CurrentThreadShard()
+        {
+            static std::atomic<int> nextShard { 0 };
+            thread_local int shard = nextShard.fetch_add(1, std::memory_order_relaxed) % TotalShards;
+            return shard;
+        }
+    }
+
+    class MetricCounter
+    {
+    public:
+        void Add(int64_t value = 1)
+        {
+            if (Metrics::IsEnabled())
+            {
+                _shards[Metrics::CurrentThreadShard()].value.fetch_add(value, std::memory_order_relaxed);
+            }
+        }
+
+        int64_t Value() const
+        {
+            int64_t total = 0;
+            for (auto& shard : _shards)
+            {
+                total += shard.value.load(std::memory_order_relaxed);
+            }
+
+            return total;
+        }
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::atomic<int64_t> value { 0 };
+        };
+
+        Shard _shards[Metrics::TotalShards];
+    };
+
+    class MetricGauge
+    {
+    public:
+        void Set(int64_t value)
+        {
+            if (Metrics::IsEnabled())
+            {
+                _value.store(value, std::memory_order_relaxed);
+            }
+        }
+
+        void Add(int64_t value)
+        {
+            if (Metrics::IsEnabled())
+            {
+                _value.fetch_add(value, std::memory_order_relaxed);
+            }
+        }
+
+        int64_t Value() const
+        {
+            return _value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<int64_t> _value { 0 };
+    };
+
+    struct LatencyHistogramSnapshot
+    {
+        double Percentile(double percentile) const;
+
+        // bucketCounts[i] is the number of samples under 2^i nanoseconds that weren't counted in an earlier bucket
+        std::vector<uint64_t> bucketCounts;
+        uint64_t count = 0;
+        double sumSeconds = 0;
+    };
+
+    // Power-of-two buckets in nanoseconds, from under 1ns up to about 9 minutes
+    class LatencyHistogram
+    {
+    public:
+        static constexpr int TotalBuckets = 40;
+
+        static double BucketUpperBoundSeconds(int bucket)
+        {
+            return (double)(1ull << bucket) * 1e-9;
+        }
+
+        void RecordNanoseconds(int64_t nanoseconds)
+        {
+            if (!Metrics::IsEnabled())
+            {
+                return;
+            }
+
+            auto& shard = _shards[Metrics::CurrentThreadShard()];
+            shard.buckets[BucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+            shard.count.fetch_add(1, std::memory_order_relaxed);
+            shard.sumNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        }
+
+        void RecordSeconds(double seconds)
+        {
+            RecordNanoseconds((int64_t)(seconds * 1e9));
+        }
+
+        void Record(std::chrono::steady_clock::duration duration)
+        {
+            RecordNanoseconds(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+        }
+
+        LatencyHistogramSnapshot Snapshot() const;
+
+    private:
+        static int BucketIndex(int64_t nanoseconds)
+        {
+            if (nanoseconds <= 0)
+            {
+                return 0;
+            }
+
+            // Index of the lowest power of two that's strictly greater than the value
+            int bucket = 64 - CountLeadingZeros((uint64_t)nanoseconds);
+            return std::min(bucket, TotalBuckets - 1);
+        }
+
+        static int CountLeadingZeros(uint64_t value)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanReverse64(&index, value);
+            return 63 - (int)index;
+#else
+            return __builtin_clzll(value);
+#endif
+        }
+
+        struct alignas(64) Shard
+        {
+            std::atomic<uint64_t> buckets[TotalBuckets] { };
+            std::atomic<uint64_t> count { 0 };
+            std::atomic<int64_t> sumNanoseconds { 0 };
+        };
+
+        Shard _shards[Metrics::TotalShards];
+    };
+
+    // Times a scope into a histogram, and doesn't even read the clock while metrics are disabled
+    class ScopedLatencyTimer
+    {
+    public:
+        explicit ScopedLatencyTimer(LatencyHistogram* histogram)
+            : _histogram(Metrics::IsEnabled() ? histogram : nullptr)
+        {
+            if (_histogram != nullptr)
+            {
+                _startTime = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~ScopedLatencyTimer()
+        {
+            if (_histogram != nullptr)
+            {
+                _histogram->Record(std::chrono::steady_clock::now() - _startTime);
+            }
+        }
+
+    private:
+        LatencyHistogram* _histogram;
+        std::chrono::steady_clock::time_point _startTime;
+    };
+
+    // Takes a lock, recording how long it had to wait for it
+    template<typename TLock>
+    void LockAndRecordWait(TLock& lock, LatencyHistogram* waitLatency)
+    {
+        if (!Metrics::IsEnabled())
+        {
+            lock.Lock();
+            return;
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+        lock.Lock();
+        waitLatency->Record(std::chrono::steady_clock::now() - startTime);
+    }
+
+    enum class MetricType
+    {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    struct MetricSnapshot
+    {
+        std::string name;
+        std::string labels;
+        std::string help;
+        MetricType type;
+
+        // Counters and gauges
+        double value = 0;
+
+        // Histograms
+        LatencyHistogramSnapshot histogram;
+    };
+
+    // Formats one label as name="value", escaping the value, for labels that come from user-supplied names
+    std::string MetricLabel(const std::string& name, const std::string& value);
+
+    // Owns every metric. Metrics are looked up by name once, typically in a constructor, and the returned pointers stay
+    // valid for the life of the process. Labels use the Prometheus syntax, e.g. set="agents"; see MetricLabel().
+    class MetricsRegistry
+    {
+    public:
+        static MetricsRegistry* GetInstance();
+
+        MetricCounter* GetCounter(const std::string& name, const std::string& help, const std::string& labels = "");
+        MetricGauge* GetGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+        LatencyHistogram* GetHistogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+        std::vector<MetricSnapshot> Snapshot();
+
+        // Prometheus text exposition format
+        std::string FormatText();
+        bool TryWriteTextFile(const std::string& path);
+
+        // Rewrites the file with the current metrics every intervalSeconds, until stopped
+        void StartPeriodicDump(const std::string& path, float intervalSeconds);
+        void StopPeriodicDump();
+
+    private:
+        friend struct DumpMetricsWorkItem;
+
+        // Skips the dump if the last one is still being written
+        bool TryWritePeriodicDump(const std::string& path);
+
+        struct Metric
+        {
+            std::string name;
+            std::string labels;
+            std::string help;
+            MetricType type;
+            std::unique_ptr<MetricCounter> counter;
+            std::unique_ptr<MetricGauge> gauge;
+            std::unique_ptr<LatencyHistogram> histogram;
+        };
+
+        Metric& GetOrAddMetric(const std::string& name, const std::string& help, const std::string& labels, MetricType type);
+
+        std::mutex _mutex;
+        std::map<std::string, Metric> _metricsByKey;
+        std::shared_ptr<ScheduledTask> _dumpTask;
+        std::shared_ptr<std::atomic<bool>> _isDumping;
+        std::atomic<bool> _isWritingDump { false };
+    };
+}
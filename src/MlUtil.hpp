@@ -27,6 +27,213 @@ namespace StrifeML
                 });
             }
         };
+
+        // Multi-producer, single-consumer queue. Producers append with a single CAS and never wait on the consumer; the
+        // consumer takes everything pushed so far in one exchange and visits it in the order it was pushed.
+        template<typename T>
+        struct StagingQueue
+        {
+            StagingQueue() = default;
+            StagingQueue(const StagingQueue&) = delete;
+            StagingQueue& operator=(const StagingQueue&) = delete;
+
+            ~StagingQueue()
+            {
+                Drain([](T&) { });
+            }
+
+            void Push(const T& value)
+            {
+                auto node = new Node { value, _head.load(std::memory_order_relaxed) };
+                while (!_head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+                {
+
+                }
+
+                _depth.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void Push(T&& value)
+            {
+                auto node = new Node { std::move(value), _head.load(std::memory_order_relaxed) };
+                while (!_head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+                {
+
+                }
+
+                _depth.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Only one thread may drain at a time
+            template<typename TFunc>
+            int Drain(TFunc&& func)
+            {
+                Node* node = _head.exchange(nullptr, std::memory_order_acquire);
+
+                // Nodes were pushed onto the front, so reverse them to get back to FIFO order
+                Node* ordered = nullptr;
+                int64_t taken = 0;
+                while (node != nullptr)
+                {
+                    Node* next = node->next;
+                    node->next = ordered;
+                    ordered = node;
+                    node = next;
+                    ++taken;
+                }
+
+                _depth.fetch_sub(taken, std::memory_order_relaxed);
+
+                // If func throws, the values it hasn't visited yet are dropped rather than leaked
+                struct DeleteRemainingOnExit
+                {
+                    ~DeleteRemainingOnExit()
+                    {
+                        while (remaining != nullptr)
+                        {
+                            Node* next = remaining->next;
+                            delete remaining;
+                            remaining = next;
+                        }
+                    }
+
+                    Node* remaining;
+                } deleteRemaining { ordered };
+
+                int count = 0;
+                while (deleteRemaining.remaining != nullptr)
+                {
+                    Node* current = deleteRemaining.remaining;
+                    func(current->value);
+                    deleteRemaining.remaining = current->next;
+                    delete current;
+                    ++count;
+                }
+
+                return count;
+            }
+
+            bool IsEmpty() const
+            {
+                return _head.load(std::memory_order_relaxed) == nullptr;
+            }
+
+            // Values pushed but not yet taken by Drain(). Updated after the push lands, so it can briefly lag behind.
+            int64_t Depth() const
+            {
+                return std::max<int64_t>(0, _depth.load(std::memory_order_relaxed));
+            }
+
+        private:
+            struct Node
+            {
+                T value;
+                Node* next;
+            };
+
+            std::atomic<Node*> _head { nullptr };
+            std::atomic<int64_t> _depth { 0 };
+        };
+
+        struct ParallelShardJob
+        {
+            ParallelShardJob(int shardCount_, std::function<void(int shardIndex)> runShard_)
+                : shardCount(shardCount_),
+                  runShard(std::move(runShard_))
+            {
+
+            }
+
+            void RunAvailableShards()
+            {
+                int shardIndex;
+                while ((shardIndex = nextShard.fetch_add(1, std::memory_order_relaxed)) < shardCount)
+                {
+                    // A shard that throws still counts as completed, otherwise the caller would wait on it forever. The first
+                    // exception is kept and rethrown on the caller once nothing is touching its frame anymore.
+                    try
+                    {
+                        runShard(shardIndex);
+                    }
+                    catch (...)
+                    {
+                        if (!hasException.exchange(true, std::memory_order_relaxed))
+                        {
+                            exception = std::current_exception();
+                        }
+                    }
+
+                    completedShards.fetch_add(1, std::memory_order_release);
+                }
+            }
+
+            int shardCount;
+            std::function<void(int shardIndex)> runShard;
+            std::atomic<int> nextShard { 0 };
+            std::atomic<int> completedShards { 0 };
+            std::atomic<bool> hasException { false };
+            std::exception_ptr exception;
+        };
+
+        struct RunParallelShardsWorkItem : IThreadPoolWorkItem
+        {
+            RunParallelShardsWorkItem(std::shared_ptr<ParallelShardJob> job_)
+                : job(job_)
+            {
+
+            }
+
+            void Execute() override
+            {
+                job->RunAvailableShards();
+            }
+
+            std::shared_ptr<ParallelShardJob> job;
+        };
+
+        // Calls runShard(0..shardCount-1) spread over the thread pool. The calling thread runs shards as well and claims
+        // every shard no helper has started yet, so it only ever waits on shards that are already running. Helpers go in
+        // the helper lane by default, which shares the training budget, so a training item only gets as many helpers as
+        // the budget has workers left, and none with a single training worker. At most one helper per spare core is
+        // started, since each helper keeps taking shards until there are none left.
+        template<typename TFunc>
+        void ParallelForShards(int shardCount, TFunc runShard, WorkLane lane = WorkLane::Helper)
+        {
+            auto scheduler = WorkScheduler::GetInstance();
+            int helperCount = std::min(shardCount, std::max(1, (int)std::thread::hardware_concurrency())) - 1;
+            if (lane == WorkLane::Helper)
+            {
+                helperCount = std::min(helperCount, scheduler->SpareTrainingWorkers());
+            }
+
+            if (helperCount <= 0)
+            {
+                for (int i = 0; i < shardCount; ++i)
+                {
+                    runShard(i);
+                }
+
+                return;
+            }
+
+            auto job = std::make_shared<ParallelShardJob>(shardCount, runShard);
+            for (int i = 0; i < helperCount; ++i)
+            {
+                scheduler->StartItem(std::make_shared<RunParallelShardsWorkItem>(job), lane);
+            }
+
+            job->RunAvailableShards();
+
+            while (job->completedShards.load(std::memory_order_acquire) < shardCount)
+            {
+                std::this_thread::yield();
+            }
+
+            if (job->exception != nullptr)
+            {
+                std::rethrow_exception(job->exception);
+            }
+        }
     }
 
     struct StrifeException : std::exception
@@ -55,25 +262,167 @@ namespace StrifeML
         std::string message;
     };
 
+    // xoshiro256** generator. Every generator is a stream derived from a seed, and CreateStream() hands out independent
+    // streams from the same seed. Streams belong to whatever does the sampling, such as a sample set, rather than to a
+    // thread: which thread runs a batch changes from run to run, so per-thread streams would make sampling depend on
+    // scheduling. A trainer's seed fixes its sampling and torch's CPU generator, which initialization and dropout draw
+    // from; the results of multithreaded torch ops can still differ in the last bits between runs.
     struct RandomNumberGenerator
     {
         RandomNumberGenerator()
-            : _rng(std::random_device()())
+            : RandomNumberGenerator(NondeterministicSeed())
         {
 
         }
 
+        explicit RandomNumberGenerator(uint64_t seed, uint64_t streamId = 0)
+            : _seed(seed),
+              _streamId(streamId)
+        {
+            uint64_t splitMixState = seed ^ (streamId * 0xD1B54A32D192ED03ull);
+            for (auto& word : _state)
+            {
+                word = SplitMix64(splitMixState);
+            }
+        }
+
+        static uint64_t NondeterministicSeed()
+        {
+            std::random_device device;
+            return ((uint64_t)device() << 32) | device();
+        }
+
+        RandomNumberGenerator CreateStream(uint64_t streamId) const
+        {
+            return RandomNumberGenerator(_seed, streamId);
+        }
+
+        uint64_t NextUInt64()
+        {
+            uint64_t result = RotateLeft(_state[1] * 5, 7) * 9;
+            uint64_t t = _state[1] << 17;
+
+            _state[2] ^= _state[0];
+            _state[3] ^= _state[1];
+            _state[1] ^= _state[2];
+            _state[0] ^= _state[3];
+            _state[2] ^= t;
+            _state[3] = RotateLeft(_state[3], 45);
+
+            return result;
+        }
+
+        // Returns a value in [min, max]
         int RandInt(int min, int max)
         {
-            return std::uniform_int_distribution<int>(min, max)(_rng);
+            uint32_t range = (uint32_t)((int64_t)max - min + 1);
+            if (range == 0)
+            {
+                // The full 32-bit range
+                return (int)(uint32_t)NextUInt64();
+            }
+
+            // Lemire's nearly divisionless method, which has no modulo bias
+            uint64_t product = (NextUInt64() >> 32) * range;
+            uint32_t low = (uint32_t)product;
+            if (low < range)
+            {
+                uint32_t threshold = (0u - range) % range;
+                while (low < threshold)
+                {
+                    product = (NextUInt64() >> 32) * range;
+                    low = (uint32_t)product;
+                }
+            }
+
+            return (int)(min + (int64_t)(product >> 32));
+        }
+
+        // Returns a value in [min, max)
+        float RandFloat(float min, float max)
+        {
+            float unit = (NextUInt64() >> 40) * (1.0f / (1 << 24));
+            return min + unit * (max - min);
+        }
+
+        // The same numbers as calling RandInt() for each value, but the rejection threshold is only worked out once
+        void RandInts(int min, int max, gsl::span<int> outValues)
+        {
+            uint32_t range = (uint32_t)((int64_t)max - min + 1);
+            if (range == 0)
+            {
+                for (auto& value : outValues)
+                {
+                    value = (int)(uint32_t)NextUInt64();
+                }
+
+                return;
+            }
+
+            uint32_t threshold = (0u - range) % range;
+            for (auto& value : outValues)
+            {
+                uint64_t product = (NextUInt64() >> 32) * range;
+                while ((uint32_t)product < threshold)
+                {
+                    product = (NextUInt64() >> 32) * range;
+                }
+
+                value = (int)(min + (int64_t)(product >> 32));
+            }
+        }
+
+        void RandFloats(float min, float max, gsl::span<float> outValues)
+        {
+            for (auto& value : outValues)
+            {
+                value = RandFloat(min, max);
+            }
         }
 
-        int RandFloat(float min, float max)
+        uint64_t Seed() const { return _seed; }
+        uint64_t StreamId() const { return _streamId; }
+
+        // Where the generator is in its stream, so a checkpointed run can carry on with the same numbers
+        struct State
         {
-            return std::uniform_real_distribution<float>(min, max)(_rng);
+            uint64_t words[4];
+            uint64_t seed;
+            uint64_t streamId;
+        };
+
+        State GetState() const
+        {
+            State state;
+            memcpy(state.words, _state, sizeof(_state));
+            state.seed = _seed;
+            state.streamId = _streamId;
+            return state;
+        }
+
+        void SetState(const State& state)
+        {
+            memcpy(_state, state.words, sizeof(_state));
+            _seed = state.seed;
+            _streamId = state.streamId;
         }
 
     private:
-        std::mt19937 _rng;
+        static uint64_t RotateLeft(uint64_t value, int bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        static uint64_t SplitMix64(uint64_t& state)
+        {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        uint64_t _state[4];
+        uint64_t _seed;
+        uint64_t _streamId;
     };
 }
\ No newline at end of file
@@ -1,10 +1,32 @@
 #pragma once
 
+#include "SampleRepository.hpp"
+
 namespace StrifeML
 {
     template<typename TNeuralNetwork> struct Trainer;
     template<typename TNeuralNetwork> struct Decider;
 
+    // Lets deciders run an int8 snapshot of each published network instead of the fp32 one. Every snapshot is checked
+    // against fp32 on the newest samples of a trainer's sample set first, and deciders keep fp32 if too many decisions differ.
+    // Those samples aren't held out: they're the ones the trainer got most recently, and it may already have trained on them.
+    template<typename TOutput>
+    struct QuantizedInferenceOptions
+    {
+        bool isEnabled = false;
+
+        // Name of the trainer's sample set the check uses. Without one, or without a trainer, as in actor processes, there is
+        // nothing to check against and deciders stay on fp32.
+        std::string validationSet;
+        int validationRows = 256;
+
+        // Fraction of the check's decisions that have to be the same in int8 as in fp32
+        float minAgreement = 0.98f;
+
+        // Whether two decisions count as the same. If not set, their serialized bytes have to match.
+        std::function<bool(const TOutput& fp32Output, const TOutput& int8Output)> outputsMatch;
+    };
+
     struct INetworkContext
     {
         virtual ~INetworkContext() = default;
@@ -13,23 +35,55 @@ namespace StrifeML
     template<typename TNeuralNetwork>
     struct NetworkContext : INetworkContext
     {
+        using InputType = typename TNeuralNetwork::InputType;
+        using OutputType = typename TNeuralNetwork::OutputType;
+        using SampleType = typename TNeuralNetwork::SampleType;
+
         NetworkContext(Decider<TNeuralNetwork>* decider_, Trainer<TNeuralNetwork>* trainer_, int sequenceLength)
             : decider(decider_),
               trainer(trainer_),
     		  sequenceLength(sequenceLength)
         {
-
+            auto metrics = MetricsRegistry::GetInstance();
+            loadLatency = metrics->GetHistogram("strifeml_network_context_load_seconds", "Time to load a published network");
+            lockWaitLatency = metrics->GetHistogram("strifeml_network_context_lock_wait_seconds", "Time spent waiting for the network context's lock");
+            quantizeLatency = metrics->GetHistogram("strifeml_network_context_quantize_seconds", "Time to quantize and check a published network");
+            quantizedNetworks = metrics->GetCounter("strifeml_network_context_quantized_total", "Published networks deciders run in int8");
+            quantizationFallbacks = metrics->GetCounter("strifeml_network_context_quantization_fallbacks_total", "Published networks deciders run in fp32 because quantizing failed its check");
+            quantizationAgreement = metrics->GetGauge("strifeml_network_context_quantization_agreement_percent", "Percent of decisions the last quantized network made the same as fp32");
         }
 
         virtual ~NetworkContext() = default;
 
+        // The network is loaded and quantized before the lock deciders take in TryGetNewNetwork() is held, which is only
+        // held to swap it in
         std::shared_ptr <TNeuralNetwork> SetNewNetwork(std::stringstream& stream)
         {
-            newNetworkLock.Lock();
+            // Setters don't run at the same time, since quantizing uses the context's scratch buffers
+            std::lock_guard<std::mutex> preparationLock(preparationMutex);
             std::shared_ptr <TNeuralNetwork> result = std::make_shared<TNeuralNetwork>();
+
+            {
+                ScopedLatencyTimer loadTimer(loadLatency);
+                TorchLoad(result->module, stream);
+            }
+
+            if (quantization.isEnabled)
+            {
+                ScopedLatencyTimer quantizeTimer(quantizeLatency);
+                bool useInt8 = result->PrepareQuantizedInference() && CheckQuantizedDecisions(*result);
+                result->SetQuantizedInferenceEnabled(useInt8);
+                (useInt8 ? quantizedNetworks : quantizationFallbacks)->Add();
+            }
+
+            // Actor processes have no trainer of their own
+            if (trainer != nullptr)
+            {
+                trainer->OnCreateNewNetwork(result);
+            }
+
+            LockAndRecordWait(newNetworkLock, lockWaitLatency);
             newNetwork = result;
-            TorchLoad(newNetwork->module, stream);
-            trainer->OnCreateNewNetwork(newNetwork);
             newNetworkLock.Unlock();
 
             return result;
@@ -37,19 +91,148 @@ namespace StrifeML
 
         std::shared_ptr <TNeuralNetwork> TryGetNewNetwork()
         {
-            newNetworkLock.Lock();
+            LockAndRecordWait(newNetworkLock, lockWaitLatency);
             auto result = newNetwork;
             newNetwork = nullptr;
             newNetworkLock.Unlock();
             return result;
         }
 
+        QuantizedInferenceOptions<OutputType> quantization;
+
         Decider <TNeuralNetwork>* decider;
         Trainer <TNeuralNetwork>* trainer;
 
         std::shared_ptr <TNeuralNetwork> newNetwork;
         SpinLock newNetworkLock;
+        std::mutex preparationMutex;
         bool isEnabled = true;
         int sequenceLength;
+
+        LatencyHistogram* loadLatency;
+        LatencyHistogram* lockWaitLatency;
+        LatencyHistogram* quantizeLatency;
+        MetricCounter* quantizedNetworks;
+        MetricCounter* quantizationFallbacks;
+        MetricGauge* quantizationAgreement;
+
+    private:
+        // Makes the same decisions with int8 on and off and returns whether enough of them agree
+        bool CheckQuantizedDecisions(TNeuralNetwork& network)
+        {
+            if (!TryGetValidationInputs())
+            {
+                return false;
+            }
+
+            int rows = (int)_validationInputs.size() / sequenceLength;
+            Grid<const InputType> input(rows, sequenceLength, _validationInputs.data());
+            _fp32Outputs.assign(rows, OutputType());
+            _int8Outputs.assign(rows, OutputType());
+
+            network.SetQuantizedInferenceEnabled(false);
+            network.MakeDecision(input, gsl::span<OutputType>(_fp32Outputs));
+            network.SetQuantizedInferenceEnabled(true);
+            network.MakeDecision(input, gsl::span<OutputType>(_int8Outputs));
+
+            int matches = 0;
+            for (int i = 0; i < rows; ++i)
+            {
+                matches += OutputsMatch(_fp32Outputs[i], _int8Outputs[i]) ? 1 : 0;
+            }
+
+            float agreement = (float)matches / rows;
+            quantizationAgreement->Set((int64_t)(agreement * 100));
+            return agreement >= quantization.minAgreement;
+        }
+
+        // Takes the newest validationRows sequences from the validation set, newest first. Only copying their stored bytes
+        // happens under the trainer's sample lock; they're deserialized once it's released.
+        bool TryGetValidationInputs()
+        {
+            _validationInputs.clear();
+            _validationSamples.Clear();
+            if (trainer == nullptr || quantization.validationSet.empty())
+            {
+                return false;
+            }
+
+            LockAndRecordWait(trainer->sampleLock, trainer->sampleLockWaitLatency);
+            auto sampleSet = trainer->sampleRepository.GetSampleSet(quantization.validationSet);
+            if (sampleSet != nullptr)
+            {
+                int endSampleId = sampleSet->SampleCount() - 1;
+                while (_validationSamples.Count() < quantization.validationRows * sequenceLength && endSampleId - sequenceLength + 1 >= 0)
+                {
+                    int startSampleId = endSampleId - sequenceLength + 1;
+                    int rowStart = _validationSamples.Count();
+                    for (int sampleId = startSampleId; sampleId <= endSampleId; ++sampleId)
+                    {
+                        if (!sampleSet->TryCopySerializedSample(sampleId, _validationSamples))
+                        {
+                            break;
+                        }
+                    }
+
+                    // Only whole sequences count; evicted samples leave gaps, so the next sequence ends just before this one
+                    if (_validationSamples.Count() - rowStart != sequenceLength)
+                    {
+                        _validationSamples.Truncate(rowStart);
+                    }
+
+                    endSampleId = startSampleId - 1;
+                }
+            }
+
+            trainer->sampleLock.Unlock();
+
+            SampleType sample;
+            for (int rowStart = 0; rowStart < _validationSamples.Count(); rowStart += sequenceLength)
+            {
+                size_t inputsBefore = _validationInputs.size();
+                for (int i = rowStart; i < rowStart + sequenceLength; ++i)
+                {
+                    auto bytes = _validationSamples.Bytes(i);
+                    _sampleBytes.assign(bytes.begin(), bytes.end());
+                    if (!SampleSet<SampleType>::TryDeserializeSample(_sampleBytes, sample))
+                    {
+                        break;
+                    }
+
+                    _validationInputs.push_back(sample.input);
+                }
+
+                if (_validationInputs.size() - inputsBefore != (size_t)sequenceLength)
+                {
+                    _validationInputs.resize(inputsBefore);
+                }
+            }
+
+            return !_validationInputs.empty();
+        }
+
+        bool OutputsMatch(OutputType& fp32Output, OutputType& int8Output)
+        {
+            if (quantization.outputsMatch != nullptr)
+            {
+                return quantization.outputsMatch(fp32Output, int8Output);
+            }
+
+            _fp32Bytes.clear();
+            _int8Bytes.clear();
+            ObjectSerializer fp32Serializer(_fp32Bytes, false);
+            ObjectSerializer int8Serializer(_int8Bytes, false);
+            fp32Output.Serialize(fp32Serializer);
+            int8Output.Serialize(int8Serializer);
+            return _fp32Bytes == _int8Bytes;
+        }
+
+        SerializedSampleBatch _validationSamples;
+        std::vector<unsigned char> _sampleBytes;
+        std::vector<InputType> _validationInputs;
+        std::vector<OutputType> _fp32Outputs;
+        std::vector<OutputType> _int8Outputs;
+        std::vector<unsigned char> _fp32Bytes;
+        std::vector<unsigned char> _int8Bytes;
     };
 }
\ No newline at end of file
@@ -2,6 +2,39 @@
 
 namespace StrifeML
 {
+    void TorchCopyParameters(std::shared_ptr<torch::nn::Module> from, std::shared_ptr<torch::nn::Module> to);
+    void TorchShareParameters(std::shared_ptr<torch::nn::Module> from, std::shared_ptr<torch::nn::Module> to);
+    void TorchZeroGradients(std::shared_ptr<torch::nn::Module> module);
+    void TorchAddGradients(std::shared_ptr<torch::nn::Module> from, std::shared_ptr<torch::nn::Module> to, float scale);
+    void TorchScaleGradients(std::shared_ptr<torch::nn::Module> module, float scale);
+
+    enum class TrainingPrecision
+    {
+        Float32,
+
+        // Forward passes run in bfloat16 and inputs are packed as bfloat16, but parameters, gradients and the optimizer
+        // stay fp32, so the published network is the same fp32 network either way
+        BFloat16
+    };
+
+    // Runs the CPU ops in its scope in bfloat16 where that's safe, through torch's autocast, while everything else, including
+    // parameters, stays fp32. Autocast is per thread, so each thread that trains needs its own scope. CPU autocast needs
+    // libtorch 1.10 or newer, and bfloat16 scopes throw on anything older.
+    class MixedPrecisionScope
+    {
+    public:
+        explicit MixedPrecisionScope(TrainingPrecision precision);
+        ~MixedPrecisionScope();
+
+        MixedPrecisionScope(const MixedPrecisionScope&) = delete;
+        MixedPrecisionScope& operator=(const MixedPrecisionScope&) = delete;
+
+    private:
+        bool _isEnabled;
+        bool _wasEnabled = false;
+        int _previousType = 0;
+    };
+
     struct INeuralNetwork
     {
         INeuralNetwork()
@@ -33,6 +66,36 @@ namespace StrifeML
         virtual void MakeDecision(Grid<const TInput> input, gsl::span<TOutput> output) = 0;
         virtual void TrainBatch(Grid<const SampleType> input, TrainingBatchResult& outResult) = 0;
 
+        // Optional split of TrainBatch() used by data-parallel training and gradient accumulation. ComputeGradients()
+        // should run the forward and backward pass without touching the optimizer, leaving the gradients accumulated in
+        // the module's parameters. ApplyGradients() should step the optimizer. The trainer takes care of zeroing the
+        // gradients.
+        virtual bool SupportsGradientSplit() const { return false; }
+        virtual void ComputeGradients(Grid<const SampleType> input, TrainingBatchResult& outResult) { }
+        virtual void ApplyGradients() { }
+
+        // Optional, so trainer checkpoints can restore the optimizer's state along with the weights. Usually torch::save()
+        // and torch::load() of the optimizer.
+        virtual void SaveOptimizer(std::stringstream& stream) { }
+        virtual void LoadOptimizer(std::stringstream& stream) { }
+
+        // Used instead of TrainBatch() and ComputeGradients() when the trainer has shareSequenceFrames set. Each distinct sample
+        // is in the batch once: PackIntoTensor(batch, selector) gathers it into the usual [rows, sequence length, ...] tensor,
+        // or run per-frame work once on PackFramesIntoTensor() and gather the results with the frame indexes.
+        virtual void TrainSequenceBatch(const SequenceBatch<SampleType>& batch, TrainingBatchResult& outResult) { }
+        virtual void ComputeSequenceGradients(const SequenceBatch<SampleType>& batch, TrainingBatchResult& outResult) { }
+
+        // Optional int8 inference, used when the network context has quantization enabled. PrepareQuantizedInference() is
+        // called on each published network before any decider gets it and should build what MakeDecision() runs in int8,
+        // usually with QuantizedLinearLayers, returning false if nothing could be quantized. SetQuantizedInferenceEnabled()
+        // switches MakeDecision() between the int8 and fp32 layers; the context uses it to check one against the other.
+        virtual bool PrepareQuantizedInference() { return false; }
+        virtual void SetQuantizedInferenceEnabled(bool isEnabled) { }
+
         int sequenceLength;
+
+        // Kept in sync with the trainer's before each batch. Networks that support mixed precision pack their training inputs
+        // with PackIntoTensor(grid, selector, trainingPrecision).
+        TrainingPrecision trainingPrecision = TrainingPrecision::Float32;
     };
 }
\ No newline at end of file
@@ -0,0 +1,320 @@
+#pragma once
+
+namespace StrifeML
+{
+    // Hands out items in random order while only holding capacity items. Until it's full, nothing comes out; after that,
+    // each item added pushes out a random one, and once the input runs dry the rest are drained in random order.
+    template<typename T>
+    class ShuffleBuffer
+    {
+    public:
+        ShuffleBuffer(int capacity)
+            : _capacity(std::max(1, capacity))
+        {
+            _items.reserve(_capacity);
+        }
+
+        bool IsFull() const { return _items.size() >= (size_t)_capacity; }
+        bool IsEmpty() const { return _items.empty(); }
+
+        void Add(T&& item)
+        {
+            _items.push_back(std::move(item));
+        }
+
+        bool TryTake(RandomNumberGenerator& rng, T& outItem)
+        {
+            if (_items.empty())
+            {
+                return false;
+            }
+
+            int index = rng.RandInt(0, (int)_items.size() - 1);
+            std::swap(_items[index], _items.back());
+            outItem = std::move(_items.back());
+            _items.pop_back();
+
+            return true;
+        }
+
+    private:
+        int _capacity;
+        std::vector<T> _items;
+    };
+
+    struct OfflineTrainingSettings
+    {
+        // Passes over the shards
+        int epochs = 1;
+
+        // Sequences held for shuffling. Bigger decorrelates batches better at the cost of memory.
+        int shuffleBufferSize = 16384;
+
+        // Batches between publishing the network through the trainer. 0 only publishes once, at the end.
+        int publishInterval = 0;
+
+        uint32_t sampleVersion = 0;
+        SampleShardReaderSettings reader;
+    };
+
+    struct OfflineTrainingResult
+    {
+        int batches = 0;
+        int64_t sequences = 0;
+        uint64_t bytesRead = 0;
+        float seconds = 0;
+        float averageLoss = 0;
+    };
+
+    // Trains a Trainer's network from sample shards on disk with no game attached. Sequences are windows of
+    // sequenceLength consecutive samples within a shard, so shards should be written in the order samples were recorded.
+    // Batches go through Trainer::TrainBatch, so data parallel replicas and mixed precision work as they do live, and the
+    // network is published the same way too. If the trainer has shareSequenceFrames set, batches are built with its
+    // sequenceBatchBuilder and trained with Trainer::TrainSequenceBatch instead, the same as live.
+    //
+    // Offline there's no need for gradient accumulation since the batch size isn't tied to the game, so accumulationSteps
+    // is ignored; make the trainer's batch size bigger instead.
+    //
+    // With the trainer's checkpoints enabled, each publish counts towards batchesPerCheckpoint as it does live, and Run()
+    // waits for the last checkpoint to be written before returning. Where the run was in the shards isn't part of a
+    // checkpoint, so a run resumed with TryResumeFromCheckpoint() carries on training the restored network from the first
+    // shard of the first epoch.
+    template<typename TNeuralNetwork>
+    class OfflineTrainer
+    {
+    public:
+        using SampleType = typename Trainer<TNeuralNetwork>::SampleType;
+
+        OfflineTrainer(std::shared_ptr<Trainer<TNeuralNetwork>> trainer, std::vector<std::string> shardPaths, const OfflineTrainingSettings& settings)
+            : _trainer(trainer),
+              _shardPaths(std::move(shardPaths)),
+              _settings(settings),
+              _rng(trainer->rng.CreateStream(0x0FF11E))
+        {
+
+        }
+
+        OfflineTrainingResult Run();
+
+    private:
+        // A sequence is kept as the serialized bytes of its samples back to back, with where each sample starts and a key
+        // for each made of its shard and its position in the shard
+        struct Sequence
+        {
+            std::vector<unsigned char> bytes;
+            std::vector<int> sampleOffsets;
+            std::vector<uint64_t> frameKeys;
+        };
+
+        bool TryTakeSequence(SampleShardReader& reader, ShuffleBuffer<Sequence>& shuffleBuffer, Sequence& outSequence);
+        bool TryFillBatch(Grid<SampleType> outBatch, SampleShardReader& reader, ShuffleBuffer<Sequence>& shuffleBuffer);
+        bool TryFillSequenceBatch(SampleShardReader& reader, ShuffleBuffer<Sequence>& shuffleBuffer);
+        bool TryReadSequence(SampleShardReader& reader, Sequence& outSequence);
+        void Publish(TrainingBatchResult& result);
+
+        std::shared_ptr<Trainer<TNeuralNetwork>> _trainer;
+        std::vector<std::string> _shardPaths;
+        OfflineTrainingSettings _settings;
+        RandomNumberGenerator _rng;
+        std::deque<std::vector<unsigned char>> _window;
+        int _windowShard = -1;
+        uint32_t _recordsReadInShard = 0;
+        std::vector<Sequence> _batchSequences;
+        int64_t _sequencesTrained = 0;
+    };
+
+    template<typename TNeuralNetwork>
+    OfflineTrainingResult OfflineTrainer<TNeuralNetwork>::Run()
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        auto trainer = _trainer;
+        OfflineTrainingResult result;
+        TrainingBatchResult batchResult;
+        double totalLoss = 0;
+
+        for (int epoch = 0; epoch < _settings.epochs; ++epoch)
+        {
+            SampleShardReader reader(_shardPaths, _settings.sampleVersion, _settings.reader);
+            ShuffleBuffer<Sequence> shuffleBuffer(_settings.shuffleBufferSize);
+            _window.clear();
+            _windowShard = -1;
+
+            Grid<SampleType> batch(trainer->batchSize, trainer->sequenceLength, trainer->trainingInput.data.get());
+            while (trainer->shareSequenceFrames
+                ? TryFillSequenceBatch(reader, shuffleBuffer)
+                : TryFillBatch(batch, reader, shuffleBuffer))
+            {
+                trainer->OnRunBatch();
+                if (trainer->shareSequenceFrames)
+                {
+                    trainer->TrainSequenceBatch(trainer->sequenceBatchBuilder.Batch(), batchResult);
+                }
+                else
+                {
+                    trainer->TrainBatch(Grid<const SampleType>(batch.Rows(), batch.Cols(), batch[0]), batchResult);
+                }
+
+                totalLoss += batchResult.loss;
+                ++result.batches;
+
+                if (_settings.publishInterval > 0 && result.batches % _settings.publishInterval == 0)
+                {
+                    Publish(batchResult);
+                }
+            }
+
+            result.bytesRead += reader.BytesRead();
+        }
+
+        if (result.batches > 0)
+        {
+            result.averageLoss = (float)(totalLoss / result.batches);
+            Publish(batchResult);
+        }
+
+        if (trainer->checkpointWriter != nullptr)
+        {
+            trainer->checkpointWriter->Flush();
+        }
+
+        result.sequences = _sequencesTrained;
+        result.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+        return result;
+    }
+
+    template<typename TNeuralNetwork>
+    bool OfflineTrainer<TNeuralNetwork>::TryTakeSequence(SampleShardReader& reader, ShuffleBuffer<Sequence>& shuffleBuffer, Sequence& outSequence)
+    {
+        Sequence sequence;
+        while (!shuffleBuffer.IsFull() && TryReadSequence(reader, sequence))
+        {
+            shuffleBuffer.Add(std::move(sequence));
+        }
+
+        return shuffleBuffer.TryTake(_rng, outSequence);
+    }
+
+    template<typename TNeuralNetwork>
+    bool OfflineTrainer<TNeuralNetwork>::TryFillBatch(Grid<SampleType> outBatch, SampleShardReader& reader, ShuffleBuffer<Sequence>& shuffleBuffer)
+    {
+        Sequence sequence;
+
+        for (int row = 0; row < outBatch.Rows(); ++row)
+        {
+            // The tail of the last epoch that doesn't fill a whole batch is dropped
+            if (!TryTakeSequence(reader, shuffleBuffer, sequence))
+            {
+                return false;
+            }
+
+            ObjectSerializer serializer(sequence.bytes, true);
+            for (int i = 0; i < outBatch.Cols(); ++i)
+            {
+                outBatch[row][i].input.Serialize(serializer);
+                outBatch[row][i].output.Serialize(serializer);
+            }
+
+            if (serializer.hadError)
+            {
+                throw StrifeException("Failed to deserialize a sample from the shards");
+            }
+        }
+
+        _sequencesTrained += outBatch.Rows();
+        return true;
+    }
+
+    template<typename TNeuralNetwork>
+    bool OfflineTrainer<TNeuralNetwork>::TryFillSequenceBatch(SampleShardReader& reader, ShuffleBuffer<Sequence>& shuffleBuffer)
+    {
+        auto& builder = _trainer->sequenceBatchBuilder;
+        int batchSize = _trainer->batchSize;
+
+        // Kept until the next batch, since the builder deserializes from them when it builds
+        _batchSequences.resize(batchSize);
+        builder.Begin(_trainer->sequenceLength);
+
+        for (int row = 0; row < batchSize; ++row)
+        {
+            auto& sequence = _batchSequences[row];
+            if (!TryTakeSequence(reader, shuffleBuffer, sequence))
+            {
+                return false;
+            }
+
+            builder.AddSequence(sequence.frameKeys, [&sequence](int step, SampleType& outSample)
+            {
+                ObjectSerializer serializer(sequence.bytes, true);
+                serializer.Seek(sequence.sampleOffsets[step]);
+                outSample.input.Serialize(serializer);
+                outSample.output.Serialize(serializer);
+                return !serializer.hadError;
+            });
+        }
+
+        if (!builder.TryBuild())
+        {
+            throw StrifeException("Failed to deserialize a sample from the shards");
+        }
+
+        _sequencesTrained += batchSize;
+        return true;
+    }
+
+    template<typename TNeuralNetwork>
+    bool OfflineTrainer<TNeuralNetwork>::TryReadSequence(SampleShardReader& reader, Sequence& outSequence)
+    {
+        gsl::span<const unsigned char> record;
+        int shardIndex;
+        int sequenceLength = _trainer->sequenceLength;
+
+        do
+        {
+            if (!reader.TryReadNext(record, shardIndex))
+            {
+                return false;
+            }
+
+            // Sequences don't cross from one shard into the next
+            if (shardIndex != _windowShard)
+            {
+                _window.clear();
+                _windowShard = shardIndex;
+                _recordsReadInShard = 0;
+            }
+
+            if ((int)_window.size() == sequenceLength)
+            {
+                _window.pop_front();
+            }
+
+            _window.emplace_back(record.begin(), record.end());
+            ++_recordsReadInShard;
+        } while ((int)_window.size() < sequenceLength);
+
+        outSequence.bytes.clear();
+        outSequence.sampleOffsets.clear();
+        outSequence.frameKeys.clear();
+
+        uint32_t firstRecord = _recordsReadInShard - (uint32_t)_window.size();
+        for (int i = 0; i < (int)_window.size(); ++i)
+        {
+            outSequence.sampleOffsets.push_back((int)outSequence.bytes.size());
+            outSequence.frameKeys.push_back(((uint64_t)_windowShard << 32) | (firstRecord + i));
+            outSequence.bytes.insert(outSequence.bytes.end(), _window[i].begin(), _window[i].end());
+        }
+
+        return true;
+    }
+
+    template<typename TNeuralNetwork>
+    void OfflineTrainer<TNeuralNetwork>::Publish(TrainingBatchResult& result)
+    {
+        auto saveStart = std::chrono::steady_clock::now();
+        std::stringstream stream;
+        TorchSave(_trainer->network->module, stream);
+        result.timings.publishSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - saveStart).count();
+        _trainer->NotifyTrainingComplete(stream, result);
+        _trainer->CheckpointIfDue(stream);
+    }
+}
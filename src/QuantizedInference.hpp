@@ -0,0 +1,121 @@
+#pragma once
+
+#include <unordered_map>
+#include <torch/torch.h>
+
+namespace StrifeML
+{
+    // Int8 copies of a module's linear layers for making decisions. Weights are quantized once when the snapshot is taken
+    // and activations are quantized on the fly by each call (dynamic quantization), so nothing needs calibrating.
+    // Networks opt in by running the layers MakeDecision() uses through Linear() and quantizing in
+    // PrepareQuantizedInference(); training keeps calling the layers directly and never sees the int8 weights.
+    //
+    // Only torch::nn::Linear is quantized. Recurrent layers such as LSTM and GRU are left in fp32, as is everything else,
+    // so a recurrent network only gains on the linear layers around its cells. The kernels are the fbgemm_* functions,
+    // which libtorch deprecates with a warning in favour of quantized::linear_dynamic. That op takes prepacked params
+    // declared only in ATen's internal quantized headers, so the fbgemm_* functions stay until those are public.
+    class QuantizedLinearLayers
+    {
+    public:
+        // Quantizes every linear layer under module. Returns false, with nothing quantized, if the CPU has no int8 kernels.
+        bool TryQuantize(torch::nn::Module& module)
+        {
+            Clear();
+
+            if (!torch::fbgemm_is_cpu_supported())
+            {
+                return false;
+            }
+
+            torch::NoGradGuard noGrad;
+            for (auto& child : module.modules())
+            {
+                auto linear = std::dynamic_pointer_cast<torch::nn::LinearImpl>(child);
+                if (linear == nullptr)
+                {
+                    continue;
+                }
+
+                QuantizedLinear quantized;
+                auto weight = linear->weight.detach().to(torch::kFloat32).contiguous();
+                std::tie(quantized.weight, quantized.columnOffsets, quantized.scale, quantized.zeroPoint) =
+                    torch::fbgemm_linear_quantize_weight(weight);
+                quantized.packedWeight = torch::fbgemm_pack_quantized_matrix(quantized.weight);
+                quantized.bias = linear->bias.defined()
+                    ? linear->bias.detach().to(torch::kFloat32).contiguous()
+                    : torch::zeros({ weight.size(0) }, torch::kFloat32);
+
+                _unpackedBytes += quantized.weight.nbytes() + quantized.columnOffsets.nbytes() + quantized.bias.nbytes();
+                _layers[linear.get()] = std::move(quantized);
+            }
+
+            return !_layers.empty();
+        }
+
+        void Clear()
+        {
+            _layers.clear();
+            _unpackedBytes = 0;
+        }
+
+        // Runs layer in int8 if it was quantized and int8 is enabled, otherwise with its fp32 weights
+        torch::Tensor Linear(const torch::nn::Linear& layer, const torch::Tensor& input) const
+        {
+            if (_isEnabled)
+            {
+                auto it = _layers.find(layer.get());
+                if (it != _layers.end())
+                {
+                    const QuantizedLinear& quantized = it->second;
+                    return torch::fbgemm_linear_int8_weight_fp32_activation(
+                        input.to(torch::kFloat32).contiguous(),
+                        quantized.weight,
+                        quantized.packedWeight,
+                        quantized.columnOffsets,
+                        quantized.scale,
+                        quantized.zeroPoint,
+                        quantized.bias);
+                }
+            }
+
+            return layer->forward(input);
+        }
+
+        void SetEnabled(bool isEnabled)
+        {
+            _isEnabled = isEnabled;
+        }
+
+        bool IsEnabled() const
+        {
+            return _isEnabled && !_layers.empty();
+        }
+
+        int TotalLayers() const
+        {
+            return (int)_layers.size();
+        }
+
+        // Bytes held by the int8 weights, column offsets and biases. The fbgemm-packed copy of each weight is opaque and
+        // isn't counted, and neither are the fp32 layers the int8 ones were made from.
+        uint64_t UnpackedBytes() const
+        {
+            return _unpackedBytes;
+        }
+
+    private:
+        struct QuantizedLinear
+        {
+            torch::Tensor weight;
+            torch::Tensor packedWeight;
+            torch::Tensor columnOffsets;
+            torch::Tensor bias;
+            double scale = 1;
+            int64_t zeroPoint = 0;
+        };
+
+        std::unordered_map<const torch::nn::LinearImpl*, QuantizedLinear> _layers;
+        uint64_t _unpackedBytes = 0;
+        bool _isEnabled = true;
+    };
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+namespace StrifeML
+{
+    // Lives in an actor process. Streams samples to the learner process and receives the networks it trains.
+    template<typename TNeuralNetwork>
+    struct RemoteTrainerClient
+    {
+        using InputType = typename TNeuralNetwork::InputType;
+        using OutputType = typename TNeuralNetwork::OutputType;
+        using SampleType = Sample<InputType, OutputType>;
+
+        RemoteTrainerClient(const std::string& channelName, int actorId, std::shared_ptr<NetworkContext<TNeuralNetwork>> networkContext_)
+            : channel(SharedMemoryTrainingChannel::Open(channelName, actorId)),
+              networkContext(networkContext_)
+        {
+
+        }
+
+        // Safe to call from any thread. Returns false if the sample was dropped because the learner has fallen behind.
+        bool TrySendSample(SampleType& sample);
+
+        // Hands the most recent network published by the learner, if any, to the network context. Cheap to call every frame.
+        bool TryReceiveNetwork();
+
+        std::unique_ptr<SharedMemoryTrainingChannel> channel;
+        std::shared_ptr<NetworkContext<TNeuralNetwork>> networkContext;
+        std::vector<unsigned char> sendBuffer;
+        std::vector<unsigned char> receiveBuffer;
+        SpinLock sendLock;
+        std::atomic<int> droppedSamples { 0 };
+    };
+
+    template<typename TNeuralNetwork>
+    struct PollRemoteActorsWorkItem;
+
+    // Lives in the learner process next to the trainer. Feeds the trainer with samples from every actor and publishes each
+    // newly trained network back to them.
+    template<typename TNeuralNetwork>
+    struct RemoteActorHost : std::enable_shared_from_this<RemoteActorHost<TNeuralNetwork>>
+    {
+        using InputType = typename TNeuralNetwork::InputType;
+        using OutputType = typename TNeuralNetwork::OutputType;
+        using SampleType = Sample<InputType, OutputType>;
+
+        RemoteActorHost(
+            std::shared_ptr<Trainer<TNeuralNetwork>> trainer_,
+            const std::string& channelName,
+            int actorCount,
+            const SharedMemoryChannelSettings& settings = SharedMemoryChannelSettings());
+
+        // Starts polling the actors for samples and subscribes to the trainer's published networks
+        void StartRunning(float pollsPerSecond = 60);
+
+        // Returns 0 without reading anything if another thread is already polling, since each channel's sample ring has a
+        // single reader and the receive buffers are shared
+        int ReceiveSamples();
+        void PublishNetwork(const std::string& serializedNetwork);
+
+        std::shared_ptr<Trainer<TNeuralNetwork>> trainer;
+        std::vector<std::unique_ptr<SharedMemoryTrainingChannel>> channels;
+        std::vector<unsigned char> receiveBuffer;
+        std::shared_ptr<ScheduledTask> pollTask;
+        SampleType receivedSample;
+        std::atomic<bool> isPolling { false };
+        std::atomic<int> skippedPublishes { 0 };
+
+        MetricCounter* skippedPublishesCounter;
+        MetricCounter* oversizedNetworksCounter;
+    };
+
+    template<typename TNeuralNetwork>
+    struct PollRemoteActorsWorkItem : IThreadPoolWorkItem
+    {
+        PollRemoteActorsWorkItem(std::shared_ptr<RemoteActorHost<TNeuralNetwork>> host_)
+            : host(host_)
+        {
+
+        }
+
+        void Execute() override
+        {
+            host->ReceiveSamples();
+        }
+
+        std::shared_ptr<RemoteActorHost<TNeuralNetwork>> host;
+    };
+
+    template<typename TNeuralNetwork>
+    bool RemoteTrainerClient<TNeuralNetwork>::TrySendSample(SampleType& sample)
+    {
+        sendLock.Lock();
+
+        sendBuffer.clear();
+        ObjectSerializer serializer(sendBuffer, false);
+        sample.input.Serialize(serializer);
+        sample.output.Serialize(serializer);
+
+        bool sent = channel->samples.TryWrite(sendBuffer.data(), (uint32_t)sendBuffer.size());
+        sendLock.Unlock();
+
+        if (!sent)
+        {
+            ++droppedSamples;
+        }
+
+        return sent;
+    }
+
+    template<typename TNeuralNetwork>
+    bool RemoteTrainerClient<TNeuralNetwork>::TryReceiveNetwork()
+    {
+        bool receivedNetwork = false;
+
+        // Only the newest network matters, so skip over any that queued up
+        while (channel->models.TryRead(receiveBuffer))
+        {
+            receivedNetwork = true;
+        }
+
+        if (receivedNetwork)
+        {
+            std::stringstream stream(std::string(receiveBuffer.begin(), receiveBuffer.end()));
+            networkContext->SetNewNetwork(stream);
+        }
+
+        return receivedNetwork;
+    }
+
+    template<typename TNeuralNetwork>
+    RemoteActorHost<TNeuralNetwork>::RemoteActorHost(
+        std::shared_ptr<Trainer<TNeuralNetwork>> trainer_,
+        const std::string& channelName,
+        int actorCount,
+        const SharedMemoryChannelSettings& settings)
+        : trainer(trainer_)
+    {
+        for (int i = 0; i < actorCount; ++i)
+        {
+            channels.push_back(SharedMemoryTrainingChannel::Create(channelName, i, settings));
+        }
+
+        auto metrics = MetricsRegistry::GetInstance();
+        auto labels = MetricLabel("channel", channelName);
+        skippedPublishesCounter = metrics->GetCounter("strifeml_remote_skipped_publishes_total", "Networks not sent to an actor because its model ring was full or too small", labels);
+        oversizedNetworksCounter = metrics->GetCounter("strifeml_remote_oversized_networks_total", "Networks larger than the model ring, which no actor can ever receive", labels);
+    }
+
+    template<typename TNeuralNetwork>
+    void RemoteActorHost<TNeuralNetwork>::StartRunning(float pollsPerSecond)
+    {
+        std::weak_ptr<RemoteActorHost> weakSelf = this->shared_from_this();
+        trainer->AddNetworkPublishedListener([=](const std::string& serializedNetwork)
+        {
+            if (auto self = weakSelf.lock())
+            {
+                self->PublishNetwork(serializedNetwork);
+            }
+        });
+
+        auto taskScheduler = TaskScheduler::GetInstance();
+        pollTask = std::make_shared<ScheduledTask>();
+        pollTask->workItem = std::make_shared<PollRemoteActorsWorkItem<TNeuralNetwork>>(this->shared_from_this());
+        pollTask->recurringTime = 1.0f / pollsPerSecond;
+        pollTask->runTime = 0;
+        taskScheduler->Start(pollTask);
+    }
+
+    template<typename TNeuralNetwork>
+    int RemoteActorHost<TNeuralNetwork>::ReceiveSamples()
+    {
+        // The poll task can start the next poll before the last one is done
+        if (isPolling.exchange(true, std::memory_order_acquire))
+        {
+            return 0;
+        }
+
+        int totalReceived = 0;
+        for (auto& channel : channels)
+        {
+            while (channel->samples.TryRead(receiveBuffer))
+            {
+                ObjectSerializer serializer(receiveBuffer, true);
+                receivedSample.input.Serialize(serializer);
+                receivedSample.output.Serialize(serializer);
+
+                if (!serializer.hadError)
+                {
+                    trainer->AddSample(receivedSample);
+                    ++totalReceived;
+                }
+            }
+        }
+
+        isPolling.store(false, std::memory_order_release);
+        return totalReceived;
+    }
+
+    template<typename TNeuralNetwork>
+    void RemoteActorHost<TNeuralNetwork>::PublishNetwork(const std::string& serializedNetwork)
+    {
+        auto data = reinterpret_cast<const unsigned char*>(serializedNetwork.data());
+        for (auto& channel : channels)
+        {
+            // The ring would throw on a message that can never fit, and no later network will fit either, so all that
+            // can be done is to count it where someone will see it. SharedMemoryChannelSettings sets the ring size.
+            if (sizeof(uint32_t) + (uint64_t)serializedNetwork.size() > channel->models.Capacity())
+            {
+                oversizedNetworksCounter->Add();
+                skippedPublishesCounter->Add();
+                ++skippedPublishes;
+                continue;
+            }
+
+            // A full ring means the actor hasn't read the networks already in it. It misses this one and gets a later
+            // publish once it has caught up.
+            if (!channel->models.TryWrite(data, (uint32_t)serializedNetwork.size()))
+            {
+                skippedPublishesCounter->Add();
+                ++skippedPublishes;
+            }
+        }
+    }
+}
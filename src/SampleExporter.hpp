@@ -0,0 +1,246 @@
+#pragma once
+
+namespace StrifeML
+{
+    struct SampleExporterSettings
+    {
+        std::string directory = ".";
+
+        // Shards are named <filePrefix>-<start time>-<shard number>.shard
+        std::string filePrefix = "samples";
+
+        // A new shard is started once the current one reaches this size
+        uint64_t maxShardBytes = 64 * 1024 * 1024;
+
+        // Samples waiting to be written. Anything added while the queue is full is dropped.
+        int maxQueuedSamples = 8192;
+
+        // Once the queue is more than this full, only one in keepOneInUnderPressure new samples is queued, so a slow disk
+        // thins the export out evenly instead of cutting off everything after some point
+        float pressureThreshold = 0.5f;
+        int keepOneInUnderPressure = 4;
+
+        // How long the writer sleeps when there's nothing to write
+        float idleSeconds = 0.005f;
+
+        SampleShardCompression compression = SampleShardCompression::ZeroRun;
+        uint32_t sampleVersion = 0;
+    };
+
+    // Streams the samples added to a sample set into size-bounded shards on disk, for offline analysis or training with
+    // OfflineTrainer. Samples arrive in batches from SampleSet::NotifyObservers(), and each batch is copied onto a
+    // lock-free queue in one piece; a background thread does the compression and disk I/O.
+    template<typename TSample>
+    class SampleExporter : public ISampleSetObserver<TSample>
+    {
+    public:
+        SampleExporter(const SampleExporterSettings& settings);
+        ~SampleExporter();
+
+        // Starts exporting the samples added to the set from now on. The set must outlive the exporter or Stop(). Like
+        // Stop(), this mustn't race with samples being added, so call it with the trainer's sample lock held.
+        void ExportFrom(SampleSet<TSample>* sampleSet);
+
+        // Called by the sample set. Never blocks.
+        void OnSamplesAdded(const SerializedSampleBatch& samples) override;
+
+        // Writes out whatever is still queued and closes the current shard
+        void Stop();
+
+        int64_t ExportedSamples() const { return _exportedSamples.load(std::memory_order_relaxed); }
+        int64_t DroppedSamples() const { return _droppedSamples.load(std::memory_order_relaxed); }
+        int64_t SampledOutSamples() const { return _sampledOutSamples.load(std::memory_order_relaxed); }
+        int ShardsWritten() const { return _shardsWritten.load(std::memory_order_relaxed); }
+
+    private:
+        void RunWriter();
+        void WriteSample(gsl::span<const unsigned char> serializedSample);
+        void OpenShard(gsl::span<const unsigned char> firstSample);
+
+        SampleExporterSettings _settings;
+        std::vector<SampleSet<TSample>*> _sampleSets;
+        MlUtil::StagingQueue<SerializedSampleBatch> _queue;
+        std::atomic<int> _queuedSamples { 0 };
+        std::atomic<uint32_t> _samplesUnderPressure { 0 };
+        std::atomic<bool> _isStopping { false };
+        std::thread _writerThread;
+
+        std::unique_ptr<SampleShardWriter> _shard;
+        std::string _runId;
+
+        std::atomic<int64_t> _exportedSamples { 0 };
+        std::atomic<int64_t> _droppedSamples { 0 };
+        std::atomic<int64_t> _sampledOutSamples { 0 };
+        std::atomic<int> _shardsWritten { 0 };
+
+        MetricCounter* _exportedCounter;
+        MetricCounter* _droppedCounter;
+        MetricCounter* _bytesCounter;
+        MetricGauge* _queuedGauge;
+    };
+
+    template<typename TSample>
+    SampleExporter<TSample>::SampleExporter(const SampleExporterSettings& settings)
+        : _settings(settings),
+          _runId(std::to_string(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count()))
+    {
+        auto metrics = MetricsRegistry::GetInstance();
+        auto labels = MetricLabel("exporter", settings.filePrefix);
+        _exportedCounter = metrics->GetCounter("strifeml_exporter_samples_total", "Samples written to shards", labels);
+        _droppedCounter = metrics->GetCounter("strifeml_exporter_dropped_samples_total", "Samples not exported because the writer fell behind", labels);
+        _bytesCounter = metrics->GetCounter("strifeml_exporter_bytes_total", "Bytes written to shards", labels);
+        _queuedGauge = metrics->GetGauge("strifeml_exporter_queued_samples", "Samples waiting to be written", labels);
+
+        _writerThread = std::thread([this] { RunWriter(); });
+    }
+
+    template<typename TSample>
+    SampleExporter<TSample>::~SampleExporter()
+    {
+        Stop();
+    }
+
+    template<typename TSample>
+    void SampleExporter<TSample>::ExportFrom(SampleSet<TSample>* sampleSet)
+    {
+        sampleSet->AddObserver(this);
+        _sampleSets.push_back(sampleSet);
+    }
+
+    template<typename TSample>
+    void SampleExporter<TSample>::OnSamplesAdded(const SerializedSampleBatch& samples)
+    {
+        SerializedSampleBatch keptSamples;
+        int queuedSamples = _queuedSamples.load(std::memory_order_relaxed);
+        for (int i = 0; i < samples.Count(); ++i)
+        {
+            if (queuedSamples >= _settings.maxQueuedSamples || _isStopping.load(std::memory_order_relaxed))
+            {
+                _droppedSamples.fetch_add(1, std::memory_order_relaxed);
+                _droppedCounter->Add();
+                continue;
+            }
+
+            if (queuedSamples > _settings.pressureThreshold * _settings.maxQueuedSamples
+                && _samplesUnderPressure.fetch_add(1, std::memory_order_relaxed) % std::max(1, _settings.keepOneInUnderPressure) != 0)
+            {
+                _sampledOutSamples.fetch_add(1, std::memory_order_relaxed);
+                _droppedCounter->Add();
+                continue;
+            }
+
+            keptSamples.Add(samples.SampleId(i), samples.Bytes(i));
+            ++queuedSamples;
+        }
+
+        if (keptSamples.Count() > 0)
+        {
+            _queuedSamples.fetch_add(keptSamples.Count(), std::memory_order_relaxed);
+            _queue.Push(std::move(keptSamples));
+        }
+    }
+
+    template<typename TSample>
+    void SampleExporter<TSample>::Stop()
+    {
+        for (auto sampleSet : _sampleSets)
+        {
+            sampleSet->RemoveObserver(this);
+        }
+
+        _sampleSets.clear();
+
+        if (_isStopping.exchange(true))
+        {
+            return;
+        }
+
+        _writerThread.join();
+    }
+
+    template<typename TSample>
+    void SampleExporter<TSample>::RunWriter()
+    {
+        auto writeQueued = [this]
+        {
+            int written = 0;
+            _queue.Drain([this, &written](const SerializedSampleBatch& samples)
+            {
+                for (int i = 0; i < samples.Count(); ++i)
+                {
+                    try
+                    {
+                        WriteSample(samples.Bytes(i));
+                    }
+                    catch (const StrifeException&)
+                    {
+                        // Most likely the disk is full. Count the sample as dropped and try again with a fresh shard.
+                        _shard = nullptr;
+                        _droppedSamples.fetch_add(1, std::memory_order_relaxed);
+                        _droppedCounter->Add();
+                    }
+                }
+
+                written += samples.Count();
+            });
+
+            _queuedGauge->Set(_queuedSamples.fetch_sub(written, std::memory_order_relaxed) - written);
+            return written;
+        };
+
+        while (!_isStopping.load(std::memory_order_acquire))
+        {
+            if (writeQueued() == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::duration<float>(_settings.idleSeconds));
+            }
+        }
+
+        writeQueued();
+        _shard = nullptr;
+    }
+
+    template<typename TSample>
+    void SampleExporter<TSample>::WriteSample(gsl::span<const unsigned char> serializedSample)
+    {
+        if (_shard != nullptr && _shard->BytesWritten() >= _settings.maxShardBytes)
+        {
+            _shard = nullptr;
+        }
+
+        if (_shard == nullptr)
+        {
+            OpenShard(serializedSample);
+        }
+
+        uint64_t bytesBefore = _shard->BytesWritten();
+        _shard->Write(serializedSample.data(), (uint32_t)serializedSample.size());
+
+        _exportedSamples.fetch_add(1, std::memory_order_relaxed);
+        _exportedCounter->Add();
+        _bytesCounter->Add((int64_t)(_shard->BytesWritten() - bytesBefore));
+    }
+
+    template<typename TSample>
+    void SampleExporter<TSample>::OpenShard(gsl::span<const unsigned char> firstSample)
+    {
+        // The schema comes from running a sample back through the serializer with a schema attached
+        TSample sample;
+        std::vector<unsigned char> bytes(firstSample.begin(), firstSample.end());
+        ObjectSerializer reader(bytes, true);
+        sample.input.Serialize(reader);
+        sample.output.Serialize(reader);
+
+        ObjectSerializerSchema schema;
+        std::vector<unsigned char> schemaBytes;
+        ObjectSerializer schemaWriter(schemaBytes, false, &schema);
+        sample.input.Serialize(schemaWriter);
+        sample.output.Serialize(schemaWriter);
+
+        char shardNumber[16];
+        snprintf(shardNumber, sizeof(shardNumber), "%06d", _shardsWritten.fetch_add(1, std::memory_order_relaxed));
+        auto path = _settings.directory + "/" + _settings.filePrefix + "-" + _runId + "-" + shardNumber + ".shard";
+
+        _shard = std::make_unique<SampleShardWriter>(path, _settings.sampleVersion, _settings.compression, FormatSampleShardSchema(schema));
+    }
+}
@@ -6,32 +6,167 @@ namespace StrifeML
     template<typename TSample>
     class SampleSet;
 
+    enum class SampleEvictionPolicy
+    {
+        // Nothing is evicted. New samples are turned away once the set is full.
+        None,
+
+        // The oldest samples are evicted first
+        Fifo,
+
+        // Keeps a uniformly random selection of every sample ever added, old and new alike, whether the set's maxBytes or
+        // the repository's budget is what fills it. Like Priority, this evicts samples one at a time from anywhere in the
+        // set, which breaks up sequences, so it's meant for sequence length 1.
+        Reservoir,
+
+        // The samples with the lowest priority are evicted first
+        Priority
+    };
+
+    template<typename TSample>
+    struct SampleSetOptions
+    {
+        SampleCodecSettings codec;
+
+        // The most bytes the set may store. 0 leaves it limited by the repository's budget alone.
+        uint64_t maxBytes = 0;
+
+        SampleEvictionPolicy eviction = SampleEvictionPolicy::Fifo;
+
+        // Required for SampleEvictionPolicy::Priority
+        std::function<float(const TSample& sample)> priority;
+    };
+
+    struct SampleSetUsage
+    {
+        std::string name;
+        int liveSamples = 0;
+        int64_t samplesAdded = 0;
+        int64_t samplesEvicted = 0;
+        int64_t samplesRejected = 0;
+        uint64_t bytes = 0;
+        uint64_t uncompressedBytes = 0;
+        uint64_t maxBytes = 0;
+    };
+
+    // Numbers sample repositories in the order they're created, for their sets' metric labels
+    inline int NextSampleRepositoryId()
+    {
+        static std::atomic<int> nextId { 0 };
+        return nextId.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Lets a set tell whoever enforces a memory budget across several sets that it has grown
+    struct ISampleSetBudget
+    {
+        virtual ~ISampleSetBudget() = default;
+
+        virtual void EnforceBudget() = 0;
+    };
+
+    // Serialized samples packed end to end, so handing a run of them around doesn't take an allocation per sample
+    struct SerializedSampleBatch
+    {
+        void Add(int sampleId, gsl::span<const unsigned char> serializedSample)
+        {
+            bytes.insert(bytes.end(), serializedSample.begin(), serializedSample.end());
+            samples.emplace_back(sampleId, bytes.size());
+        }
+
+        void Clear()
+        {
+            bytes.clear();
+            samples.clear();
+        }
+
+        // Drops every sample after the first count
+        void Truncate(int count)
+        {
+            bytes.resize(count == 0 ? 0 : samples[count - 1].second);
+            samples.resize(count);
+        }
+
+        int Count() const { return (int)samples.size(); }
+        int SampleId(int index) const { return samples[index].first; }
+
+        gsl::span<const unsigned char> Bytes(int index) const
+        {
+            size_t start = index == 0 ? 0 : samples[index - 1].second;
+            return gsl::span<const unsigned char>(bytes.data() + start, samples[index].second - start);
+        }
+
+        std::vector<unsigned char> bytes;
+
+        // Each sample's id and where its bytes end
+        std::vector<std::pair<int, size_t>> samples;
+    };
+
+    template<typename TSample>
+    struct ISampleSetObserver
+    {
+        virtual ~ISampleSetObserver() = default;
+
+        // Called by SampleSet::NotifyObservers() with the bytes the set stored for each sample added since the last call, in
+        // the order they were added. The batch is reused once this returns.
+        virtual void OnSamplesAdded(const SerializedSampleBatch& samples) = 0;
+    };
+
     template<typename TSample>
     struct IGroupedSampleView
     {
         virtual ~IGroupedSampleView() = default;
 
         virtual void AddSample(const TSample& sample, int sampleId) = 0;
+        virtual void RemoveEvictedSamples() = 0;
     };
 
     template<typename TSample, typename TSelector>
     class GroupedSampleView : public IGroupedSampleView<TSample>
     {
     public:
-        GroupedSampleView(SampleSet<TSample>* owner)
-            : _owner(owner)
+        struct IndexRecord
+        {
+            TSelector key;
+            int sampleId;
+        };
+
+        GroupedSampleView(SampleSet<TSample>* owner, MappedAppendFile* index)
+            : _owner(owner),
+              _index(index)
         {
 
         }
 
+        // Also indexes any samples the set already has, either from the persisted index or by running the selector on them
         GroupedSampleView* GroupBy(std::function<TSelector(const TSample& sample)> selector)
         {
             _selector = selector;
+            RestoreIndex();
             return this;
         }
 
+        // Sequences that run into an evicted sample are skipped
         bool TryPickRandomSequence(gsl::span <TSample> outSamples);
 
+        // The same, but the sequence is added to builder as a row and only deserialized when the batch is built, once per
+        // distinct sample
+        bool TryPickRandomSequence(int length, SequenceBatchBuilder<TSample>& builder);
+
+        // Adds up to count sequences to builder for a whole batch and returns how many were added. The groups that can be
+        // picked from are only worked out once, and every row's group is drawn up front with one bulk draw.
+        int TryPickRandomSequences(int length, int count, SequenceBatchBuilder<TSample>& builder);
+
+        void RemoveEvictedSamples() override
+        {
+            for (auto& groupPair : _samplesBySelectorType)
+            {
+                auto& group = groupPair.second;
+                group.erase(
+                    std::remove_if(group.begin(), group.end(), [this](int sampleId) { return !_owner->HasSample(sampleId); }),
+                    group.end());
+            }
+        }
+
         void AddSample(const TSample& sample, int sampleId) override
         {
             if (_selector == nullptr)
@@ -39,47 +174,126 @@ namespace StrifeML
                 return;
             }
 
-            _samplesBySelectorType[_selector(sample)].push_back(sampleId);
+            IndexRecord record { _selector(sample), sampleId };
+            _samplesBySelectorType[record.key].push_back(sampleId);
+            _indexedSampleCount = sampleId + 1;
+
+            if (_index != nullptr)
+            {
+                _index->Append(&record, sizeof(record));
+            }
         }
 
     private:
+        void RestoreIndex();
+        bool TryFindValidGroups(int minSampleId);
+        bool TryPickValidSequenceEnd(int length, int& outEndSampleId);
+        bool TryPickValidSequenceEnd(int length, int firstGroupSelector, int& outEndSampleId);
+        bool TryPickRandomSequenceEnd(int groupSelector, int minSampleId, int& outEndSampleId);
+        bool HasSequence(int endSampleId, int length) const;
+
         SampleSet<TSample>* _owner;
+        MappedAppendFile* _index;
+        int _indexedSampleCount = 0;
         std::function<TSelector(const TSample& sample)> _selector;
         std::unordered_map <TSelector, std::vector<int>> _samplesBySelectorType;
         std::vector<const std::vector<int>*> _validSampleGroups;
+        std::vector<int> _groupSelectors;
     };
 
     template<typename TSample>
     class SampleSet
     {
     public:
-        SampleSet(RandomNumberGenerator& rng)
-            : _rng(rng)
+        SampleSet(
+            const std::string& name,
+            const RandomNumberGenerator& rng,
+            std::unique_ptr<ISampleStorage> storage = nullptr,
+            const SampleSetOptions<TSample>& options = SampleSetOptions<TSample>(),
+            ISampleSetBudget* budget = nullptr,
+            int repositoryId = -1)
+            : _name(name),
+              _storage(storage != nullptr ? std::move(storage) : std::make_unique<MemorySampleStorage>()),
+              _options(options),
+              _budget(budget),
+              _rng(rng)
         {
+            if (_options.eviction == SampleEvictionPolicy::Priority && _options.priority == nullptr)
+            {
+                throw StrifeException("Sample set %s evicts by priority but has no priority function", name.c_str());
+            }
 
+            // Persistent storage is append-only, so all it can do when it's full is turn samples away
+            if (!_storage->CanEvict())
+            {
+                _options.eviction = SampleEvictionPolicy::None;
+            }
+
+            auto metrics = MetricsRegistry::GetInstance();
+            // Sets in different repositories, such as those of two trainers, can have the same name
+            auto labels = MetricLabel("set", name);
+            if (repositoryId >= 0)
+            {
+                labels += "," + MetricLabel("repository", std::to_string(repositoryId));
+            }
+
+            _sampleCountGauge = metrics->GetGauge("strifeml_sample_set_samples", "Samples stored in a sample set", labels);
+            _sampleBytesGauge = metrics->GetGauge("strifeml_sample_set_bytes", "Serialized bytes stored in a sample set", labels);
+            _uncompressedBytesGauge = metrics->GetGauge("strifeml_sample_set_uncompressed_bytes", "Serialized bytes stored in a sample set before compression", labels);
+            _sampleCountGauge->Set(_storage->SampleCount());
+            _sampleBytesGauge->Set((int64_t)_storage->TotalBytes());
+            _uncompressedBytesGauge->Set((int64_t)_storage->UncompressedBytes());
+            _evictedCounter = metrics->GetCounter("strifeml_sample_set_evicted_total", "Samples evicted from a sample set to stay within its memory budget", labels);
+            _rejectedCounter = metrics->GetCounter("strifeml_sample_set_rejected_total", "Samples a full sample set didn't store", labels);
         }
 
         bool TryGetSampleById(int sampleId, TSample& outSample)
         {
-            if (sampleId < 0 || sampleId >= _serializedSamples.size())
+            if (!_storage->HasSample(sampleId))
             {
                 return false;
             }
 
-            auto& serializedSample = _serializedSamples[sampleId];
-            ObjectSerializer serializer(serializedSample.bytes, true);
+            return TryDeserializeSample(_storage->GetSample(sampleId), outSample);
+        }
+
+        // Appends the bytes stored for a sample to outSamples without deserializing it, so a caller holding a lock to read
+        // the set can leave the deserializing until after it's released
+        bool TryCopySerializedSample(int sampleId, SerializedSampleBatch& outSamples)
+        {
+            if (!_storage->HasSample(sampleId))
+            {
+                return false;
+            }
+
+            outSamples.Add(sampleId, _storage->GetSample(sampleId));
+            return true;
+        }
+
+        static bool TryDeserializeSample(std::vector<unsigned char>& bytes, TSample& outSample)
+        {
+            ObjectSerializer serializer(bytes, true);
             outSample.input.Serialize(serializer);
             outSample.output.Serialize(serializer);
 
             return !serializer.hadError;
         }
 
+        // Returns the id of the sample, or -1 if the set is full and its eviction policy turned the sample away
         int AddSample(const TSample& sample)
         {
-            _serializedSamples.emplace_back();
-            int sampleId = _serializedSamples.size() - 1;
-            auto& serializedObject = _serializedSamples[sampleId];
-            ObjectSerializer serializer(serializedObject.bytes, false);
+            ++_samplesAdded;
+            _hasTestedAddingSample = false;
+            _isAddingSampleRejected = false;
+            if (!ShouldStoreSample())
+            {
+                ++_samplesRejected;
+                _rejectedCounter->Add();
+                return -1;
+            }
+
+            _writeBuffer.clear();
+            ObjectSerializer serializer(_writeBuffer, false);
 
             // This is safe because the serializer is in reading mode
             auto& mutableSample = const_cast<TSample&>(sample);
@@ -87,38 +301,486 @@ namespace StrifeML
             mutableSample.input.Serialize(serializer);
             mutableSample.output.Serialize(serializer);
 
+            int sampleId = _storage->AddSample(_writeBuffer);
+            _addingSampleId = sampleId;
+
+            if (_options.eviction == SampleEvictionPolicy::Priority)
+            {
+                _samplesByPriority.push({ _options.priority(sample), sampleId });
+            }
+
             for (auto& group : _groupedSamplesViews)
             {
                 group->AddSample(sample, sampleId);
             }
 
-            return sampleId;
+            if (!_observers.empty())
+            {
+                _pendingNotificationsLock.Lock();
+                _pendingNotifications.Add(sampleId, _writeBuffer);
+                _pendingNotificationsLock.Unlock();
+            }
+
+            while (_options.maxBytes != 0 && _storage->TotalBytes() > _options.maxBytes && TryEvictSample())
+            {
+
+            }
+
+            if (_budget != nullptr)
+            {
+                _budget->EnforceBudget();
+            }
+
+            _addingSampleId = -1;
+            UpdateGauges();
+            return _isAddingSampleRejected ? -1 : sampleId;
+        }
+
+        // Evicts one sample according to the set's policy. Returns false if there's nothing the policy allows evicting. The
+        // sample being added is never evicted to make room for itself, though a Reservoir set may turn it away instead.
+        bool TryEvictSample()
+        {
+            if (_storage->LiveSampleCount() <= 1)
+            {
+                return false;
+            }
+
+            int sampleId = -1;
+            switch (_options.eviction)
+            {
+            case SampleEvictionPolicy::None:
+                return false;
+
+            case SampleEvictionPolicy::Fifo:
+                sampleId = _storage->FirstSampleId();
+                break;
+
+            case SampleEvictionPolicy::Reservoir:
+                // Evicting while a sample is being added means the set is full, so the sample gets the admission test it
+                // would have had if the set had been full before it arrived. Without it, evictions by the repository's
+                // budget would always keep the new sample and favour recent ones.
+                if (_addingSampleId >= 0 && !_hasTestedAddingSample)
+                {
+                    _hasTestedAddingSample = true;
+                    if (!PassesReservoirTest(_storage->LiveSampleCount() - 1))
+                    {
+                        RejectAddingSample();
+                        return true;
+                    }
+                }
+
+                sampleId = PickRandomLiveSample();
+                break;
+
+            case SampleEvictionPolicy::Priority:
+            {
+                bool skippedAddingSample = false;
+                std::pair<float, int> addingSample;
+                while (!_samplesByPriority.empty()
+                    && (!_storage->HasSample(_samplesByPriority.top().second) || _samplesByPriority.top().second == _addingSampleId))
+                {
+                    if (_samplesByPriority.top().second == _addingSampleId)
+                    {
+                        addingSample = _samplesByPriority.top();
+                        skippedAddingSample = true;
+                    }
+
+                    _samplesByPriority.pop();
+                }
+
+                if (!_samplesByPriority.empty())
+                {
+                    sampleId = _samplesByPriority.top().second;
+                    _samplesByPriority.pop();
+                }
+
+                if (skippedAddingSample)
+                {
+                    _samplesByPriority.push(addingSample);
+                }
+
+                if (sampleId == -1)
+                {
+                    return false;
+                }
+
+                break;
+            }
+            }
+
+            _storage->EvictSample(sampleId);
+            ++_samplesEvicted;
+            _evictedCounter->Add();
+
+            // Views skip evicted samples on their own, so only clean them out once they make up a good part of the views
+            if (++_evictedSinceViewCleanup > _storage->LiveSampleCount())
+            {
+                for (auto& group : _groupedSamplesViews)
+                {
+                    group->RemoveEvictedSamples();
+                }
+
+                _evictedSinceViewCleanup = 0;
+            }
+
+            UpdateGauges();
+            return true;
+        }
+
+        bool HasSample(int sampleId) const
+        {
+            return _storage->HasSample(sampleId);
+        }
+
+        bool CanEvict() const
+        {
+            return _options.eviction != SampleEvictionPolicy::None;
+        }
+
+        const SampleSetOptions<TSample>& Options() const
+        {
+            return _options;
+        }
+
+        SampleSetUsage Usage() const
+        {
+            SampleSetUsage usage;
+            usage.name = _name;
+            usage.liveSamples = _storage->LiveSampleCount();
+            usage.samplesAdded = _samplesAdded;
+            usage.samplesEvicted = _samplesEvicted;
+            usage.samplesRejected = _samplesRejected;
+            usage.bytes = _storage->TotalBytes();
+            usage.uncompressedBytes = _storage->UncompressedBytes();
+            usage.maxBytes = _options.maxBytes;
+            return usage;
+        }
+
+        // Like adding samples, these must be called with the lock that samples are added under held
+        void AddObserver(ISampleSetObserver<TSample>* observer)
+        {
+            std::lock_guard<std::mutex> lock(_observerMutex);
+            _observers.push_back(observer);
+        }
+
+        // Waits for a NotifyObservers() that's already running, so the observer can be destroyed once this returns
+        void RemoveObserver(ISampleSetObserver<TSample>* observer)
+        {
+            std::lock_guard<std::mutex> lock(_observerMutex);
+            _observers.erase(std::remove(_observers.begin(), _observers.end(), observer), _observers.end());
+        }
+
+        // AddSample() only copies each sample's bytes into a buffer for the observers. This hands them over, and is meant to
+        // be called once the lock that samples are added under has been released, so a slow observer doesn't hold up adding
+        // samples or building batches. Samples still reach the observers in the order they were added.
+        void NotifyObservers()
+        {
+            std::lock_guard<std::mutex> lock(_observerMutex);
+
+            // The buffers are swapped rather than copied, so both keep their capacity from one call to the next
+            _pendingNotificationsLock.Lock();
+            std::swap(_pendingNotifications, _notifyingSamples);
+            _pendingNotificationsLock.Unlock();
+
+            if (_notifyingSamples.Count() == 0)
+            {
+                return;
+            }
+
+            for (auto observer : _observers)
+            {
+                observer->OnSamplesAdded(_notifyingSamples);
+            }
+
+            _notifyingSamples.Clear();
         }
 
+        // A persistent set finds the view's index again after a restart by viewName. Without one, views are told apart by
+        // their selector type and how many views with that type were created before them, so name views if a set has
+        // several with the same selector type that aren't always created in the same order.
         template<typename TSelector>
-        GroupedSampleView<TSample, TSelector>* CreateGroupedView()
+        GroupedSampleView<TSample, TSelector>* CreateGroupedView(const std::string& viewName = "")
         {
-            auto group = std::make_unique<GroupedSampleView<TSample, TSelector>>(this);
+            // Only plain data selectors can be written straight to disk; anything else is regrouped when the set is opened
+            MappedAppendFile* index = nullptr;
+            if constexpr (std::is_trivially_copyable_v<TSelector>)
+            {
+                using IndexRecord = typename GroupedSampleView<TSample, TSelector>::IndexRecord;
+
+                std::string viewKey = viewName;
+                if (viewKey.empty())
+                {
+                    std::string selectorType = typeid(TSelector).name();
+                    viewKey = selectorType + "#" + std::to_string(_unnamedViewsBySelectorType[selectorType]++);
+                }
+
+                index = _storage->GetGroupIndex(viewKey, sizeof(IndexRecord));
+            }
+
+            auto group = std::make_unique<GroupedSampleView<TSample, TSelector>>(this, index);
             auto ptr = group.get();
             _groupedSamplesViews.emplace_back(std::move(group));
             return ptr;
         }
 
-        RandomNumberGenerator& GetRandomNumberGenerator() const
+        // One more than the id of the newest sample
+        int SampleCount() const
+        {
+            return _storage->SampleCount();
+        }
+
+        int LiveSampleCount() const
+        {
+            return _storage->LiveSampleCount();
+        }
+
+        uint64_t TotalBytes() const
+        {
+            return _storage->TotalBytes();
+        }
+
+        uint64_t UncompressedBytes() const
+        {
+            return _storage->UncompressedBytes();
+        }
+
+        // Pushes everything written so far to disk for persistent sets. The OS does this on its own eventually, even if
+        // the process crashes, so this only matters if the machine might go down.
+        void Flush()
+        {
+            _storage->Flush();
+        }
+
+        const std::string& Name() const
+        {
+            return _name;
+        }
+
+        RandomNumberGenerator& GetRandomNumberGenerator()
         {
             return _rng;
         }
 
     private:
-        std::vector <SerializedObject> _serializedSamples;
+        bool ShouldStoreSample()
+        {
+            if (_options.eviction == SampleEvictionPolicy::Reservoir && _options.maxBytes != 0 && _storage->TotalBytes() >= _options.maxBytes)
+            {
+                _hasTestedAddingSample = true;
+                return PassesReservoirTest(_storage->LiveSampleCount());
+            }
+
+            if (_options.eviction == SampleEvictionPolicy::None && _options.maxBytes != 0)
+            {
+                return _storage->TotalBytes() < _options.maxBytes;
+            }
+
+            return true;
+        }
+
+        // Once full, the nth sample replaces a random one with probability capacity / n, which keeps every sample seen
+        // equally likely to be in the set
+        bool PassesReservoirTest(int capacity)
+        {
+            return _rng.RandInt(0, (int)std::min<int64_t>(_samplesAdded - 1, INT32_MAX)) < capacity;
+        }
+
+        // Takes back the sample being added after it was stored, as if ShouldStoreSample() had turned it away
+        void RejectAddingSample()
+        {
+            _storage->EvictSample(_addingSampleId);
+            _isAddingSampleRejected = true;
+            ++_samplesRejected;
+            _rejectedCounter->Add();
+
+            // Views already have it and skip it like any evicted sample, but observers haven't been told yet
+            _pendingNotificationsLock.Lock();
+            if (_pendingNotifications.Count() > 0 && _pendingNotifications.SampleId(_pendingNotifications.Count() - 1) == _addingSampleId)
+            {
+                _pendingNotifications.Truncate(_pendingNotifications.Count() - 1);
+            }
+
+            _pendingNotificationsLock.Unlock();
+            ++_evictedSinceViewCleanup;
+            UpdateGauges();
+        }
+
+        int PickRandomLiveSample()
+        {
+            int firstSampleId = _storage->FirstSampleId();
+            int sampleCount = _storage->SampleCount();
+            int sampleId = _rng.RandInt(firstSampleId, sampleCount - 1);
+
+            // Evicted samples leave holes, so fall back to the next live sample after the one picked
+            for (int attempt = 0; attempt < 8 && (!_storage->HasSample(sampleId) || sampleId == _addingSampleId); ++attempt)
+            {
+                sampleId = _rng.RandInt(firstSampleId, sampleCount - 1);
+            }
+
+            while (!_storage->HasSample(sampleId) || sampleId == _addingSampleId)
+            {
+                sampleId = sampleId + 1 < sampleCount ? sampleId + 1 : firstSampleId;
+            }
+
+            return sampleId;
+        }
+
+        void UpdateGauges()
+        {
+            _sampleCountGauge->Set(_storage->LiveSampleCount());
+            _sampleBytesGauge->Set((int64_t)_storage->TotalBytes());
+            _uncompressedBytesGauge->Set((int64_t)_storage->UncompressedBytes());
+        }
+
+        std::string _name;
+        MetricGauge* _sampleCountGauge;
+        MetricGauge* _sampleBytesGauge;
+        MetricGauge* _uncompressedBytesGauge;
+        MetricCounter* _evictedCounter;
+        MetricCounter* _rejectedCounter;
+        std::unique_ptr<ISampleStorage> _storage;
+        SampleSetOptions<TSample> _options;
+        ISampleSetBudget* _budget;
+        int64_t _samplesAdded = 0;
+        int64_t _samplesEvicted = 0;
+        int64_t _samplesRejected = 0;
+        int _evictedSinceViewCleanup = 0;
+        int _addingSampleId = -1;
+        bool _hasTestedAddingSample = false;
+        bool _isAddingSampleRejected = false;
+        std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int>>, std::greater<>> _samplesByPriority;
+        std::vector<unsigned char> _writeBuffer;
         std::vector <std::unique_ptr<IGroupedSampleView<TSample>>> _groupedSamplesViews;
-        RandomNumberGenerator& _rng;
+        std::map<std::string, int> _unnamedViewsBySelectorType;
+        std::vector<ISampleSetObserver<TSample>*> _observers;
+        std::mutex _observerMutex;
+        SpinLock _pendingNotificationsLock;
+        SerializedSampleBatch _pendingNotifications;
+        SerializedSampleBatch _notifyingSamples;
+        RandomNumberGenerator _rng;
     };
 
+    template<typename TSample, typename TSelector>
+    void GroupedSampleView<TSample, TSelector>::RestoreIndex()
+    {
+        int sampleCount = _owner->SampleCount();
+
+        if (_index != nullptr)
+        {
+            // Records are written after their sample, so there can't be any for samples that were lost, but be safe
+            auto records = reinterpret_cast<const IndexRecord*>(_index->Payload());
+            int recordCount = (int)_index->RecordCount();
+            int validRecordCount = 0;
+
+            while (validRecordCount < recordCount && records[validRecordCount].sampleId < sampleCount)
+            {
+                const auto& record = records[validRecordCount++];
+                _samplesBySelectorType[record.key].push_back(record.sampleId);
+                _indexedSampleCount = record.sampleId + 1;
+            }
+
+            // The index only says which view it belongs to, not which selector wrote it. If the newest indexed sample no
+            // longer groups the way its record says, the selector has changed, so the index is rebuilt from the samples.
+            TSample newestSample;
+            if (validRecordCount > 0)
+            {
+                const auto& newestRecord = records[validRecordCount - 1];
+                if (_owner->TryGetSampleById(newestRecord.sampleId, newestSample) && !(_selector(newestSample) == newestRecord.key))
+                {
+                    _samplesBySelectorType.clear();
+                    _indexedSampleCount = 0;
+                    validRecordCount = 0;
+                }
+            }
+
+            _index->Truncate((uint64_t)validRecordCount * sizeof(IndexRecord));
+        }
+
+        // Samples added before this view existed, or whose index record didn't make it to disk
+        TSample sample;
+        for (int sampleId = _indexedSampleCount; sampleId < sampleCount; ++sampleId)
+        {
+            if (_owner->TryGetSampleById(sampleId, sample))
+            {
+                AddSample(sample, sampleId);
+            }
+        }
+
+        _indexedSampleCount = sampleCount;
+    }
+
     template<typename TSample, typename TSelector>
     bool GroupedSampleView<TSample, TSelector>::TryPickRandomSequence(gsl::span <TSample> outSamples)
     {
-        int minSampleId = outSamples.size() - 1;
+        int endSampleId;
+        if (!TryPickValidSequenceEnd(outSamples.size(), endSampleId))
+        {
+            return false;
+        }
+
+        for (int i = 0; i < outSamples.size(); ++i)
+        {
+            int sampleId = endSampleId - (outSamples.size() - 1 - i);
+            bool gotSample = _owner->TryGetSampleById(sampleId, outSamples[i]);
+            assert(gotSample);
+        }
+
+        return true;
+    }
+
+    template<typename TSample, typename TSelector>
+    bool GroupedSampleView<TSample, TSelector>::TryPickRandomSequence(int length, SequenceBatchBuilder<TSample>& builder)
+    {
+        int endSampleId;
+        if (!TryPickValidSequenceEnd(length, endSampleId))
+        {
+            return false;
+        }
+
+        builder.AddSequence(_owner, endSampleId);
+        return true;
+    }
+
+    template<typename TSample, typename TSelector>
+    int GroupedSampleView<TSample, TSelector>::TryPickRandomSequences(int length, int count, SequenceBatchBuilder<TSample>& builder)
+    {
+        if (count <= 0 || !TryFindValidGroups(length - 1))
+        {
+            return 0;
+        }
+
+        _groupSelectors.resize(count);
+        _owner->GetRandomNumberGenerator().RandInts(0, (int)_validSampleGroups.size() - 1, _groupSelectors);
+
+        int added = 0;
+        for (int groupSelector : _groupSelectors)
+        {
+            int endSampleId;
+            if (TryPickValidSequenceEnd(length, groupSelector, endSampleId))
+            {
+                builder.AddSequence(_owner, endSampleId);
+                ++added;
+            }
+        }
+
+        return added;
+    }
+
+    template<typename TSample, typename TSelector>
+    bool GroupedSampleView<TSample, TSelector>::TryPickValidSequenceEnd(int length, int& outEndSampleId)
+    {
+        if (!TryFindValidGroups(length - 1))
+        {
+            return false;
+        }
+
+        int groupSelector = _owner->GetRandomNumberGenerator().RandInt(0, (int)_validSampleGroups.size() - 1);
+        return TryPickValidSequenceEnd(length, groupSelector, outEndSampleId);
+    }
+
+    template<typename TSample, typename TSelector>
+    bool GroupedSampleView<TSample, TSelector>::TryFindValidGroups(int minSampleId)
+    {
         _validSampleGroups.clear();
 
         for (const auto& groupPair : _samplesBySelectorType)
@@ -138,17 +800,41 @@ namespace StrifeML
             _validSampleGroups.push_back(&group);
         }
 
-        if (_validSampleGroups.empty())
+        return !_validSampleGroups.empty();
+    }
+
+    // Takes the valid groups from the last TryFindValidGroups(), and the group to try first
+    template<typename TSample, typename TSelector>
+    bool GroupedSampleView<TSample, TSelector>::TryPickValidSequenceEnd(int length, int firstGroupSelector, int& outEndSampleId)
+    {
+        // Evicted samples aren't removed from the groups right away, so a sequence may run into one. Give up after a few
+        // tries rather than scanning, the next batch will have another go.
+        const int maxAttempts = 8;
+        int minSampleId = length - 1;
+        int endSampleId = -1;
+
+        for (int attempt = 0; attempt < maxAttempts && endSampleId == -1; ++attempt)
         {
-            return false;
+            int groupSelector = attempt == 0
+                ? firstGroupSelector
+                : _owner->GetRandomNumberGenerator().RandInt(0, (int)_validSampleGroups.size() - 1);
+
+            if (TryPickRandomSequenceEnd(groupSelector, minSampleId, endSampleId) && !HasSequence(endSampleId, length))
+            {
+                endSampleId = -1;
+            }
         }
 
+        outEndSampleId = endSampleId;
+        return endSampleId != -1;
+    }
+
+    template<typename TSample, typename TSelector>
+    bool GroupedSampleView<TSample, TSelector>::TryPickRandomSequenceEnd(int groupSelector, int minSampleId, int& outEndSampleId)
+    {
         auto& rng = _owner->GetRandomNumberGenerator();
-        int randomSelector = rng.RandInt(0, _validSampleGroups.size() - 1);
-        auto& groupToSampleFrom = *_validSampleGroups[randomSelector];
+        auto& groupToSampleFrom = *_validSampleGroups[groupSelector];
         int groupIndexStart = 0;
-        int endSampleId = 0;
-        bool found = false;
 
         while (groupIndexStart < groupToSampleFrom.size())
         {
@@ -159,44 +845,178 @@ namespace StrifeML
             }
             else
             {
-                endSampleId = groupIndex;
-                found = true;
-                break;
+                outEndSampleId = groupToSampleFrom[groupIndex];
+                return true;
             }
         }
 
         // Should be impossible because we checked to make sure the list had at least one sample id big enough
-        assert(found);
+        assert(false);
+        return false;
+    }
 
-        for (int i = 0; i < outSamples.size(); ++i)
+    template<typename TSample, typename TSelector>
+    bool GroupedSampleView<TSample, TSelector>::HasSequence(int endSampleId, int length) const
+    {
+        for (int sampleId = endSampleId - length + 1; sampleId <= endSampleId; ++sampleId)
         {
-            int sampleId = endSampleId - (outSamples.size() - 1 - i);
-            bool gotSample = _owner->TryGetSampleById(sampleId, outSamples[i]);
-            assert(gotSample);
+            if (!_owner->HasSample(sampleId))
+            {
+                return false;
+            }
         }
 
         return true;
     }
 
+    // Owns a trainer's sample sets and keeps them within an optional memory budget. Like the sets themselves, it's meant
+    // to be used from one thread at a time, which the trainer's sample lock takes care of.
     template<typename TSample>
-    class SampleRepository
+    class SampleRepository : public ISampleSetBudget
     {
     public:
         SampleRepository(RandomNumberGenerator& rng)
-            : _rng(rng)
+            : _rng(rng),
+              _repositoryId(NextSampleRepositoryId())
         {
 
         }
 
-        SampleSet<TSample>* CreateSampleSet(const char* name)
+        // Returns the existing set if there already is one with this name, in which case the options are ignored
+        SampleSet<TSample>* CreateSampleSet(const char* name, const SampleSetOptions<TSample>& options = SampleSetOptions<TSample>())
         {
-            // TODO check for duplicate
-            _sequencesByName[name] = std::make_unique<SampleSet<TSample>>(_rng);
-            return _sequencesByName[name].get();
+            if (auto sampleSet = GetSampleSet(name))
+            {
+                return sampleSet;
+            }
+
+            return AddSampleSet(name, std::make_unique<MemorySampleStorage>(), options);
+        }
+
+        // Like CreateSampleSet, but the samples and grouped view indexes are kept in memory-mapped files in directory,
+        // so whatever was collected before a restart is available again immediately. Persistent sets can't evict, so once
+        // they reach maxBytes new samples are turned away.
+        SampleSet<TSample>* CreatePersistentSampleSet(
+            const char* name,
+            const std::string& directory,
+            uint32_t sampleVersion = 0,
+            const SampleSetOptions<TSample>& options = SampleSetOptions<TSample>())
+        {
+            if (auto sampleSet = GetSampleSet(name))
+            {
+                return sampleSet;
+            }
+
+            // Compressed and uncompressed records can't be told apart, so switching the codec must discard the set
+            uint32_t storageVersion = options.codec.isEnabled ? sampleVersion | 0x80000000u : sampleVersion;
+            return AddSampleSet(name, std::make_unique<MappedSampleStorage>(directory, name, storageVersion), options);
+        }
+
+        SampleSet<TSample>* GetSampleSet(const std::string& name)
+        {
+            auto it = _sequencesByName.find(name);
+            return it != _sequencesByName.end() ? it->second.get() : nullptr;
+        }
+
+        // The most bytes all of the sets together may store, 0 for no limit. When a set grows past it, samples are evicted
+        // from whichever set is furthest over its share: its maxBytes if it has one, otherwise an even split of the budget.
+        void SetMemoryBudget(uint64_t maxBytes)
+        {
+            _maxBytes = maxBytes;
+            EnforceBudget();
+        }
+
+        uint64_t TotalBytes() const
+        {
+            uint64_t totalBytes = 0;
+            for (const auto& sampleSet : _sampleSets)
+            {
+                totalBytes += sampleSet->TotalBytes();
+            }
+
+            return totalBytes;
+        }
+
+        const std::vector<SampleSet<TSample>*>& SampleSets() const
+        {
+            return _sampleSets;
+        }
+
+        std::vector<SampleSetUsage> Usage() const
+        {
+            std::vector<SampleSetUsage> usage;
+            for (const auto& sampleSet : _sampleSets)
+            {
+                usage.push_back(sampleSet->Usage());
+            }
+
+            return usage;
+        }
+
+        void EnforceBudget() override
+        {
+            if (_maxBytes == 0)
+            {
+                return;
+            }
+
+            uint64_t totalBytes = TotalBytes();
+            uint64_t evenShare = _maxBytes / std::max<size_t>(1, _sampleSets.size());
+
+            while (totalBytes > _maxBytes)
+            {
+                SampleSet<TSample>* mostOverShare = nullptr;
+                double mostOverShareRatio = 0;
+
+                for (auto sampleSet : _sampleSets)
+                {
+                    if (!sampleSet->CanEvict() || sampleSet->LiveSampleCount() <= 1)
+                    {
+                        continue;
+                    }
+
+                    uint64_t share = sampleSet->Options().maxBytes != 0 ? std::min(sampleSet->Options().maxBytes, evenShare) : evenShare;
+                    double ratio = (double)sampleSet->TotalBytes() / std::max<uint64_t>(1, share);
+                    if (ratio > mostOverShareRatio)
+                    {
+                        mostOverShare = sampleSet;
+                        mostOverShareRatio = ratio;
+                    }
+                }
+
+                uint64_t bytesBefore = mostOverShare != nullptr ? mostOverShare->TotalBytes() : 0;
+                if (mostOverShare == nullptr || !mostOverShare->TryEvictSample())
+                {
+                    return;
+                }
+
+                // An eviction can leave a compressed set slightly bigger than before, so this mustn't assume it shrank
+                totalBytes = totalBytes - bytesBefore + mostOverShare->TotalBytes();
+            }
         }
 
     private:
+        SampleSet<TSample>* AddSampleSet(const char* name, std::unique_ptr<ISampleStorage> storage, const SampleSetOptions<TSample>& options)
+        {
+            if (options.codec.isEnabled)
+            {
+                storage = std::make_unique<CompressedSampleStorage>(std::move(storage), options.codec);
+            }
+
+            // Each set draws from its own stream so that sampling from one doesn't perturb the others
+            auto sampleSet = std::make_unique<SampleSet<TSample>>(name, _rng.CreateStream(++_nextStreamId), std::move(storage), options, this, _repositoryId);
+            auto ptr = sampleSet.get();
+            _sequencesByName[name] = std::move(sampleSet);
+            _sampleSets.push_back(ptr);
+
+            return ptr;
+        }
+
         std::unordered_map <std::string, std::unique_ptr<SampleSet<TSample>>> _sequencesByName;
+        std::vector<SampleSet<TSample>*> _sampleSets;
         RandomNumberGenerator& _rng;
+        uint64_t _nextStreamId = 0;
+        int _repositoryId;
+        uint64_t _maxBytes = 0;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,340 @@
+#include "StrifeML.hpp"
+
+namespace StrifeML
+{
+    static bool TryReadHeader(FILE* file, SampleShardHeader& outHeader)
+    {
+        if (fread(&outHeader, SampleShardHeader::Version1Size, 1, file) != 1 || outHeader.magic != SampleShardHeader::Magic)
+        {
+            return false;
+        }
+
+        if (outHeader.version < 2)
+        {
+            outHeader.compression = SampleShardCompression::None;
+            outHeader.schemaBytes = 0;
+            outHeader.indexOffset = 0;
+            return true;
+        }
+
+        auto rest = reinterpret_cast<unsigned char*>(&outHeader) + SampleShardHeader::Version1Size;
+        return fread(rest, sizeof(SampleShardHeader) - SampleShardHeader::Version1Size, 1, file) == 1;
+    }
+
+    SampleShardInfo ReadSampleShardInfo(const std::string& path)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == nullptr)
+        {
+            throw StrifeException("Failed to open sample shard %s", path.c_str());
+        }
+
+        SampleShardInfo info;
+        if (!TryReadHeader(file, info.header))
+        {
+            fclose(file);
+            throw StrifeException("%s is not a sample shard", path.c_str());
+        }
+
+        info.schema.resize(info.header.schemaBytes);
+        bool successful = fread(&info.schema[0], 1, info.schema.size(), file) == info.schema.size();
+
+        if (successful && info.header.indexOffset != 0)
+        {
+            info.sampleOffsets.resize(info.header.sampleCount);
+            successful = fseek(file, (long)info.header.indexOffset, SEEK_SET) == 0
+                && fread(info.sampleOffsets.data(), sizeof(uint64_t), info.sampleOffsets.size(), file) == info.sampleOffsets.size();
+        }
+
+        fclose(file);
+
+        if (!successful)
+        {
+            throw StrifeException("Sample shard %s is truncated", path.c_str());
+        }
+
+        return info;
+    }
+
+    std::string FormatSampleShardSchema(const ObjectSerializerSchema& schema)
+    {
+        std::vector<std::pair<std::string, ObjectSerializerProperty>> properties(schema.propertiesByName.begin(), schema.propertiesByName.end());
+        std::sort(properties.begin(), properties.end(), [](const auto& lhs, const auto& rhs)
+        {
+            return lhs.second.offset < rhs.second.offset;
+        });
+
+        std::string text;
+        for (const auto& property : properties)
+        {
+            text += property.first + " " + property.second.type + " " + std::to_string(property.second.offset) + "\n";
+        }
+
+        return text;
+    }
+
+    SampleShardWriter::SampleShardWriter(const std::string& path, uint32_t sampleVersion, SampleShardCompression compression, const std::string& schema)
+        : _path(path),
+          _file(fopen(path.c_str(), "wb"))
+    {
+        if (_file == nullptr)
+        {
+            throw StrifeException("Failed to create sample shard %s", path.c_str());
+        }
+
+        _header.sampleVersion = sampleVersion;
+        _header.compression = compression;
+        _header.schemaBytes = schema.size();
+        fwrite(&_header, sizeof(_header), 1, _file);
+        fwrite(schema.data(), 1, schema.size(), _file);
+        _bytesWritten = sizeof(_header) + schema.size();
+    }
+
+    SampleShardWriter::~SampleShardWriter()
+    {
+        Close();
+    }
+
+    void SampleShardWriter::Write(const unsigned char* data, uint32_t size)
+    {
+        if (_file == nullptr)
+        {
+            throw StrifeException("Sample shard %s has already been closed", _path.c_str());
+        }
+
+        if (_header.compression == SampleShardCompression::ZeroRun)
+        {
+            _compressedBytes.clear();
+            ZeroRunEncode(data, size, _compressedBytes);
+            data = _compressedBytes.data();
+            size = (uint32_t)_compressedBytes.size();
+        }
+
+        if (fwrite(&size, sizeof(size), 1, _file) != 1 || fwrite(data, 1, size, _file) != size)
+        {
+            throw StrifeException("Failed to write to sample shard %s", _path.c_str());
+        }
+
+        _sampleOffsets.push_back(_bytesWritten);
+        ++_header.sampleCount;
+        _bytesWritten += sizeof(size) + size;
+    }
+
+    void SampleShardWriter::Close()
+    {
+        if (_file == nullptr)
+        {
+            return;
+        }
+
+        _header.indexOffset = _bytesWritten;
+        fwrite(_sampleOffsets.data(), sizeof(uint64_t), _sampleOffsets.size(), _file);
+        _bytesWritten += _sampleOffsets.size() * sizeof(uint64_t);
+
+        fseek(_file, 0, SEEK_SET);
+        fwrite(&_header, sizeof(_header), 1, _file);
+        fclose(_file);
+        _file = nullptr;
+    }
+
+    SampleShardReader::SampleShardReader(const std::vector<std::string>& paths, uint32_t sampleVersion, const SampleShardReaderSettings& settings)
+        : _paths(paths),
+          _sampleVersion(sampleVersion),
+          _settings(settings)
+    {
+        _thread = std::thread([this] { ReadShards(); });
+    }
+
+    SampleShardReader::~SampleShardReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _isStopping = true;
+        }
+
+        _blockRemoved.notify_all();
+        _thread.join();
+    }
+
+    bool SampleShardReader::TryReadNext(gsl::span<const unsigned char>& outRecord, int& outShardIndex)
+    {
+        while (_currentRecord >= (int)_currentBlock.recordEnds.size())
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _blockAdded.wait(lock, [this] { return !_blocks.empty() || _isDone; });
+
+            if (_blocks.empty())
+            {
+                if (!_error.empty())
+                {
+                    throw StrifeException(_error);
+                }
+
+                return false;
+            }
+
+            _currentBlock = std::move(_blocks.front());
+            _blocks.pop_front();
+            _currentRecord = 0;
+
+            lock.unlock();
+            _blockRemoved.notify_one();
+        }
+
+        uint32_t start = _currentRecord == 0 ? 0 : _currentBlock.recordEnds[_currentRecord - 1];
+        uint32_t end = _currentBlock.recordEnds[_currentRecord++];
+
+        outRecord = gsl::span<const unsigned char>(_currentBlock.bytes.data() + start, end - start);
+        outShardIndex = _currentBlock.shardIndex;
+        return true;
+    }
+
+    bool SampleShardReader::TryPushBlock(Block& block)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _blockRemoved.wait(lock, [this] { return _blocks.size() < (size_t)_settings.readAheadBlocks || _isStopping; });
+
+        if (_isStopping)
+        {
+            return false;
+        }
+
+        _blocks.push_back(std::move(block));
+        lock.unlock();
+        _blockAdded.notify_one();
+
+        block = Block();
+        return true;
+    }
+
+    void SampleShardReader::ReadShards()
+    {
+        try
+        {
+            for (int i = 0; i < (int)_paths.size(); ++i)
+            {
+                ReadShard(i);
+            }
+        }
+        catch (const StrifeException& e)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _error = e.what();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _isDone = true;
+        }
+
+        _blockAdded.notify_all();
+    }
+
+    void SampleShardReader::ReadShard(int shardIndex)
+    {
+        const auto& path = _paths[shardIndex];
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == nullptr)
+        {
+            throw StrifeException("Failed to open sample shard %s", path.c_str());
+        }
+
+        // The file is read front to back, so let stdio pull it in big sequential reads
+        std::vector<char> fileBuffer(_settings.blockBytes);
+        setvbuf(file, fileBuffer.data(), _IOFBF, fileBuffer.size());
+
+        SampleShardHeader header;
+        if (!TryReadHeader(file, header))
+        {
+            fclose(file);
+            throw StrifeException("%s is not a sample shard", path.c_str());
+        }
+
+        if (header.version > SampleShardHeader::CurrentVersion || header.sampleVersion != _sampleVersion)
+        {
+            fclose(file);
+            throw StrifeException(
+                "Sample shard %s has version %d/%d, expected at most %d/%d",
+                path.c_str(),
+                (int)header.version,
+                (int)header.sampleVersion,
+                (int)SampleShardHeader::CurrentVersion,
+                (int)_sampleVersion);
+        }
+
+        // Readers only need the schema to interpret samples they don't have the type for
+        fseek(file, (long)header.schemaBytes, SEEK_CUR);
+
+        uint64_t position = (header.version < 2 ? SampleShardHeader::Version1Size : sizeof(SampleShardHeader)) + header.schemaBytes;
+        Block block;
+        block.shardIndex = shardIndex;
+
+        while (TryReadRecord(file, header, position, block))
+        {
+            if (block.bytes.size() >= (size_t)_settings.blockBytes)
+            {
+                if (!TryPushBlock(block))
+                {
+                    fclose(file);
+                    return;
+                }
+
+                block.shardIndex = shardIndex;
+            }
+        }
+
+        fclose(file);
+
+        if (!block.recordEnds.empty())
+        {
+            TryPushBlock(block);
+        }
+    }
+
+    bool SampleShardReader::TryReadRecord(FILE* file, const SampleShardHeader& header, uint64_t& position, Block& block)
+    {
+        // The samples end where the index starts, or with a record cut short by a writer that never finished
+        if (header.indexOffset != 0 && position >= header.indexOffset)
+        {
+            return false;
+        }
+
+        uint32_t size;
+        if (fread(&size, sizeof(size), 1, file) != 1)
+        {
+            return false;
+        }
+
+        if (header.compression == SampleShardCompression::ZeroRun)
+        {
+            _compressedRecord.resize(size);
+            if (fread(_compressedRecord.data(), 1, size, file) != size)
+            {
+                return false;
+            }
+
+            size_t start = block.bytes.size();
+            if (!ZeroRunDecode(_compressedRecord.data(), size, block.bytes))
+            {
+                block.bytes.resize(start);
+                return false;
+            }
+        }
+        else
+        {
+            size_t start = block.bytes.size();
+            block.bytes.resize(start + size);
+            if (fread(block.bytes.data() + start, 1, size, file) != size)
+            {
+                block.bytes.resize(start);
+                return false;
+            }
+        }
+
+        block.recordEnds.push_back((uint32_t)block.bytes.size());
+        position += sizeof(size) + size;
+        _bytesRead.fetch_add(sizeof(size) + size, std::memory_order_relaxed);
+
+        return true;
+    }
+}
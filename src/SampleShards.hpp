@@ -0,0 +1,148 @@
+#pragma once
+
+namespace StrifeML
+{
+    enum class SampleShardCompression : uint32_t
+    {
+        None,
+        ZeroRun
+    };
+
+    // A sample shard is a file of samples serialized by ObjectSerializer (the sample's input followed by its output), laid
+    // out as:
+    //
+    //   SampleShardHeader
+    //   the schema: one "name type offset" line per property, schemaBytes long           (version 2)
+    //   the samples in the order they were recorded, each one a uint32_t size then the possibly compressed bytes
+    //   the index: the file offset of each sample as a uint64_t, starting at indexOffset   (version 2)
+    //
+    // Version 1 shards stop after the sample count and have neither schema nor index.
+    struct SampleShardHeader
+    {
+        static constexpr uint32_t Magic = 0x53534D53;
+        static constexpr uint32_t CurrentVersion = 2;
+        static constexpr size_t Version1Size = 24;
+
+        uint32_t magic = Magic;
+        uint32_t version = CurrentVersion;
+        uint32_t sampleVersion = 0;
+        SampleShardCompression compression = SampleShardCompression::None;
+
+        // This and the index are filled in when the shard is closed. Zero means the writer never finished, but every
+        // complete record is still readable.
+        uint64_t sampleCount = 0;
+
+        uint64_t schemaBytes = 0;
+        uint64_t indexOffset = 0;
+    };
+
+    // What's known about a shard without reading its samples
+    struct SampleShardInfo
+    {
+        SampleShardHeader header;
+        std::string schema;
+        std::vector<uint64_t> sampleOffsets;
+    };
+
+    SampleShardInfo ReadSampleShardInfo(const std::string& path);
+
+    // Turns a schema collected by serializing a sample into the text stored in a shard
+    std::string FormatSampleShardSchema(const ObjectSerializerSchema& schema);
+
+    class SampleShardWriter
+    {
+    public:
+        // Bump sampleVersion whenever the sample's serialized layout changes so that old shards are rejected
+        SampleShardWriter(
+            const std::string& path,
+            uint32_t sampleVersion,
+            SampleShardCompression compression = SampleShardCompression::None,
+            const std::string& schema = "");
+        ~SampleShardWriter();
+
+        void Write(const unsigned char* data, uint32_t size);
+
+        template<typename TSample>
+        void WriteSample(const TSample& sample)
+        {
+            _sampleBytes.clear();
+            ObjectSerializer serializer(_sampleBytes, false);
+
+            // This is safe because the serializer is in writing mode
+            auto& mutableSample = const_cast<TSample&>(sample);
+            mutableSample.input.Serialize(serializer);
+            mutableSample.output.Serialize(serializer);
+
+            Write(_sampleBytes.data(), (uint32_t)_sampleBytes.size());
+        }
+
+        void Close();
+
+        uint64_t SampleCount() const { return _header.sampleCount; }
+        uint64_t BytesWritten() const { return _bytesWritten; }
+
+    private:
+        std::string _path;
+        FILE* _file;
+        SampleShardHeader _header;
+        uint64_t _bytesWritten = 0;
+        std::vector<unsigned char> _sampleBytes;
+        std::vector<unsigned char> _compressedBytes;
+        std::vector<uint64_t> _sampleOffsets;
+    };
+
+    struct SampleShardReaderSettings
+    {
+        // Records are handed from the read-ahead thread to the reader in blocks of about this size
+        int blockBytes = 1024 * 1024;
+
+        // Blocks the read-ahead thread may get ahead of the reader, which bounds the reader's memory use
+        int readAheadBlocks = 16;
+    };
+
+    // Reads the records of a list of shards in order. A background thread reads the files sequentially and splits them
+    // into records ahead of time, so the disk is kept busy while the caller deserializes and trains.
+    class SampleShardReader
+    {
+    public:
+        SampleShardReader(const std::vector<std::string>& paths, uint32_t sampleVersion, const SampleShardReaderSettings& settings = SampleShardReaderSettings());
+        ~SampleShardReader();
+
+        // Returns false once every shard has been read. The record is only valid until the next call. Throws if a shard
+        // couldn't be read.
+        bool TryReadNext(gsl::span<const unsigned char>& outRecord, int& outShardIndex);
+
+        uint64_t BytesRead() const { return _bytesRead.load(std::memory_order_relaxed); }
+
+    private:
+        struct Block
+        {
+            int shardIndex = 0;
+            std::vector<unsigned char> bytes;
+            std::vector<uint32_t> recordEnds;
+        };
+
+        void ReadShards();
+        void ReadShard(int shardIndex);
+        bool TryReadRecord(FILE* file, const SampleShardHeader& header, uint64_t& position, Block& block);
+        bool TryPushBlock(Block& block);
+
+        std::vector<std::string> _paths;
+        uint32_t _sampleVersion;
+        SampleShardReaderSettings _settings;
+
+        std::mutex _mutex;
+        std::condition_variable _blockAdded;
+        std::condition_variable _blockRemoved;
+        std::deque<Block> _blocks;
+        bool _isDone = false;
+        bool _isStopping = false;
+        std::string _error;
+        std::atomic<uint64_t> _bytesRead { 0 };
+
+        std::vector<unsigned char> _compressedRecord;
+        Block _currentBlock;
+        int _currentRecord = 0;
+        std::thread _thread;
+    };
+}
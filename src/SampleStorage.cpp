@@ -0,0 +1,287 @@
+#include "StrifeML.hpp"
+
+namespace StrifeML
+{
+    MappedSampleStorage::MappedSampleStorage(const std::string& directory, const std::string& name, uint32_t sampleVersion)
+        : _pathPrefix(directory + "/" + name),
+          _sampleVersion(sampleVersion)
+    {
+        _samples = std::make_unique<MappedAppendFile>(_pathPrefix + ".samples", sampleVersion, 0);
+        _offsets = std::make_unique<MappedAppendFile>(_pathPrefix + ".offsets", sampleVersion, sizeof(uint64_t), _samples->WasReset());
+
+        // The offsets are only useful together with the samples they point into
+        if (_offsets->WasReset() && !_samples->WasReset())
+        {
+            _samples = std::make_unique<MappedAppendFile>(_pathPrefix + ".samples", sampleVersion, 0, true);
+        }
+
+        _wasReset = _samples->WasReset();
+
+        // A sample is written before its offset, so a crash in between leaves bytes that no offset points to
+        uint64_t committedSampleBytes = 0;
+        if (_offsets->RecordCount() > 0)
+        {
+            memcpy(&committedSampleBytes, _offsets->Payload() + (_offsets->RecordCount() - 1) * sizeof(uint64_t), sizeof(uint64_t));
+        }
+
+        if (committedSampleBytes > _samples->PayloadSize())
+        {
+            throw StrifeException("Sample set %s is corrupt: its offsets point past the end of its samples", _pathPrefix.c_str());
+        }
+
+        _samples->Truncate(committedSampleBytes);
+    }
+
+    int MappedSampleStorage::SampleCount() const
+    {
+        return (int)_offsets->RecordCount();
+    }
+
+    uint64_t MappedSampleStorage::TotalBytes() const
+    {
+        return _samples->PayloadSize();
+    }
+
+    int MappedSampleStorage::AddSample(const std::vector<unsigned char>& bytes)
+    {
+        _samples->Append(bytes.data(), bytes.size());
+
+        uint64_t endOffset = _samples->PayloadSize();
+        _offsets->Append(&endOffset, sizeof(endOffset));
+
+        return SampleCount() - 1;
+    }
+
+    std::vector<unsigned char>& MappedSampleStorage::GetSample(int sampleId)
+    {
+        uint64_t startOffset = 0;
+        uint64_t endOffset;
+        auto offsets = _offsets->Payload();
+
+        if (sampleId > 0)
+        {
+            memcpy(&startOffset, offsets + (sampleId - 1) * sizeof(uint64_t), sizeof(uint64_t));
+        }
+
+        memcpy(&endOffset, offsets + sampleId * sizeof(uint64_t), sizeof(uint64_t));
+
+        _readBuffer.assign(_samples->Payload() + startOffset, _samples->Payload() + endOffset);
+        return _readBuffer;
+    }
+
+    MappedAppendFile* MappedSampleStorage::GetGroupIndex(const std::string& viewKey, uint32_t recordSize)
+    {
+        auto& index = _groupIndexes[viewKey];
+        if (index == nullptr)
+        {
+            // The key can be anything, so the file is named after its hash. A view whose key changed gets a file of its
+            // own and rebuilds, rather than reading another view's index.
+            uint64_t keyHash = 0xCBF29CE484222325ull;
+            for (char c : viewKey)
+            {
+                keyHash = (keyHash ^ (unsigned char)c) * 0x100000001B3ull;
+            }
+
+            char keyHashText[17];
+            snprintf(keyHashText, sizeof(keyHashText), "%016llx", (unsigned long long)keyHash);
+
+            auto path = _pathPrefix + ".view-" + keyHashText + ".index";
+            index = std::make_unique<MappedAppendFile>(path, _sampleVersion, recordSize, _wasReset);
+        }
+
+        return index.get();
+    }
+
+    void MappedSampleStorage::Flush()
+    {
+        _samples->Flush();
+        _offsets->Flush();
+
+        for (auto& indexPair : _groupIndexes)
+        {
+            indexPair.second->Flush();
+        }
+    }
+
+    static void XorBytes(const unsigned char* lhs, const unsigned char* rhs, size_t size, std::vector<unsigned char>& outResult)
+    {
+        outResult.resize(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            outResult[i] = lhs[i] ^ rhs[i];
+        }
+    }
+
+    CompressedSampleStorage::CompressedSampleStorage(std::unique_ptr<ISampleStorage> storage, const SampleCodecSettings& settings)
+        : _storage(std::move(storage)),
+          _settings(settings)
+    {
+        _settings.keyframeInterval = std::max(1, _settings.keyframeInterval);
+    }
+
+    void CompressedSampleStorage::Encode(RecordType type, const std::vector<unsigned char>& bytes, const unsigned char* delta)
+    {
+        uint32_t size = (uint32_t)bytes.size();
+        _encodeBuffer.resize(RecordHeaderSize);
+        _encodeBuffer[0] = type;
+        memcpy(_encodeBuffer.data() + 1, &size, sizeof(size));
+
+        ZeroRunEncode(delta != nullptr ? delta : bytes.data(), bytes.size(), _encodeBuffer);
+    }
+
+    int CompressedSampleStorage::AddSample(const std::vector<unsigned char>& bytes)
+    {
+        int sampleId = _storage->SampleCount();
+
+        // Samples can only be deltas of the one right before them, which isn't around after a persistent set is reopened
+        bool isKeyframe = sampleId % _settings.keyframeInterval == 0
+            || _lastAddedSampleId != sampleId - 1
+            || _lastAddedSample.size() != bytes.size();
+
+        if (isKeyframe)
+        {
+            Encode(Keyframe, bytes, nullptr);
+        }
+        else
+        {
+            XorBytes(bytes.data(), _lastAddedSample.data(), bytes.size(), _deltaBuffer);
+            Encode(Delta, bytes, _deltaBuffer.data());
+        }
+
+        _storage->AddSample(_encodeBuffer);
+        _lastAddedSample = bytes;
+        _lastAddedSampleId = sampleId;
+        _uncompressedBytes += bytes.size();
+
+        return sampleId;
+    }
+
+    std::vector<unsigned char>& CompressedSampleStorage::GetSample(int sampleId)
+    {
+        if (sampleId == _decodedSampleId)
+        {
+            return _decodedSample;
+        }
+
+        // Walk back to the keyframe the sample is built on, or to the cached sample if it's on the way
+        int startId = sampleId;
+        while (PreviousLiveSampleId(startId) != _decodedSampleId && _storage->GetSample(startId)[0] != Keyframe)
+        {
+            startId = PreviousLiveSampleId(startId);
+        }
+
+        for (int id = startId; id <= sampleId; id = NextLiveSampleId(id))
+        {
+            Decode(id, _decodedSample, _decodeBuffer);
+            std::swap(_decodedSample, _decodeBuffer);
+            _decodedSampleId = id;
+        }
+
+        return _decodedSample;
+    }
+
+    void CompressedSampleStorage::EvictSample(int sampleId)
+    {
+        if (!_storage->HasSample(sampleId))
+        {
+            return;
+        }
+
+        // The next sample can't be a delta of one that's gone. If the evicted sample was a delta itself, the two deltas XORed
+        // together are the next sample's delta against the sample before the evicted one, which is usually as small as
+        // either of them. Only the sample after a keyframe has to become a keyframe.
+        int nextSampleId = NextLiveSampleId(sampleId);
+        if (nextSampleId < _storage->SampleCount() && _storage->GetSample(nextSampleId)[0] == Delta)
+        {
+            if (_storage->GetSample(sampleId)[0] == Delta)
+            {
+                DecodeRecord(sampleId, _deltaBuffer);
+                DecodeRecord(nextSampleId, _decodeBuffer);
+                for (size_t i = 0; i < _decodeBuffer.size(); ++i)
+                {
+                    _decodeBuffer[i] ^= _deltaBuffer[i];
+                }
+
+                Encode(Delta, _decodeBuffer, _decodeBuffer.data());
+            }
+            else
+            {
+                auto nextSample = GetSample(nextSampleId);
+                Encode(Keyframe, nextSample, nullptr);
+            }
+
+            _storage->ReplaceSample(nextSampleId, _encodeBuffer);
+        }
+
+        uint32_t size;
+        memcpy(&size, _storage->GetSample(sampleId).data() + 1, sizeof(size));
+        _uncompressedBytes -= size;
+        _storage->EvictSample(sampleId);
+
+        if (sampleId == _lastAddedSampleId)
+        {
+            _lastAddedSampleId = -1;
+        }
+
+        if (sampleId == _decodedSampleId)
+        {
+            _decodedSampleId = -1;
+        }
+    }
+
+    int CompressedSampleStorage::PreviousLiveSampleId(int sampleId) const
+    {
+        for (int id = sampleId - 1; id >= _storage->FirstSampleId(); --id)
+        {
+            if (_storage->HasSample(id))
+            {
+                return id;
+            }
+        }
+
+        return -1;
+    }
+
+    int CompressedSampleStorage::NextLiveSampleId(int sampleId) const
+    {
+        int sampleCount = _storage->SampleCount();
+        for (int id = sampleId + 1; id < sampleCount; ++id)
+        {
+            if (_storage->HasSample(id))
+            {
+                return id;
+            }
+        }
+
+        return sampleCount;
+    }
+
+    bool CompressedSampleStorage::DecodeRecord(int sampleId, std::vector<unsigned char>& outBytes)
+    {
+        auto& record = _storage->GetSample(sampleId);
+
+        outBytes.clear();
+        if (record.size() < RecordHeaderSize || !ZeroRunDecode(record.data() + RecordHeaderSize, record.size() - RecordHeaderSize, outBytes))
+        {
+            throw StrifeException("Compressed sample %d is corrupt", sampleId);
+        }
+
+        return record[0] == Delta;
+    }
+
+    void CompressedSampleStorage::Decode(int sampleId, std::vector<unsigned char>& previousSample, std::vector<unsigned char>& outSample)
+    {
+        if (DecodeRecord(sampleId, outSample))
+        {
+            if (previousSample.size() != outSample.size())
+            {
+                throw StrifeException("Compressed sample %d doesn't match the sample before it", sampleId);
+            }
+
+            for (size_t i = 0; i < outSample.size(); ++i)
+            {
+                outSample[i] ^= previousSample[i];
+            }
+        }
+    }
+}
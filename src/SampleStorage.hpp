@@ -0,0 +1,234 @@
+#pragma once
+
+namespace StrifeML
+{
+    // Where a SampleSet keeps its serialized samples
+    struct ISampleStorage
+    {
+        virtual ~ISampleStorage() = default;
+
+        // One more than the id of the newest sample. Ids are never reused, even once samples are evicted.
+        virtual int SampleCount() const = 0;
+        virtual uint64_t TotalBytes() const = 0;
+
+        virtual int LiveSampleCount() const { return SampleCount(); }
+
+        // The oldest sample that hasn't been evicted
+        virtual int FirstSampleId() const { return 0; }
+        virtual bool HasSample(int sampleId) const { return sampleId >= 0 && sampleId < SampleCount(); }
+
+        // Storages that can give memory back. An evicted sample can't be read again.
+        virtual bool CanEvict() const { return false; }
+        virtual void EvictSample(int sampleId) { throw StrifeException("This sample storage can't evict samples"); }
+
+        // Lets a wrapper re-encode a sample it has already stored
+        virtual void ReplaceSample(int sampleId, const std::vector<unsigned char>& bytes) { throw StrifeException("This sample storage can't replace samples"); }
+
+        // What TotalBytes() would be without compression. Storages that only learn this as samples are added count the
+        // samples added since they were opened.
+        virtual uint64_t UncompressedBytes() const { return TotalBytes(); }
+
+        virtual int AddSample(const std::vector<unsigned char>& bytes) = 0;
+
+        // The returned bytes are only valid until the next call
+        virtual std::vector<unsigned char>& GetSample(int sampleId) = 0;
+
+        // Returns the file a grouped view should persist its index to, or null if views should rebuild their indexes
+        // from the samples instead. viewKey identifies the view across restarts.
+        virtual MappedAppendFile* GetGroupIndex(const std::string& viewKey, uint32_t recordSize) { return nullptr; }
+
+        virtual void Flush() { }
+    };
+
+    class MemorySampleStorage : public ISampleStorage
+    {
+    public:
+        int SampleCount() const override
+        {
+            return _firstSampleId + (int)_samples.size();
+        }
+
+        uint64_t TotalBytes() const override
+        {
+            return _totalBytes;
+        }
+
+        int LiveSampleCount() const override
+        {
+            return _liveSampleCount;
+        }
+
+        int FirstSampleId() const override
+        {
+            return _firstSampleId;
+        }
+
+        bool HasSample(int sampleId) const override
+        {
+            return sampleId >= _firstSampleId && sampleId < SampleCount() && _samples[sampleId - _firstSampleId].isLive;
+        }
+
+        int AddSample(const std::vector<unsigned char>& bytes) override
+        {
+            _samples.emplace_back();
+            _samples.back().serializedObject.bytes = bytes;
+            _samples.back().isLive = true;
+            _totalBytes += bytes.size();
+            ++_liveSampleCount;
+
+            return SampleCount() - 1;
+        }
+
+        std::vector<unsigned char>& GetSample(int sampleId) override
+        {
+            return _samples[sampleId - _firstSampleId].serializedObject.bytes;
+        }
+
+        bool CanEvict() const override
+        {
+            return true;
+        }
+
+        void EvictSample(int sampleId) override
+        {
+            if (!HasSample(sampleId))
+            {
+                return;
+            }
+
+            auto& sample = _samples[sampleId - _firstSampleId];
+            _totalBytes -= sample.serializedObject.bytes.size();
+            std::vector<unsigned char>().swap(sample.serializedObject.bytes);
+            sample.isLive = false;
+            --_liveSampleCount;
+
+            // Evicting oldest first, which is the common case, leaves nothing behind
+            while (!_samples.empty() && !_samples.front().isLive)
+            {
+                _samples.pop_front();
+                ++_firstSampleId;
+            }
+        }
+
+        void ReplaceSample(int sampleId, const std::vector<unsigned char>& bytes) override
+        {
+            auto& sample = _samples[sampleId - _firstSampleId];
+            _totalBytes += bytes.size();
+            _totalBytes -= sample.serializedObject.bytes.size();
+            sample.serializedObject.bytes = bytes;
+        }
+
+    private:
+        struct StoredSample
+        {
+            SerializedObject serializedObject;
+            bool isLive;
+        };
+
+        std::deque<StoredSample> _samples;
+        int _firstSampleId = 0;
+        int _liveSampleCount = 0;
+        uint64_t _totalBytes = 0;
+    };
+
+    struct SampleCodecSettings
+    {
+        bool isEnabled = false;
+
+        // Every Nth sample is stored on its own instead of as a delta against the sample before it. Bigger saves more
+        // memory, but reading a random sample has to decode up to N - 1 deltas to get to it.
+        int keyframeInterval = 8;
+    };
+
+    // Compresses the samples of another storage. Consecutive samples are usually nearly identical, so each one is XORed
+    // with the live sample before it, which leaves mostly zeros, and then zero run-length encoded. The last sample decoded
+    // is cached, so reading a sequence in order costs one delta per sample. Evicting a sample folds its delta into the
+    // next sample's, so evicting from the middle of the set doesn't grow it.
+    class CompressedSampleStorage : public ISampleStorage
+    {
+    public:
+        CompressedSampleStorage(std::unique_ptr<ISampleStorage> storage, const SampleCodecSettings& settings);
+
+        int SampleCount() const override { return _storage->SampleCount(); }
+        uint64_t TotalBytes() const override { return _storage->TotalBytes(); }
+        uint64_t UncompressedBytes() const override { return _uncompressedBytes; }
+        int LiveSampleCount() const override { return _storage->LiveSampleCount(); }
+        int FirstSampleId() const override { return _storage->FirstSampleId(); }
+        bool HasSample(int sampleId) const override { return _storage->HasSample(sampleId); }
+
+        bool CanEvict() const override { return _storage->CanEvict(); }
+        void EvictSample(int sampleId) override;
+
+        int AddSample(const std::vector<unsigned char>& bytes) override;
+        std::vector<unsigned char>& GetSample(int sampleId) override;
+
+        MappedAppendFile* GetGroupIndex(const std::string& viewKey, uint32_t recordSize) override { return _storage->GetGroupIndex(viewKey, recordSize); }
+        void Flush() override { _storage->Flush(); }
+
+    private:
+        enum RecordType : unsigned char
+        {
+            Keyframe,
+            Delta
+        };
+
+        // Each record is a RecordType, the uncompressed size as a uint32_t, then the zero run-length encoded bytes
+        static constexpr size_t RecordHeaderSize = 1 + sizeof(uint32_t);
+
+        int PreviousLiveSampleId(int sampleId) const;
+        int NextLiveSampleId(int sampleId) const;
+
+        void Encode(RecordType type, const std::vector<unsigned char>& bytes, const unsigned char* delta);
+
+        // Run-length decodes a record without applying it to the sample before it. Returns whether it's a delta.
+        bool DecodeRecord(int sampleId, std::vector<unsigned char>& outBytes);
+        void Decode(int sampleId, std::vector<unsigned char>& previousSample, std::vector<unsigned char>& outSample);
+
+        std::unique_ptr<ISampleStorage> _storage;
+        SampleCodecSettings _settings;
+        uint64_t _uncompressedBytes = 0;
+
+        std::vector<unsigned char> _lastAddedSample;
+        int _lastAddedSampleId = -1;
+        std::vector<unsigned char> _encodeBuffer;
+        std::vector<unsigned char> _deltaBuffer;
+
+        std::vector<unsigned char> _decodedSample;
+        int _decodedSampleId = -1;
+        std::vector<unsigned char> _decodeBuffer;
+    };
+
+    // Keeps a sample set in memory-mapped files so it survives a restart. Opening an existing set only maps the files, so
+    // it's ready to sample right away instead of being refilled from live play. Three kinds of file are kept per set:
+    //
+    //   <name>.samples                 the serialized samples back to back
+    //   <name>.offsets                 the end offset of each sample in the .samples file, which makes lookups by id O(1)
+    //   <name>.view-<key hash>.index   (selector, sample id) records for a grouped view, named after the 64-bit FNV-1a
+    //                                  hash of the view's key: its name, or its selector type and creation order if unnamed
+    //
+    // Bump sampleVersion whenever the sample's serialized layout changes; files written with another version are discarded.
+    class MappedSampleStorage : public ISampleStorage
+    {
+    public:
+        MappedSampleStorage(const std::string& directory, const std::string& name, uint32_t sampleVersion);
+
+        int SampleCount() const override;
+        uint64_t TotalBytes() const override;
+
+        int AddSample(const std::vector<unsigned char>& bytes) override;
+        std::vector<unsigned char>& GetSample(int sampleId) override;
+
+        MappedAppendFile* GetGroupIndex(const std::string& viewKey, uint32_t recordSize) override;
+
+        void Flush() override;
+
+    private:
+        std::string _pathPrefix;
+        uint32_t _sampleVersion;
+        bool _wasReset;
+        std::unique_ptr<MappedAppendFile> _samples;
+        std::unique_ptr<MappedAppendFile> _offsets;
+        std::map<std::string, std::unique_ptr<MappedAppendFile>> _groupIndexes;
+        std::vector<unsigned char> _readBuffer;
+    };
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "Memory/SpinLock.hpp"
+
+// A ring of fixed-size segments addressed by an ever increasing unsigned index, which is allowed to wrap. A segment is only
+// allocated the first time something in it is needed and goes back on a free list once everything in it has been released,
+// so memory follows the live range rather than the capacity.
+//
+// Callers keep the live range within Capacity elements (see CanHold()). Inside that range, a segment slot is either empty or
+// holds the segment for that range, never a stale one.
+template<typename T, unsigned int SegmentSize, unsigned int TotalSegments>
+class SegmentedRingBuffer
+{
+public:
+	static constexpr unsigned long long Capacity = static_cast<unsigned long long>(SegmentSize) * TotalSegments;
+
+	static_assert((Capacity & (Capacity - 1)) == 0, "SegmentSize * TotalSegments must be a power of two so indexes can wrap");
+
+	SegmentedRingBuffer() = default;
+	SegmentedRingBuffer(const SegmentedRingBuffer&) = delete;
+	SegmentedRingBuffer& operator=(const SegmentedRingBuffer&) = delete;
+
+	~SegmentedRingBuffer()
+	{
+		for (auto& segment : _segments)
+		{
+			delete[] segment.load(std::memory_order_relaxed);
+		}
+
+		for (T* segment : _freeSegments)
+		{
+			delete[] segment;
+		}
+	}
+
+	// Whether everything from the segment holding firstLiveIndex up to (but not including) endIndex fits in the ring
+	static bool CanHold(unsigned int firstLiveIndex, unsigned int endIndex)
+	{
+		unsigned int firstLiveSegmentStart = firstLiveIndex - firstLiveIndex % SegmentSize;
+		return static_cast<unsigned long long>(endIndex - firstLiveSegmentStart) <= Capacity;
+	}
+
+	// The segment holding index must be allocated
+	T& operator[](unsigned int index)
+	{
+		return _segments[SlotOf(index)].load(std::memory_order_acquire)[index % SegmentSize];
+	}
+
+	const T& operator[](unsigned int index) const
+	{
+		return _segments[SlotOf(index)].load(std::memory_order_acquire)[index % SegmentSize];
+	}
+
+	// Returns null if the segment holding index hasn't been allocated yet
+	T* TryGet(unsigned int index)
+	{
+		T* segment = _segments[SlotOf(index)].load(std::memory_order_acquire);
+		return segment != nullptr
+			? &segment[index % SegmentSize]
+			: nullptr;
+	}
+
+	// Safe to call from several threads at once, including for the same segment
+	void EnsureAllocated(unsigned int index)
+	{
+		auto& slot = _segments[SlotOf(index)];
+		if (slot.load(std::memory_order_acquire) != nullptr)
+		{
+			return;
+		}
+
+		T* segment = AcquireSegment();
+		T* expected = nullptr;
+		if (!slot.compare_exchange_strong(expected, segment, std::memory_order_acq_rel))
+		{
+			ReturnSegment(segment);
+		}
+	}
+
+	// Releases the segments from the one holding firstIndex up to, but not including, the one holding endIndex. reset() is
+	// called on every element so the segment is ready to be handed out again. Must not run at the same time as anything that
+	// reads the released elements.
+	template<typename TReset>
+	void ReleaseSegments(unsigned int firstIndex, unsigned int endIndex, TReset reset)
+	{
+		unsigned int endSegmentStart = endIndex - endIndex % SegmentSize;
+		for (unsigned int segmentStart = firstIndex - firstIndex % SegmentSize; segmentStart != endSegmentStart; segmentStart += SegmentSize)
+		{
+			ReleaseSlot(_segments[SlotOf(segmentStart)], reset);
+		}
+	}
+
+	template<typename TReset>
+	void ReleaseAll(TReset reset)
+	{
+		for (auto& slot : _segments)
+		{
+			ReleaseSlot(slot, reset);
+		}
+	}
+
+	unsigned int AllocatedSegments() const
+	{
+		_lock.Lock();
+		unsigned int allocatedSegments = _totalAllocatedSegments - static_cast<unsigned int>(_freeSegments.size());
+		_lock.Unlock();
+
+		return allocatedSegments;
+	}
+
+private:
+	static unsigned int SlotOf(unsigned int index)
+	{
+		return (index / SegmentSize) % TotalSegments;
+	}
+
+	template<typename TReset>
+	void ReleaseSlot(std::atomic<T*>& slot, TReset& reset)
+	{
+		T* segment = slot.exchange(nullptr, std::memory_order_acq_rel);
+		if (segment == nullptr)
+		{
+			return;
+		}
+
+		for (unsigned int i = 0; i < SegmentSize; ++i)
+		{
+			reset(segment[i]);
+		}
+
+		ReturnSegment(segment);
+	}
+
+	T* AcquireSegment()
+	{
+		_lock.Lock();
+
+		T* segment;
+		if (!_freeSegments.empty())
+		{
+			segment = _freeSegments.back();
+			_freeSegments.pop_back();
+		}
+		else
+		{
+			segment = new T[SegmentSize]();
+			++_totalAllocatedSegments;
+		}
+
+		_lock.Unlock();
+
+		return segment;
+	}
+
+	void ReturnSegment(T* segment)
+	{
+		_lock.Lock();
+		_freeSegments.push_back(segment);
+		_lock.Unlock();
+	}
+
+	std::atomic<T*> _segments[TotalSegments] { };
+
+	// Only taken when a segment is allocated or released, which is once every SegmentSize elements
+	mutable SpinLock _lock;
+	std::vector<T*> _freeSegments;
+	unsigned int _totalAllocatedSegments = 0;
+};
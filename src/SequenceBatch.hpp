@@ -0,0 +1,225 @@
+#pragma once
+
+#include <unordered_map>
+
+namespace StrifeML
+{
+    template<typename TSample>
+    class SampleSet;
+
+    // A batch of sequences where every distinct sample is stored once. Sequences that overlap, which is most of them when
+    // sequences are long and the set is small, point at the same frames instead of each having a copy.
+    template<typename TSample>
+    struct SequenceBatch
+    {
+        int Rows() const { return rows; }
+        int Cols() const { return sequenceLength; }
+
+        const TSample& Get(int row, int step) const
+        {
+            return *frames[frameIndexes[row * sequenceLength + step]];
+        }
+
+        // rows x sequenceLength indexes into frames
+        Grid<const int> FrameIndexes() const
+        {
+            return Grid<const int>(rows, sequenceLength, frameIndexes.data());
+        }
+
+        int rows = 0;
+        int sequenceLength = 0;
+        std::vector<const TSample*> frames;
+        std::vector<int> frameIndexes;
+    };
+
+    // Builds SequenceBatches, deserializing each sample a batch needs once no matter how many of its sequences contain it.
+    // Frames from the previous batch are kept, so a sample that was in the last batch isn't deserialized again either.
+    template<typename TSample>
+    class SequenceBatchBuilder
+    {
+    public:
+        void Begin(int sequenceLength)
+        {
+            _sequenceLength = sequenceLength;
+            _framesDeserialized = 0;
+            _rows.clear();
+            _externalRowCount = 0;
+        }
+
+        // Adds a row made of the sequenceLength samples ending with endSampleId
+        void AddSequence(SampleSet<TSample>* sampleSet, int endSampleId)
+        {
+            _rows.push_back({ GetSetIndex(sampleSet), endSampleId });
+        }
+
+        // Adds a row of samples that don't live in a sample set, such as ones read from shards. frameKeys has a key per step
+        // that's the same wherever the same sample turns up, and deserialize(step, outSample) is only called by TryBuild()
+        // for steps whose sample isn't already in this batch or the last one, so whatever it reads from has to outlive that.
+        void AddSequence(gsl::span<const uint64_t> frameKeys, std::function<bool(int step, TSample& outSample)> deserialize)
+        {
+            if (_externalRowCount == (int)_externalRows.size())
+            {
+                _externalRows.emplace_back();
+            }
+
+            auto& externalRow = _externalRows[_externalRowCount];
+            externalRow.frameKeys.assign(frameKeys.begin(), frameKeys.end());
+            externalRow.deserialize = std::move(deserialize);
+
+            _rows.push_back({ -1, _externalRowCount++ });
+        }
+
+        // Returns false if a sample has been evicted since its sequence was added
+        bool TryBuild()
+        {
+            std::swap(_slotsByFrame, _previousSlotsByFrame);
+            _slotsByFrame.clear();
+
+            _batch.rows = (int)_rows.size();
+            _batch.sequenceLength = _sequenceLength;
+            _batch.frames.clear();
+            _batch.frameIndexes.resize(_rows.size() * _sequenceLength);
+
+            bool isComplete = true;
+            for (int row = 0; row < (int)_rows.size() && isComplete; ++row)
+            {
+                for (int step = 0; step < _sequenceLength; ++step)
+                {
+                    int frameIndex;
+                    if (!TryGetFrame(_rows[row], step, frameIndex))
+                    {
+                        isComplete = false;
+                        break;
+                    }
+
+                    _batch.frameIndexes[row * _sequenceLength + step] = frameIndex;
+                }
+            }
+
+            // Whatever the previous batch had that this one didn't reuse goes back to the pool
+            for (auto& slotPair : _previousSlotsByFrame)
+            {
+                _freeSlots.push_back(slotPair.second);
+            }
+
+            _previousSlotsByFrame.clear();
+            return isComplete;
+        }
+
+        const SequenceBatch<TSample>& Batch() const
+        {
+            return _batch;
+        }
+
+        // How many of the batch's frames had to be deserialized, and how many places in the batch were filled by a frame that
+        // was already there, from this batch or the last
+        int FramesDeserialized() const { return _framesDeserialized; }
+        int FramesShared() const { return (int)_batch.frameIndexes.size() - _framesDeserialized; }
+
+    private:
+        struct Row
+        {
+            // -1 for rows added with frame keys, in which case endSampleId is the index of their ExternalRow
+            int setIndex;
+            int endSampleId;
+        };
+
+        struct ExternalRow
+        {
+            std::vector<uint64_t> frameKeys;
+            std::function<bool(int step, TSample& outSample)> deserialize;
+        };
+
+        int GetSetIndex(SampleSet<TSample>* sampleSet)
+        {
+            auto it = std::find(_sampleSets.begin(), _sampleSets.end(), sampleSet);
+            if (it != _sampleSets.end())
+            {
+                return (int)(it - _sampleSets.begin());
+            }
+
+            _sampleSets.push_back(sampleSet);
+            return (int)_sampleSets.size() - 1;
+        }
+
+        bool TryGetFrame(const Row& row, int step, int& outFrameIndex)
+        {
+            // External keys are kept apart from sample set ones by the top bit, which set indexes never reach
+            const ExternalRow* externalRow = row.setIndex < 0 ? &_externalRows[row.endSampleId] : nullptr;
+            int sampleId = row.endSampleId - (_sequenceLength - 1 - step);
+            uint64_t frameKey = externalRow != nullptr
+                ? externalRow->frameKeys[step] | (1ull << 63)
+                : ((uint64_t)row.setIndex << 32) | (uint32_t)sampleId;
+
+            int slot;
+            auto it = _slotsByFrame.find(frameKey);
+            if (it != _slotsByFrame.end())
+            {
+                slot = it->second;
+            }
+            else
+            {
+                auto previous = _previousSlotsByFrame.find(frameKey);
+                if (previous != _previousSlotsByFrame.end())
+                {
+                    slot = previous->second;
+                    _previousSlotsByFrame.erase(previous);
+                }
+                else
+                {
+                    slot = AllocateSlot();
+                    bool deserialized = externalRow != nullptr
+                        ? externalRow->deserialize(step, *_slots[slot])
+                        : _sampleSets[row.setIndex]->TryGetSampleById(sampleId, *_slots[slot]);
+
+                    if (!deserialized)
+                    {
+                        _freeSlots.push_back(slot);
+                        return false;
+                    }
+
+                    ++_framesDeserialized;
+                }
+
+                _slotsByFrame[frameKey] = slot;
+                _frameIndexBySlot[slot] = (int)_batch.frames.size();
+                _batch.frames.push_back(_slots[slot].get());
+            }
+
+            outFrameIndex = _frameIndexBySlot[slot];
+            return true;
+        }
+
+        int AllocateSlot()
+        {
+            if (!_freeSlots.empty())
+            {
+                int slot = _freeSlots.back();
+                _freeSlots.pop_back();
+                return slot;
+            }
+
+            // Samples are held through pointers so that the batch's frame pointers stay put as the pool grows
+            _slots.push_back(std::make_unique<TSample>());
+            _frameIndexBySlot.push_back(-1);
+            return (int)_slots.size() - 1;
+        }
+
+        int _sequenceLength = 1;
+        int _framesDeserialized = 0;
+        std::vector<Row> _rows;
+        std::vector<ExternalRow> _externalRows;
+        int _externalRowCount = 0;
+        std::vector<SampleSet<TSample>*> _sampleSets;
+        SequenceBatch<TSample> _batch;
+
+        std::vector<std::unique_ptr<TSample>> _slots;
+        std::vector<int> _frameIndexBySlot;
+        std::vector<int> _freeSlots;
+
+        // Keyed by the set's index in _sampleSets in the high 32 bits and the sample id in the low 32 bits, or by the caller's
+        // key with the top bit set
+        std::unordered_map<uint64_t, int> _slotsByFrame;
+        std::unordered_map<uint64_t, int> _previousSlotsByFrame;
+    };
+}
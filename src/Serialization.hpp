@@ -14,6 +14,12 @@ namespace StrifeML
     std::shared_ptr<torch::nn::Module> CreateModule();
     void TorchLoad(std::shared_ptr<torch::nn::Module> module, std::stringstream& stream);
     void TorchSave(std::shared_ptr<torch::nn::Module> module, std::stringstream& stream);
+    void TorchSetThreadCount(int intraOpThreads);
+
+    // State of torch's default CPU generator, which dropout and initialization draw from
+    std::string TorchGetRngState();
+    void TorchSetRngState(const std::string& state);
+    void TorchSetSeed(uint64_t seed);
 
     template<typename T>
     const char* ObjectSerializerName() { return "unknown"; };
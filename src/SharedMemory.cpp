@@ -0,0 +1,671 @@
+#include "StrifeML.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace StrifeML
+{
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared ring buffers need lock-free 64-bit atomics");
+
+#ifdef _WIN32
+    static std::string PlatformName(const std::string& name)
+    {
+        return "Local\\" + name;
+    }
+
+    std::unique_ptr<SharedMemoryRegion> SharedMemoryRegion::Create(const std::string& name, size_t size)
+    {
+        HANDLE mapping = CreateFileMappingA(
+            INVALID_HANDLE_VALUE,
+            nullptr,
+            PAGE_READWRITE,
+            (DWORD)((uint64_t)size >> 32),
+            (DWORD)(size & 0xFFFFFFFF),
+            PlatformName(name).c_str());
+
+        if (mapping == nullptr)
+        {
+            throw StrifeException("Failed to create shared memory %s (error %d)", name.c_str(), (int)GetLastError());
+        }
+
+        void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (data == nullptr)
+        {
+            CloseHandle(mapping);
+            throw StrifeException("Failed to map shared memory %s (error %d)", name.c_str(), (int)GetLastError());
+        }
+
+        std::unique_ptr<SharedMemoryRegion> region(new SharedMemoryRegion);
+        region->_name = name;
+        region->_data = static_cast<unsigned char*>(data);
+        region->_size = size;
+        region->_isOwner = true;
+        region->_handle = mapping;
+        return region;
+    }
+
+    std::unique_ptr<SharedMemoryRegion> SharedMemoryRegion::Open(const std::string& name)
+    {
+        HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, PlatformName(name).c_str());
+        if (mapping == nullptr)
+        {
+            throw StrifeException("Failed to open shared memory %s (error %d)", name.c_str(), (int)GetLastError());
+        }
+
+        void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        if (data == nullptr)
+        {
+            CloseHandle(mapping);
+            throw StrifeException("Failed to map shared memory %s (error %d)", name.c_str(), (int)GetLastError());
+        }
+
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(data, &info, sizeof(info));
+
+        std::unique_ptr<SharedMemoryRegion> region(new SharedMemoryRegion);
+        region->_name = name;
+        region->_data = static_cast<unsigned char*>(data);
+        region->_size = info.RegionSize;
+        region->_handle = mapping;
+        return region;
+    }
+
+    SharedMemoryRegion::~SharedMemoryRegion()
+    {
+        // Windows removes the name once the last handle is closed
+        UnmapViewOfFile(_data);
+        CloseHandle(_handle);
+    }
+
+    std::unique_ptr<MappedFile> MappedFile::Open(const std::string& path, size_t minimumSize)
+    {
+        HANDLE file = CreateFileA(
+            path.c_str(),
+            GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw StrifeException("Failed to open %s (error %d)", path.c_str(), (int)GetLastError());
+        }
+
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+
+        std::unique_ptr<MappedFile> mappedFile(new MappedFile);
+        mappedFile->_path = path;
+        mappedFile->_fileHandle = file;
+        mappedFile->_size = std::max((size_t)fileSize.QuadPart, minimumSize);
+        mappedFile->Map();
+        return mappedFile;
+    }
+
+    std::unique_ptr<MappedFile> MappedFile::TryOpenReadOnly(const std::string& path)
+    {
+        HANDLE file = CreateFileA(
+            path.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return nullptr;
+        }
+
+        std::unique_ptr<MappedFile> mappedFile(new MappedFile);
+        mappedFile->_path = path;
+        mappedFile->_fileHandle = file;
+        mappedFile->_isReadOnly = true;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            return nullptr;
+        }
+
+        mappedFile->_size = (size_t)fileSize.QuadPart;
+        return mappedFile->TryMap() ? std::move(mappedFile) : nullptr;
+    }
+
+    bool MappedFile::TryMap()
+    {
+        // Mapping past the end of the file grows it
+        HANDLE mapping = CreateFileMappingA(
+            _fileHandle,
+            nullptr,
+            _isReadOnly ? PAGE_READONLY : PAGE_READWRITE,
+            (DWORD)((uint64_t)_size >> 32),
+            (DWORD)(_size & 0xFFFFFFFF),
+            nullptr);
+
+        if (mapping == nullptr)
+        {
+            return false;
+        }
+
+        void* data = MapViewOfFile(mapping, _isReadOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, _size);
+        if (data == nullptr)
+        {
+            CloseHandle(mapping);
+            return false;
+        }
+
+        _mappingHandle = mapping;
+        _data = static_cast<unsigned char*>(data);
+        return true;
+    }
+
+    void MappedFile::Map()
+    {
+        if (!TryMap())
+        {
+            throw StrifeException("Failed to map %s (error %d)", _path.c_str(), (int)GetLastError());
+        }
+    }
+
+    void MappedFile::Unmap()
+    {
+        if (_data != nullptr)
+        {
+            UnmapViewOfFile(_data);
+            CloseHandle(_mappingHandle);
+            _data = nullptr;
+            _mappingHandle = nullptr;
+        }
+    }
+
+    void MappedFile::Resize(size_t size)
+    {
+        if (_isReadOnly)
+        {
+            throw StrifeException("Can't resize %s, it was opened read-only", _path.c_str());
+        }
+
+        Unmap();
+
+        // Shrinking needs the file cut explicitly, growing happens when it's mapped
+        LARGE_INTEGER newSize;
+        newSize.QuadPart = (LONGLONG)size;
+        SetFilePointerEx(_fileHandle, newSize, nullptr, FILE_BEGIN);
+        SetEndOfFile(_fileHandle);
+
+        _size = size;
+        Map();
+    }
+
+    void MappedFile::Flush()
+    {
+        if (!_isReadOnly)
+        {
+            FlushViewOfFile(_data, _size);
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Unmap();
+        CloseHandle(_fileHandle);
+    }
+#else
+    static std::string PlatformName(const std::string& name)
+    {
+        return "/" + name;
+    }
+
+    std::unique_ptr<SharedMemoryRegion> SharedMemoryRegion::Create(const std::string& name, size_t size)
+    {
+        auto platformName = PlatformName(name);
+
+        // Clear out anything left behind by a process that crashed before it could clean up
+        shm_unlink(platformName.c_str());
+
+        int fd = shm_open(platformName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd == -1)
+        {
+            throw StrifeException("Failed to create shared memory %s", name.c_str());
+        }
+
+        if (ftruncate(fd, (off_t)size) != 0)
+        {
+            close(fd);
+            shm_unlink(platformName.c_str());
+            throw StrifeException("Failed to resize shared memory %s to %d bytes", name.c_str(), (int)size);
+        }
+
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (data == MAP_FAILED)
+        {
+            shm_unlink(platformName.c_str());
+            throw StrifeException("Failed to map shared memory %s", name.c_str());
+        }
+
+        std::unique_ptr<SharedMemoryRegion> region(new SharedMemoryRegion);
+        region->_name = name;
+        region->_data = static_cast<unsigned char*>(data);
+        region->_size = size;
+        region->_isOwner = true;
+        return region;
+    }
+
+    std::unique_ptr<SharedMemoryRegion> SharedMemoryRegion::Open(const std::string& name)
+    {
+        int fd = shm_open(PlatformName(name).c_str(), O_RDWR, 0600);
+        if (fd == -1)
+        {
+            throw StrifeException("Failed to open shared memory %s", name.c_str());
+        }
+
+        struct stat fileInfo;
+        if (fstat(fd, &fileInfo) != 0)
+        {
+            close(fd);
+            throw StrifeException("Failed to get the size of shared memory %s", name.c_str());
+        }
+
+        size_t size = (size_t)fileInfo.st_size;
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (data == MAP_FAILED)
+        {
+            throw StrifeException("Failed to map shared memory %s", name.c_str());
+        }
+
+        std::unique_ptr<SharedMemoryRegion> region(new SharedMemoryRegion);
+        region->_name = name;
+        region->_data = static_cast<unsigned char*>(data);
+        region->_size = size;
+        return region;
+    }
+
+    SharedMemoryRegion::~SharedMemoryRegion()
+    {
+        munmap(_data, _size);
+
+        if (_isOwner)
+        {
+            shm_unlink(PlatformName(_name).c_str());
+        }
+    }
+
+    std::unique_ptr<MappedFile> MappedFile::Open(const std::string& path, size_t minimumSize)
+    {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd == -1)
+        {
+            throw StrifeException("Failed to open %s", path.c_str());
+        }
+
+        struct stat fileInfo;
+        if (fstat(fd, &fileInfo) != 0)
+        {
+            close(fd);
+            throw StrifeException("Failed to get the size of %s", path.c_str());
+        }
+
+        std::unique_ptr<MappedFile> mappedFile(new MappedFile);
+        mappedFile->_path = path;
+        mappedFile->_fileHandle = reinterpret_cast<void*>((intptr_t)fd);
+
+        size_t size = (size_t)fileInfo.st_size;
+        if (size < minimumSize)
+        {
+            mappedFile->Resize(minimumSize);
+        }
+        else
+        {
+            mappedFile->_size = size;
+            mappedFile->Map();
+        }
+
+        return mappedFile;
+    }
+
+    std::unique_ptr<MappedFile> MappedFile::TryOpenReadOnly(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            return nullptr;
+        }
+
+        std::unique_ptr<MappedFile> mappedFile(new MappedFile);
+        mappedFile->_path = path;
+        mappedFile->_fileHandle = reinterpret_cast<void*>((intptr_t)fd);
+        mappedFile->_isReadOnly = true;
+
+        // Nothing can be mapped from an empty file, and a directory or device has no size to map
+        struct stat fileInfo;
+        if (fstat(fd, &fileInfo) != 0 || !S_ISREG(fileInfo.st_mode) || fileInfo.st_size == 0)
+        {
+            return nullptr;
+        }
+
+        mappedFile->_size = (size_t)fileInfo.st_size;
+        return mappedFile->TryMap() ? std::move(mappedFile) : nullptr;
+    }
+
+    bool MappedFile::TryMap()
+    {
+        int fd = (int)reinterpret_cast<intptr_t>(_fileHandle);
+        void* data = mmap(nullptr, _size, _isReadOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+
+        _data = static_cast<unsigned char*>(data);
+        return true;
+    }
+
+    void MappedFile::Map()
+    {
+        if (!TryMap())
+        {
+            throw StrifeException("Failed to map %s", _path.c_str());
+        }
+    }
+
+    void MappedFile::Unmap()
+    {
+        if (_data != nullptr)
+        {
+            munmap(_data, _size);
+            _data = nullptr;
+        }
+    }
+
+    void MappedFile::Resize(size_t size)
+    {
+        if (_isReadOnly)
+        {
+            throw StrifeException("Can't resize %s, it was opened read-only", _path.c_str());
+        }
+
+        Unmap();
+
+        int fd = (int)reinterpret_cast<intptr_t>(_fileHandle);
+        if (ftruncate(fd, (off_t)size) != 0)
+        {
+            throw StrifeException("Failed to resize %s to %lld bytes", _path.c_str(), (long long)size);
+        }
+
+        _size = size;
+        Map();
+    }
+
+    void MappedFile::Flush()
+    {
+        if (!_isReadOnly)
+        {
+            msync(_data, _size, MS_ASYNC);
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Unmap();
+        close((int)reinterpret_cast<intptr_t>(_fileHandle));
+    }
+#endif
+
+    bool TryReplaceFile(const std::string& temporaryPath, const std::string& path)
+    {
+#ifdef _WIN32
+        return MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+    }
+
+    MappedAppendFile::MappedAppendFile(const std::string& path, uint32_t userVersion, uint32_t recordSize, bool reset)
+        : _file(MappedFile::Open(path, 64 * 1024))
+    {
+        auto header = GetHeader();
+        bool isCompatible = header->magic == Magic
+            && header->formatVersion == FormatVersion
+            && header->userVersion == userVersion
+            && header->recordSize == recordSize
+            && sizeof(Header) + header->committedBytes <= _file->Size();
+
+        if (reset || !isCompatible)
+        {
+            header->magic = Magic;
+            header->formatVersion = FormatVersion;
+            header->userVersion = userVersion;
+            header->recordSize = recordSize;
+            header->committedBytes = 0;
+            _wasReset = true;
+        }
+    }
+
+    uint64_t MappedAppendFile::Append(const void* data, size_t size)
+    {
+        uint64_t offset = GetHeader()->committedBytes;
+        size_t requiredSize = sizeof(Header) + offset + size;
+
+        if (requiredSize > _file->Size())
+        {
+            _file->Resize(std::max(requiredSize, _file->Size() * 2));
+        }
+
+        memcpy(_file->Data() + sizeof(Header) + offset, data, size);
+        GetHeader()->committedBytes = offset + size;
+
+        return offset;
+    }
+
+    void MappedAppendFile::Truncate(uint64_t size)
+    {
+        if (size < GetHeader()->committedBytes)
+        {
+            GetHeader()->committedBytes = size;
+        }
+    }
+
+    size_t SharedRingBuffer::RequiredBytes(uint32_t capacity)
+    {
+        return sizeof(Header) + capacity;
+    }
+
+    void SharedRingBuffer::Initialize(unsigned char* memory, uint32_t capacity)
+    {
+        auto header = new (memory) Header;
+        header->magic = Magic;
+        header->capacity = capacity;
+        header->writePosition.store(0, std::memory_order_relaxed);
+        header->readPosition.store(0, std::memory_order_release);
+    }
+
+    SharedRingBuffer::SharedRingBuffer(unsigned char* memory, size_t size)
+        : _header(reinterpret_cast<Header*>(memory)),
+          _data(memory + sizeof(Header))
+    {
+        if (size < sizeof(Header) || reinterpret_cast<uintptr_t>(memory) % alignof(Header) != 0)
+        {
+            throw StrifeException("Shared ring buffer doesn't fit in %d bytes", (int)size);
+        }
+
+        if (_header->magic != Magic)
+        {
+            throw StrifeException("Shared ring buffer hasn't been initialized");
+        }
+
+        // Kept rather than read from the header each time, so the other process can't change it once it's been checked. A
+        // zero capacity would divide by zero when copying in and out.
+        _capacity = _header->capacity;
+        if (_capacity == 0 || RequiredBytes(_capacity) > size)
+        {
+            throw StrifeException("Shared ring buffer of %u bytes doesn't fit in %d bytes", _capacity, (int)size);
+        }
+    }
+
+    bool SharedRingBuffer::TryWrite(const unsigned char* data, uint32_t size)
+    {
+        uint64_t totalSize = sizeof(uint32_t) + (uint64_t)size;
+        if (totalSize > _capacity)
+        {
+            throw StrifeException("Message of %d bytes can never fit in a ring buffer of %d bytes", (int)size, (int)_capacity);
+        }
+
+        uint64_t writePosition = _header->writePosition.load(std::memory_order_relaxed);
+        uint64_t readPosition = _header->readPosition.load(std::memory_order_acquire);
+        uint64_t unreadBytes = writePosition - readPosition;
+        if (unreadBytes > _capacity)
+        {
+            throw StrifeException("Shared ring buffer positions are corrupt");
+        }
+
+        if (_capacity - unreadBytes < totalSize)
+        {
+            return false;
+        }
+
+        CopyIn(writePosition, reinterpret_cast<const unsigned char*>(&size), sizeof(size));
+        CopyIn(writePosition + sizeof(size), data, size);
+        _header->writePosition.store(writePosition + totalSize, std::memory_order_release);
+
+        return true;
+    }
+
+    bool SharedRingBuffer::TryRead(std::vector<unsigned char>& outMessage)
+    {
+        uint64_t readPosition = _header->readPosition.load(std::memory_order_relaxed);
+        uint64_t writePosition = _header->writePosition.load(std::memory_order_acquire);
+        if (readPosition == writePosition)
+        {
+            return false;
+        }
+
+        // The positions and the size prefix are written by the other process, so they're checked before anything is copied
+        uint64_t unreadBytes = writePosition - readPosition;
+        if (unreadBytes < sizeof(uint32_t) || unreadBytes > _capacity)
+        {
+            throw StrifeException("Shared ring buffer positions are corrupt");
+        }
+
+        uint32_t size;
+        CopyOut(readPosition, reinterpret_cast<unsigned char*>(&size), sizeof(size));
+        if (sizeof(size) + (uint64_t)size > unreadBytes)
+        {
+            throw StrifeException("Shared ring buffer message of %u bytes is longer than the %d bytes written", size, (int)unreadBytes);
+        }
+
+        outMessage.resize(size);
+        CopyOut(readPosition + sizeof(size), outMessage.data(), size);
+        _header->readPosition.store(readPosition + sizeof(size) + size, std::memory_order_release);
+
+        return true;
+    }
+
+    void SharedRingBuffer::CopyIn(uint64_t position, const unsigned char* data, uint32_t size)
+    {
+        uint32_t offset = (uint32_t)(position % _capacity);
+        uint32_t firstPart = std::min(size, _capacity - offset);
+        memcpy(_data + offset, data, firstPart);
+        memcpy(_data, data + firstPart, size - firstPart);
+    }
+
+    void SharedRingBuffer::CopyOut(uint64_t position, unsigned char* outData, uint32_t size) const
+    {
+        uint32_t offset = (uint32_t)(position % _capacity);
+        uint32_t firstPart = std::min(size, _capacity - offset);
+        memcpy(outData, _data + offset, firstPart);
+        memcpy(outData + firstPart, _data, size - firstPart);
+    }
+
+    std::string SharedMemoryTrainingChannel::RegionName(const std::string& name, int actorId)
+    {
+        return name + "." + std::to_string(actorId);
+    }
+
+    std::unique_ptr<SharedMemoryTrainingChannel> SharedMemoryTrainingChannel::Create(
+        const std::string& name,
+        int actorId,
+        const SharedMemoryChannelSettings& settings)
+    {
+        // Keep both ring buffer headers cache line aligned
+        auto alignUp = [](uint64_t value) { return (value + 63) & ~(uint64_t)63; };
+
+        uint64_t sampleBufferOffset = alignUp(sizeof(Header));
+        uint64_t modelBufferOffset = alignUp(sampleBufferOffset + SharedRingBuffer::RequiredBytes(settings.sampleBufferBytes));
+        uint64_t totalSize = modelBufferOffset + SharedRingBuffer::RequiredBytes(settings.modelBufferBytes);
+
+        auto region = SharedMemoryRegion::Create(RegionName(name, actorId), totalSize);
+        unsigned char* data = region->Data();
+
+        SharedRingBuffer::Initialize(data + sampleBufferOffset, settings.sampleBufferBytes);
+        SharedRingBuffer::Initialize(data + modelBufferOffset, settings.modelBufferBytes);
+
+        auto header = reinterpret_cast<Header*>(data);
+        header->version = Version;
+        header->sampleBufferOffset = sampleBufferOffset;
+        header->modelBufferOffset = modelBufferOffset;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = Magic;
+
+        return std::unique_ptr<SharedMemoryTrainingChannel>(new SharedMemoryTrainingChannel(std::move(region), sampleBufferOffset, modelBufferOffset));
+    }
+
+    std::unique_ptr<SharedMemoryTrainingChannel> SharedMemoryTrainingChannel::Open(const std::string& name, int actorId)
+    {
+        auto region = SharedMemoryRegion::Open(RegionName(name, actorId));
+        auto header = reinterpret_cast<const Header*>(region->Data());
+
+        if (region->Size() < sizeof(Header) || header->magic != Magic)
+        {
+            throw StrifeException("Shared memory %s is not a training channel", RegionName(name, actorId).c_str());
+        }
+
+        if (header->version != Version)
+        {
+            throw StrifeException("Training channel version mismatch (expected %d, got %d)", (int)Version, (int)header->version);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // The sample buffer comes first and runs up to the model buffer, which runs to the end of the region. The ring
+        // buffers check that their capacities fit. The offsets are read once, since the other process can write them.
+        uint64_t sampleBufferOffset = header->sampleBufferOffset;
+        uint64_t modelBufferOffset = header->modelBufferOffset;
+        bool isLayoutValid = sampleBufferOffset >= sizeof(Header)
+            && sampleBufferOffset < modelBufferOffset
+            && modelBufferOffset < region->Size();
+
+        if (!isLayoutValid)
+        {
+            throw StrifeException("Training channel %s has buffers outside its memory", RegionName(name, actorId).c_str());
+        }
+
+        return std::unique_ptr<SharedMemoryTrainingChannel>(new SharedMemoryTrainingChannel(std::move(region), sampleBufferOffset, modelBufferOffset));
+    }
+
+    SharedMemoryTrainingChannel::SharedMemoryTrainingChannel(
+        std::unique_ptr<SharedMemoryRegion> region,
+        uint64_t sampleBufferOffset,
+        uint64_t modelBufferOffset)
+        : samples(region->Data() + sampleBufferOffset, modelBufferOffset - sampleBufferOffset),
+          models(region->Data() + modelBufferOffset, region->Size() - modelBufferOffset),
+          _region(std::move(region))
+    {
+
+    }
+}
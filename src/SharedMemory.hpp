@@ -0,0 +1,188 @@
+#pragma once
+
+namespace StrifeML
+{
+    // A named block of memory that can be mapped by several processes on the same machine
+    class SharedMemoryRegion
+    {
+    public:
+        // Creating a region makes this process its owner, which removes the name again when the region is destroyed
+        static std::unique_ptr<SharedMemoryRegion> Create(const std::string& name, size_t size);
+        static std::unique_ptr<SharedMemoryRegion> Open(const std::string& name);
+
+        SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+        SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+        ~SharedMemoryRegion();
+
+        unsigned char* Data() const { return _data; }
+        size_t Size() const { return _size; }
+
+    private:
+        SharedMemoryRegion() = default;
+
+        std::string _name;
+        unsigned char* _data = nullptr;
+        size_t _size = 0;
+        bool _isOwner = false;
+        void* _handle = nullptr;
+    };
+
+    // A file on disk mapped into memory. Resizing remaps the file, which invalidates any pointers into it.
+    class MappedFile
+    {
+    public:
+        // Creates the file if it doesn't exist and grows it to at least minimumSize bytes
+        static std::unique_ptr<MappedFile> Open(const std::string& path, size_t minimumSize);
+
+        // Maps an existing file without write access, so its data must not be written to and it can't be resized. Returns
+        // null instead of throwing if the file doesn't exist, is empty or can't be mapped.
+        static std::unique_ptr<MappedFile> TryOpenReadOnly(const std::string& path);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        void Resize(size_t size);
+
+        // Asks the OS to write dirty pages back now rather than whenever it gets around to it
+        void Flush();
+
+        unsigned char* Data() const { return _data; }
+        size_t Size() const { return _size; }
+        const std::string& Path() const { return _path; }
+
+    private:
+        MappedFile() = default;
+
+        bool TryMap();
+        void Map();
+        void Unmap();
+
+        std::string _path;
+        unsigned char* _data = nullptr;
+        size_t _size = 0;
+        bool _isReadOnly = false;
+        void* _fileHandle = nullptr;
+        void* _mappingHandle = nullptr;
+    };
+
+    // Moves the file at temporaryPath over the one at path in one step, so path never goes missing and readers see either
+    // the old file or the new one. Used by writers that write to the side and then swap the file in.
+    bool TryReplaceFile(const std::string& temporaryPath, const std::string& path);
+
+    // A mapped file that is only ever appended to. The header records how many bytes have been committed, and that count
+    // only moves once a record has been fully written, so a crash mid-append loses that record and nothing before it.
+    class MappedAppendFile
+    {
+    public:
+        static constexpr uint32_t Magic = 0x534D4146;
+        static constexpr uint32_t FormatVersion = 1;
+
+        // Starts the file over if it was written by a different format, user version or record size, or if reset is set
+        MappedAppendFile(const std::string& path, uint32_t userVersion, uint32_t recordSize, bool reset = false);
+
+        // Returns the offset of the record in the payload
+        uint64_t Append(const void* data, size_t size);
+
+        // Drops everything after the first size bytes of the payload
+        void Truncate(uint64_t size);
+
+        const unsigned char* Payload() const { return _file->Data() + sizeof(Header); }
+        uint64_t PayloadSize() const { return GetHeader()->committedBytes; }
+        uint64_t RecordCount() const { return GetHeader()->recordSize == 0 ? 0 : PayloadSize() / GetHeader()->recordSize; }
+
+        bool WasReset() const { return _wasReset; }
+        void Flush() { _file->Flush(); }
+
+    private:
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t formatVersion;
+            uint32_t userVersion;
+            uint32_t recordSize;
+            uint64_t committedBytes;
+        };
+
+        Header* GetHeader() const { return reinterpret_cast<Header*>(_file->Data()); }
+
+        std::unique_ptr<MappedFile> _file;
+        bool _wasReset = false;
+    };
+
+    // Single-producer, single-consumer queue of variable sized messages that lives entirely inside a caller provided block
+    // of memory, so the producer and consumer can be in different processes.
+    class SharedRingBuffer
+    {
+    public:
+        static constexpr uint32_t Magic = 0x53524247;
+
+        static size_t RequiredBytes(uint32_t capacity);
+
+        // Formats the memory as an empty buffer. Must be done by one side before either side attaches.
+        static void Initialize(unsigned char* memory, uint32_t capacity);
+
+        // size is how much of the memory the buffer may use. Throws if the buffer doesn't fit in it or wasn't initialized.
+        SharedRingBuffer(unsigned char* memory, size_t size);
+
+        // Returns false without writing anything if there isn't room for the whole message
+        bool TryWrite(const unsigned char* data, uint32_t size);
+
+        // Throws if the next message claims more bytes than have been written, since the other side is then corrupt
+        bool TryRead(std::vector<unsigned char>& outMessage);
+
+        uint32_t Capacity() const { return _capacity; }
+
+    private:
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t capacity;
+            alignas(64) std::atomic<uint64_t> writePosition;
+            alignas(64) std::atomic<uint64_t> readPosition;
+        };
+
+        void CopyIn(uint64_t position, const unsigned char* data, uint32_t size);
+        void CopyOut(uint64_t position, unsigned char* outData, uint32_t size) const;
+
+        Header* _header;
+        unsigned char* _data;
+        uint32_t _capacity = 0;
+    };
+
+    struct SharedMemoryChannelSettings
+    {
+        uint32_t sampleBufferBytes = 16 * 1024 * 1024;
+        uint32_t modelBufferBytes = 64 * 1024 * 1024;
+    };
+
+    // The shared memory between the learner and one actor process: samples flow from the actor to the learner and
+    // serialized networks flow back the other way.
+    class SharedMemoryTrainingChannel
+    {
+    public:
+        static std::unique_ptr<SharedMemoryTrainingChannel> Create(const std::string& name, int actorId, const SharedMemoryChannelSettings& settings);
+        static std::unique_ptr<SharedMemoryTrainingChannel> Open(const std::string& name, int actorId);
+
+        static std::string RegionName(const std::string& name, int actorId);
+
+        SharedRingBuffer samples;
+        SharedRingBuffer models;
+
+    private:
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t sampleBufferOffset;
+            uint64_t modelBufferOffset;
+        };
+
+        static constexpr uint32_t Magic = 0x53544D43;
+        static constexpr uint32_t Version = 1;
+
+        SharedMemoryTrainingChannel(std::unique_ptr<SharedMemoryRegion> region, uint64_t sampleBufferOffset, uint64_t modelBufferOffset);
+
+        std::unique_ptr<SharedMemoryRegion> _region;
+    };
+}
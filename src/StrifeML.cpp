@@ -1,6 +1,10 @@
 #include "StrifeML.hpp"
 #include "torch/nn/module.h"
 #include "torch/serialize.h"
+#include "torch/utils.h"
+#include "torch/version.h"
+#include "ATen/autocast_mode.h"
+#include "ATen/CPUGeneratorImpl.h"
 
 namespace StrifeML
 {
@@ -48,4 +52,175 @@ namespace StrifeML
     {
         torch::save(module, stream);
     }
-}
+
+    void TorchSetThreadCount(int intraOpThreads)
+    {
+        torch::set_num_threads(intraOpThreads);
+    }
+
+    std::string TorchGetRngState()
+    {
+        auto generator = at::detail::getDefaultCPUGenerator();
+        std::lock_guard<std::mutex> lock(generator.mutex());
+        auto state = generator.get_state();
+        return std::string((const char*)state.data_ptr<uint8_t>(), state.numel());
+    }
+
+    void TorchSetRngState(const std::string& state)
+    {
+        auto tensor = torch::empty({ (int64_t)state.size() }, torch::kUInt8);
+        memcpy(tensor.data_ptr<uint8_t>(), state.data(), state.size());
+
+        auto generator = at::detail::getDefaultCPUGenerator();
+        std::lock_guard<std::mutex> lock(generator.mutex());
+        generator.set_state(tensor);
+    }
+
+    void TorchSetSeed(uint64_t seed)
+    {
+        torch::manual_seed(seed);
+    }
+
+    MixedPrecisionScope::MixedPrecisionScope(TrainingPrecision precision)
+        : _isEnabled(precision == TrainingPrecision::BFloat16)
+    {
+        if (!_isEnabled)
+        {
+            return;
+        }
+
+#if TORCH_VERSION_MAJOR > 2 || (TORCH_VERSION_MAJOR == 2 && TORCH_VERSION_MINOR >= 4)
+        _wasEnabled = at::autocast::is_autocast_enabled(at::kCPU);
+        _previousType = (int)at::autocast::get_autocast_dtype(at::kCPU);
+        at::autocast::set_autocast_dtype(at::kCPU, at::kBFloat16);
+        at::autocast::set_autocast_enabled(at::kCPU, true);
+#elif TORCH_VERSION_MAJOR > 1 || TORCH_VERSION_MINOR >= 10
+        _wasEnabled = at::autocast::is_cpu_enabled();
+        _previousType = (int)at::autocast::get_autocast_cpu_dtype();
+        at::autocast::set_autocast_cpu_dtype(at::kBFloat16);
+        at::autocast::set_cpu_enabled(true);
+#else
+        // CPU autocast first appeared in 1.10
+        throw StrifeException("bfloat16 training needs libtorch 1.10 or newer");
+#endif
+        at::autocast::increment_nesting();
+    }
+
+    MixedPrecisionScope::~MixedPrecisionScope()
+    {
+        if (!_isEnabled)
+        {
+            return;
+        }
+
+        // The bfloat16 copies of the weights are cached for the scope, and are stale once the optimizer steps
+        if (at::autocast::decrement_nesting() == 0)
+        {
+            at::autocast::clear_cache();
+        }
+
+#if TORCH_VERSION_MAJOR > 2 || (TORCH_VERSION_MAJOR == 2 && TORCH_VERSION_MINOR >= 4)
+        at::autocast::set_autocast_dtype(at::kCPU, (at::ScalarType)_previousType);
+        at::autocast::set_autocast_enabled(at::kCPU, _wasEnabled);
+#elif TORCH_VERSION_MAJOR > 1 || TORCH_VERSION_MINOR >= 10
+        at::autocast::set_autocast_cpu_dtype((at::ScalarType)_previousType);
+        at::autocast::set_cpu_enabled(_wasEnabled);
+#endif
+    }
+
+    static void CheckSameParameterCount(const std::vector<torch::Tensor>& from, const std::vector<torch::Tensor>& to)
+    {
+        if (from.size() != to.size())
+        {
+            throw StrifeException("Modules have different parameter counts (%d vs %d)", (int)from.size(), (int)to.size());
+        }
+    }
+
+    void TorchCopyParameters(std::shared_ptr<torch::nn::Module> from, std::shared_ptr<torch::nn::Module> to)
+    {
+        torch::NoGradGuard noGrad;
+
+        auto fromParameters = from->parameters();
+        auto toParameters = to->parameters();
+        CheckSameParameterCount(fromParameters, toParameters);
+
+        for (int i = 0; i < (int)fromParameters.size(); ++i)
+        {
+            toParameters[i].copy_(fromParameters[i]);
+        }
+
+        auto fromBuffers = from->buffers();
+        auto toBuffers = to->buffers();
+        for (int i = 0; i < (int)fromBuffers.size() && i < (int)toBuffers.size(); ++i)
+        {
+            toBuffers[i].copy_(fromBuffers[i]);
+        }
+    }
+
+    void TorchShareParameters(std::shared_ptr<torch::nn::Module> from, std::shared_ptr<torch::nn::Module> to)
+    {
+        auto fromParameters = from->parameters();
+        auto toParameters = to->parameters();
+        CheckSameParameterCount(fromParameters, toParameters);
+
+        for (int i = 0; i < (int)fromParameters.size(); ++i)
+        {
+            toParameters[i].set_data(fromParameters[i]);
+        }
+    }
+
+    void TorchZeroGradients(std::shared_ptr<torch::nn::Module> module)
+    {
+        for (auto& parameter : module->parameters())
+        {
+            auto& grad = parameter.mutable_grad();
+            if (grad.defined())
+            {
+                grad = grad.detach();
+                grad.zero_();
+            }
+        }
+    }
+
+    void TorchAddGradients(std::shared_ptr<torch::nn::Module> from, std::shared_ptr<torch::nn::Module> to, float scale)
+    {
+        torch::NoGradGuard noGrad;
+
+        auto fromParameters = from->parameters();
+        auto toParameters = to->parameters();
+        CheckSameParameterCount(fromParameters, toParameters);
+
+        for (int i = 0; i < (int)fromParameters.size(); ++i)
+        {
+            const auto& fromGrad = fromParameters[i].grad();
+            if (!fromGrad.defined())
+            {
+                continue;
+            }
+
+            auto& toGrad = toParameters[i].mutable_grad();
+            if (toGrad.defined())
+            {
+                toGrad.add_(fromGrad, scale);
+            }
+            else
+            {
+                toGrad = fromGrad * scale;
+            }
+        }
+    }
+
+    void TorchScaleGradients(std::shared_ptr<torch::nn::Module> module, float scale)
+    {
+        torch::NoGradGuard noGrad;
+
+        for (auto& parameter : module->parameters())
+        {
+            auto& grad = parameter.mutable_grad();
+            if (grad.defined())
+            {
+                grad.mul_(scale);
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -1,19 +1,52 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <queue>
 #include <random>
+#include <thread>
+#include <typeinfo>
+#include <type_traits>
 #include <unordered_set>
 #include <gsl/span>
 #include <cstdarg>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "Container/Grid.hpp"
 #include "Thread/TaskScheduler.hpp"
 #include "Thread/ThreadPool.hpp"
 
+#include "WorkScheduler.hpp"
 #include "MlUtil.hpp"
+#include "Metrics.hpp"
 #include "Sample.hpp"
 #include "Serialization.hpp"
+#include "Compression.hpp"
+#include "SharedMemory.hpp"
+#include "SampleStorage.hpp"
+#include "SampleShards.hpp"
+#include "SequenceBatch.hpp"
+#include "Checkpoint.hpp"
 #include "NetworkContext.hpp"
 #include "NeuralNetwork.hpp"
 #include "Decider.hpp"
-#include "Trainer.hpp"
\ No newline at end of file
+#include "Trainer.hpp"
+#include "OfflineTraining.hpp"
+#include "SampleExporter.hpp"
+#include "RemoteTraining.hpp"
\ No newline at end of file
@@ -328,4 +328,173 @@ namespace StrifeML
         Grid<const T> grid(1, span.size(), span.data());
         return PackIntoTensor(grid, selector);
     }
+
+    // Rounds to the nearest bfloat16, ties to even, the same as torch's conversion
+    inline void ConvertToBFloat16(const float* values, int64_t count, c10::BFloat16* outValues)
+    {
+        auto outBits = reinterpret_cast<uint16_t*>(outValues);
+        for (int64_t i = 0; i < count; ++i)
+        {
+            uint32_t bits;
+            memcpy(&bits, &values[i], sizeof(bits));
+
+            outBits[i] = (bits & 0x7fffffff) > 0x7f800000
+                ? (uint16_t)((bits >> 16) | 0x40)
+                : (uint16_t)((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+        }
+    }
+
+    // PackIntoTensor(grid, selector), except that when training in bfloat16, float cells are packed straight into a bfloat16
+    // tensor. That's half the bytes for the first layer to read, without packing in fp32 and converting the whole tensor.
+    template<typename T, typename TSelector>
+    torch::Tensor PackIntoTensor(const Grid<T>& grid, TSelector selector, TrainingPrecision precision)
+    {
+        using SelectorReturnType = decltype(selector(grid[0][0]));
+        using CellType = typename GetCellType<SelectorReturnType>::Type;
+
+        if constexpr (!std::is_same_v<CellType, float>)
+        {
+            return PackIntoTensor(grid, selector);
+        }
+        else
+        {
+            if (precision != TrainingPrecision::BFloat16)
+            {
+                return PackIntoTensor(grid, selector);
+            }
+
+            auto cellDimensions = DimensionCalculator<SelectorReturnType>::Dims(selector(grid[0][0]));
+            auto dimensions = Dimensions<2>((int64_t)grid.Rows(), (int64_t)grid.Cols()).Union(cellDimensions);
+
+            int64_t cellSize = 1;
+            for (int i = 0; i < cellDimensions.GetTotalDimensions(); ++i)
+            {
+                cellSize *= cellDimensions.dimensions[i];
+            }
+
+            torch::IntArrayRef dims(dimensions.dimensions, dimensions.GetTotalDimensions());
+            auto t = torch::empty(dims, torch::kBFloat16);
+
+            // Each cell goes through an fp32 buffer small enough to stay in cache
+            thread_local std::vector<float> packedCell;
+            packedCell.resize(cellSize);
+
+            c10::BFloat16* outPtr = t.template data_ptr<c10::BFloat16>();
+            for (int i = 0; i < grid.Rows(); ++i)
+            {
+                for (int j = 0; j < grid.Cols(); ++j)
+                {
+                    TorchPacker<SelectorReturnType, float>::Pack(selector(grid[i][j]), packedCell.data());
+                    ConvertToBFloat16(packedCell.data(), cellSize, outPtr);
+                    outPtr += cellSize;
+                }
+            }
+
+            return t.squeeze(t.dim()-1);
+        }
+    }
+
+    template<typename TCell>
+    TCell* GetTensorData(torch::Tensor& tensor)
+    {
+        if constexpr (std::is_integral_v<TCell>)
+        {
+            return reinterpret_cast<TCell*>(tensor.template data_ptr<std::make_signed_t<TCell>>());
+        }
+        else
+        {
+            return tensor.template data_ptr<TCell>();
+        }
+    }
+
+    // The dimensions of one frame of the batch. An empty batch has no frame to measure, so a default sample is used instead.
+    template<typename TSample, typename TSelector>
+    auto GetFrameDimensions(const SequenceBatch<TSample>& batch, TSelector selector)
+    {
+        using SelectorReturnType = decltype(selector(*batch.frames[0]));
+
+        if (batch.frames.empty())
+        {
+            TSample emptyFrame;
+            return DimensionCalculator<SelectorReturnType>::Dims(selector(emptyFrame));
+        }
+
+        return DimensionCalculator<SelectorReturnType>::Dims(selector(*batch.frames[0]));
+    }
+
+    // Packs each distinct frame of the batch once, as [frames, ...]
+    template<typename TSample, typename TSelector>
+    torch::Tensor PackFramesIntoTensor(const SequenceBatch<TSample>& batch, TSelector selector)
+    {
+        using SelectorReturnType = decltype(selector(*batch.frames[0]));
+        using CellType = typename GetCellType<SelectorReturnType>::Type;
+
+        int totalFrames = (int)batch.frames.size();
+        auto dimensions = Dimensions<1>((int64_t)totalFrames).Union(GetFrameDimensions(batch, selector));
+
+        torch::IntArrayRef dims(dimensions.dimensions, dimensions.GetTotalDimensions());
+        auto t = torch::empty(dims, GetTorchType<CellType>());
+
+        CellType* outPtr = GetTensorData<CellType>(t);
+        for (int i = 0; i < totalFrames; ++i)
+        {
+            outPtr = TorchPacker<SelectorReturnType, CellType>::Pack(selector(*batch.frames[i]), outPtr);
+        }
+
+        return t.squeeze(t.dim()-1);
+    }
+
+    // [rows, sequence length] indexes into the first dimension of PackFramesIntoTensor()
+    template<typename TSample>
+    torch::Tensor PackFrameIndexesIntoTensor(const SequenceBatch<TSample>& batch)
+    {
+        auto t = torch::empty({ (int64_t)batch.Rows(), (int64_t)batch.Cols() }, torch::kInt64);
+
+        int64_t* outPtr = t.template data_ptr<int64_t>();
+        for (int frameIndex : batch.frameIndexes)
+        {
+            *outPtr++ = frameIndex;
+        }
+
+        return t;
+    }
+
+    // The same tensor PackIntoTensor() makes from a Grid of samples, [rows, sequence length, ...], but each distinct frame is
+    // run through the selector and packed once and then copied to every place it appears
+    template<typename TSample, typename TSelector>
+    torch::Tensor PackIntoTensor(const SequenceBatch<TSample>& batch, TSelector selector)
+    {
+        using SelectorReturnType = decltype(selector(*batch.frames[0]));
+        using CellType = typename GetCellType<SelectorReturnType>::Type;
+
+        auto cellDimensions = GetFrameDimensions(batch, selector);
+        auto dimensions = Dimensions<2>((int64_t)batch.Rows(), (int64_t)batch.Cols()).Union(cellDimensions);
+
+        int64_t frameSize = 1;
+        for (int i = 0; i < cellDimensions.GetTotalDimensions(); ++i)
+        {
+            frameSize *= cellDimensions.dimensions[i];
+        }
+
+        thread_local std::vector<CellType> packedFrames;
+        packedFrames.resize(batch.frames.size() * frameSize);
+
+        CellType* framePtr = packedFrames.data();
+        for (auto frame : batch.frames)
+        {
+            framePtr = TorchPacker<SelectorReturnType, CellType>::Pack(selector(*frame), framePtr);
+        }
+
+        torch::IntArrayRef dims(dimensions.dimensions, dimensions.GetTotalDimensions());
+        auto t = torch::empty(dims, GetTorchType<CellType>());
+
+        CellType* outPtr = GetTensorData<CellType>(t);
+        for (int frameIndex : batch.frameIndexes)
+        {
+            memcpy(outPtr, &packedFrames[frameIndex * frameSize], frameSize * sizeof(CellType));
+            outPtr += frameSize;
+        }
+
+        return t.squeeze(t.dim()-1);
+    }
 }
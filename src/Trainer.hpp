@@ -11,10 +11,54 @@ namespace StrifeML
         virtual ~ITrainer() = default;
     };
 
+    struct TrainingBatchTimings
+    {
+        float TotalSeconds() const
+        {
+            return assemblySeconds + trainSeconds + publishSeconds;
+        }
+
+        float assemblySeconds = 0;
+        float trainSeconds = 0;
+
+        // Covers saving the network and loading it into the network context
+        float publishSeconds = 0;
+    };
+
     struct TrainingBatchResult
     {
         float loss = 0;
         bool isSuccess = true;
+        TrainingBatchTimings timings;
+    };
+
+    // When enabled, the train task ticks at maxTrainsPerSecond and the trainer decides on each tick whether to run a batch,
+    // based on how long recent batches took and how the decision latency reported by the game is doing.
+    struct AdaptiveTrainingSchedule
+    {
+        bool isEnabled = false;
+
+        // Fraction of a single core that batches are allowed to use on average
+        float targetCpuBudget = 0.25f;
+        float minTrainsPerSecond = 0.5f;
+        float maxTrainsPerSecond = 30;
+
+        // If non-zero, the training rate is halved whenever the reported decision latency is above this
+        float decisionLatencySloSeconds = 0;
+
+        // Weight given to the newest batch when averaging batch cost
+        float costSmoothing = 0.2f;
+    };
+
+    struct DataParallelSettings
+    {
+        // Number of replicas each batch is split across. 1 trains on the network directly. Replicas only run in parallel on
+        // workers the training budget has spare, so raise WorkSchedulerSettings::maxTrainingWorkers along with this.
+        int replicaCount = 1;
+
+        // Replicas share the network's weights and each steps its own optimizer without any synchronization, instead of
+        // having their gradients averaged into the network. Doesn't require the network to support the gradient split.
+        bool hogwild = false;
     };
 
     template<typename TNeuralNetwork>
@@ -36,6 +80,24 @@ namespace StrifeML
         std::shared_ptr<Trainer<TNeuralNetwork>> trainer;
     };
 
+    // Started by the train task on every tick. Queues the batch in the training lane unless one is already waiting there,
+    // so ticks that arrive while training is held back are coalesced instead of piling up as full batches.
+    template<typename TNeuralNetwork>
+    struct QueueTrainingBatchWorkItem : IThreadPoolWorkItem
+    {
+        QueueTrainingBatchWorkItem(std::shared_ptr<Trainer<TNeuralNetwork>> trainer_)
+            : trainer(trainer_),
+              batchWorkItem(std::make_shared<RunTrainingBatchWorkItem<TNeuralNetwork>>(trainer_))
+        {
+
+        }
+
+        void Execute() override;
+
+        std::shared_ptr<Trainer<TNeuralNetwork>> trainer;
+        std::shared_ptr<RunTrainingBatchWorkItem<TNeuralNetwork>> batchWorkItem;
+    };
+
     template<typename TNeuralNetwork>
     struct Trainer : ITrainer, std::enable_shared_from_this<Trainer<TNeuralNetwork>>
     {
@@ -46,15 +108,75 @@ namespace StrifeML
 
         static_assert(std::is_base_of_v < INeuralNetwork, TNeuralNetwork > , "Neural network must inherit from INeuralNetwork<>");
 
-        Trainer(int batchSize_, float trainsPerSecond_, int sequenceLength);
+        // Passing the same seed reproduces the same sampling decisions. Torch's CPU generator is seeded from it too, so networks
+        // created after the trainer start from the same weights; it's global, so the last trainer created wins.
+        Trainer(int batchSize_, float trainsPerSecond_, int sequenceLength, uint64_t seed = RandomNumberGenerator::NondeterministicSeed());
 
         void StartRunning();
 
+        // Safe to call from any thread. The sample is staged and handed to ReceiveSample() by the training work item at
+        // the start of the next batch, so callers never wait on batch assembly.
         void AddSample(SampleType& sample);
 
+        // Counts samples that were already in a persistent sample set when it was opened towards
+        // minSamplesBeforeStartingTraining, so a restarted trainer doesn't wait for that many new ones
+        void AddRestoredSamples(int sampleCount);
+
+        // Moves staged samples into the repository. Must be called with sampleLock held.
+        int DrainStagedSamples();
+
         virtual bool TryCreateBatch(Grid <SampleType> outBatch);
 
-        void NotifyTrainingComplete(std::stringstream& serializedNetwork, const TrainingBatchResult& result);
+        // Fills sequenceBatchBuilder with a row per batch entry from TrySelectSequence() and builds it
+        bool TryCreateSequenceBatch();
+
+        // Publishes the network and calls OnTrainingComplete(). The time publishing took is added to the result's
+        // publishSeconds first, so the caller should set it to how long saving the network took.
+        void NotifyTrainingComplete(std::stringstream& serializedNetwork, TrainingBatchResult& result);
+
+        // Hands a serialized network to the publish listeners and the network context
+        void PublishNetwork(std::stringstream& serializedNetwork);
+
+        // Safe to call from any thread, including while training is running. Listeners are called on the training thread
+        // with each published network.
+        void AddNetworkPublishedListener(std::function<void(const std::string& serializedNetwork)> listener);
+
+        // Takes a checkpoint if one is due. The network is the one that was just published, so it isn't serialized again,
+        // and the file is written on the checkpoint thread. The optimizer is serialized here, though, since it's owned by
+        // the network and can't be copied generically, so training pauses for one SaveOptimizer() per checkpoint. The
+        // pause is recorded in strifeml_trainer_checkpoint_pause_seconds.
+        void CheckpointIfDue(const std::stringstream& serializedNetwork);
+
+        // Loads the newest intact checkpoint into the network, optimizer, random generators and counters, and publishes
+        // the network right away. Call before StartRunning(), after creating the sample sets so their generators are
+        // restored too. Returns false if there's no checkpoint to resume from.
+        bool TryResumeFromCheckpoint();
+
+        // Trains the network on a batch, sharding it across replicas if data parallelism is enabled. Runs in the
+        // trainer's trainingPrecision, like the other training calls below.
+        void TrainBatch(Grid<const SampleType> input, TrainingBatchResult& outResult);
+
+        // Adds the gradients of a batch to the network's gradients without stepping the optimizer. Only valid if
+        // CanSplitGradients() is true.
+        void ComputeGradients(Grid<const SampleType> input, TrainingBatchResult& outResult);
+        bool CanSplitGradients() const;
+
+        // The same for a batch built by sequenceBatchBuilder, used when shareSequenceFrames is set
+        void TrainSequenceBatch(const SequenceBatch<SampleType>& batch, TrainingBatchResult& outResult);
+        void ComputeSequenceGradients(const SequenceBatch<SampleType>& batch, TrainingBatchResult& outResult);
+
+        void RunOnReplicas(Grid<const SampleType> input, TrainingBatchResult& outResult, bool accumulateGradients);
+
+        // Can be called from any thread to feed the decision latency SLO of the adaptive schedule
+        void ReportDecisionLatency(float seconds);
+
+        // Returns false if the tick should be skipped, either because a batch is still running or because the adaptive
+        // schedule says it's too early. Every successful call must be paired with EndBatch().
+        bool TryBeginBatch();
+        void SkipTick();
+        void EndBatch(const TrainingBatchTimings* timings);
+
+        bool TryAssembleBatch();
 
         virtual void OnTrainingComplete(const TrainingBatchResult& result) { }
         virtual void ReceiveSample(const SampleType& sample) { }
@@ -64,6 +186,29 @@ namespace StrifeML
             return false;
         }
 
+        // Used instead of TrySelectSequenceSamples() when shareSequenceFrames is set. Should add one row of sequenceLength
+        // samples to builder, usually through GroupedSampleView::TryPickRandomSequence(sequenceLength, builder).
+        virtual bool TrySelectSequence(SequenceBatchBuilder<SampleType>& builder)
+        {
+            return false;
+        }
+
+        // Adds count rows for a batch and returns how many were added. Calls TrySelectSequence() once per row unless
+        // overridden, usually with GroupedSampleView::TryPickRandomSequences(sequenceLength, count, builder), which picks a
+        // whole batch with bulk draws.
+        virtual int TrySelectSequences(SequenceBatchBuilder<SampleType>& builder, int count)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                if (!TrySelectSequence(builder))
+                {
+                    return i;
+                }
+            }
+
+            return count;
+        }
+
         virtual void OnCreateNewNetwork(std::shared_ptr <NetworkType> newNetwork) { }
         virtual void OnRunBatch() { }
 
@@ -71,42 +216,125 @@ namespace StrifeML
         RandomNumberGenerator rng;
         SampleRepository <SampleType> sampleRepository;
         MlUtil::SharedArray <SampleType> trainingInput;
+        MlUtil::StagingQueue <SampleType> stagedSamples;
+
+        // The sets to notify once the sample lock is released, copied while it's held
+        std::vector<SampleSet<SampleType>*> sampleSetsToNotify;
         int batchSize;
         int sequenceLength;
         float trainsPerSecond;
+        AdaptiveTrainingSchedule adaptiveSchedule;
+        DataParallelSettings dataParallel;
+        std::vector<std::shared_ptr<TNeuralNetwork>> replicas;
+        std::vector<TrainingBatchResult> replicaResults;
+
+        // Builds batches as SequenceBatches, where sequences that overlap share frames rather than each deserializing its own
+        // copy, and trains with the network's TrainSequenceBatch()/ComputeSequenceGradients(). Worth it once sequences are
+        // long enough to overlap. Batches aren't split across data-parallel replicas in this mode.
+        bool shareSequenceFrames = false;
+        SequenceBatchBuilder<SampleType> sequenceBatchBuilder;
+
+        // Number of batches of batchSize whose gradients are accumulated before the optimizer is stepped and the network is
+        // published. Needs a network that supports the gradient split and no hogwild replicas; StartRunning() throws
+        // otherwise, since each batch would then step the optimizer on its own.
+        int accumulationSteps = 1;
+
+        // BFloat16 trains with bfloat16 forward passes and inputs over fp32 weights. Only helps if the network packs its inputs
+        // with trainingPrecision and the CPU has native bfloat16 support; otherwise the conversions cost more than they save.
+        TrainingPrecision trainingPrecision = TrainingPrecision::Float32;
+
+        // Periodic checkpoints of everything TryResumeFromCheckpoint() needs, written on a background thread
+        CheckpointSettings checkpoints;
+        std::unique_ptr<CheckpointWriter> checkpointWriter;
+
+        // Networks trained and published, including those before the checkpoint training resumed from
+        int64_t batchesTrained = 0;
+
+        float adaptiveTrainsPerSecond = 0;
+        float averageBatchSeconds = 0;
+        std::atomic<int> skippedTicks { 0 };
+        std::atomic<bool> isBatchRunning { false };
+        std::atomic<bool> isBatchQueued { false };
+        std::atomic<float> lastDecisionLatency { 0 };
+        std::chrono::steady_clock::time_point nextBatchTime;
         std::shared_ptr <ScheduledTask> trainTask;
+        std::vector<std::function<void(const std::string& serializedNetwork)>> networkPublishedListeners;
+        std::mutex networkPublishedListenersMutex;
+
+        MetricCounter* samplesAddedCounter;
+        MetricCounter* batchesTrainedCounter;
+        MetricCounter* skippedTicksCounter;
+        LatencyHistogram* batchAssemblyLatency;
+        LatencyHistogram* trainBatchLatency;
+        LatencyHistogram* publishLatency;
+        LatencyHistogram* sampleLockWaitLatency;
+        LatencyHistogram* checkpointPauseLatency;
+        MetricGauge* stagedSamplesGauge;
         std::shared_ptr <NetworkContext<TNeuralNetwork>> networkContext;
         std::shared_ptr <TNeuralNetwork> network;
-        bool isTraining = false;
+        std::atomic<bool> isTraining { false };
         int minSamplesBeforeStartingTraining = 32;
-        int totalSamples = 0;
+        std::atomic<int> totalSamples { 0 };
     };
 
     template<typename TNeuralNetwork>
-    Trainer<TNeuralNetwork>::Trainer(int batchSize_, float trainsPerSecond_, int sequenceLength)
-        : sampleRepository(rng),
+    Trainer<TNeuralNetwork>::Trainer(int batchSize_, float trainsPerSecond_, int sequenceLength, uint64_t seed)
+        : rng(seed),
+          sampleRepository(rng),
           trainingInput(MlUtil::SharedArray<SampleType>(batchSize_ * sequenceLength)),
           batchSize(batchSize_),
           sequenceLength(sequenceLength),
           trainsPerSecond(trainsPerSecond_)
     {
+        // A stream of its own, so seeding torch doesn't shift the numbers the sample sets get
+        TorchSetSeed(rng.CreateStream(0x7E5EED).NextUInt64());
 
+        auto metrics = MetricsRegistry::GetInstance();
+        samplesAddedCounter = metrics->GetCounter("strifeml_trainer_samples_added_total", "Samples passed to Trainer::AddSample");
+        batchesTrainedCounter = metrics->GetCounter("strifeml_trainer_batches_total", "Training batches run and published");
+        skippedTicksCounter = metrics->GetCounter("strifeml_trainer_skipped_ticks_total", "Train ticks coalesced because a batch was still running or queued");
+        batchAssemblyLatency = metrics->GetHistogram("strifeml_trainer_batch_assembly_seconds", "Time to drain staged samples and assemble a batch");
+        trainBatchLatency = metrics->GetHistogram("strifeml_trainer_train_batch_seconds", "Time spent in TrainBatch");
+        publishLatency = metrics->GetHistogram("strifeml_trainer_publish_seconds", "Time to save a trained network and load it into the network context");
+        sampleLockWaitLatency = metrics->GetHistogram("strifeml_trainer_sample_lock_wait_seconds", "Time spent waiting for the trainer's sample lock");
+        checkpointPauseLatency = metrics->GetHistogram("strifeml_trainer_checkpoint_pause_seconds", "Time the training thread spends copying state into a checkpoint");
+        stagedSamplesGauge = metrics->GetGauge("strifeml_trainer_staged_samples", "Samples added but not yet moved into the sample repository by the training thread");
     }
 
     template<typename TNeuralNetwork>
     void Trainer<TNeuralNetwork>::AddSample(Trainer::SampleType& sample)
     {
-        sampleLock.Lock();
-        ReceiveSample(sample);
-        sampleLock.Unlock();
+        stagedSamples.Push(sample);
+        samplesAddedCounter->Add();
+        stagedSamplesGauge->Set(stagedSamples.Depth());
 
-        ++totalSamples;
-        if (!isTraining && totalSamples >= minSamplesBeforeStartingTraining)
+        if (++totalSamples >= minSamplesBeforeStartingTraining && !isTraining.load(std::memory_order_relaxed))
         {
             isTraining = true;
         }
     }
 
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::AddRestoredSamples(int sampleCount)
+    {
+        if ((totalSamples += sampleCount) >= minSamplesBeforeStartingTraining)
+        {
+            isTraining = true;
+        }
+    }
+
+    template<typename TNeuralNetwork>
+    int Trainer<TNeuralNetwork>::DrainStagedSamples()
+    {
+        int drained = stagedSamples.Drain([this](const SampleType& sample)
+        {
+            ReceiveSample(sample);
+        });
+
+        stagedSamplesGauge->Set(stagedSamples.Depth());
+        return drained;
+    }
+
     template<typename TNeuralNetwork>
     bool Trainer<TNeuralNetwork>::TryCreateBatch(Grid <SampleType> outBatch)
     {
@@ -123,43 +351,535 @@ namespace StrifeML
     }
 
     template<typename TNeuralNetwork>
-    void Trainer<TNeuralNetwork>::NotifyTrainingComplete(std::stringstream& serializedNetwork, const TrainingBatchResult& result)
+    bool Trainer<TNeuralNetwork>::TryCreateSequenceBatch()
     {
-        auto newNetwork = networkContext->SetNewNetwork(serializedNetwork);
+        sequenceBatchBuilder.Begin(sequenceLength);
+        return TrySelectSequences(sequenceBatchBuilder, batchSize) == batchSize && sequenceBatchBuilder.TryBuild();
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::NotifyTrainingComplete(std::stringstream& serializedNetwork, TrainingBatchResult& result)
+    {
+        ++batchesTrained;
+        auto publishStart = std::chrono::steady_clock::now();
+        PublishNetwork(serializedNetwork);
+        result.timings.publishSeconds += std::chrono::duration<float>(std::chrono::steady_clock::now() - publishStart).count();
         OnTrainingComplete(result);
     }
 
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::PublishNetwork(std::stringstream& serializedNetwork)
+    {
+        {
+            std::lock_guard<std::mutex> lock(networkPublishedListenersMutex);
+            if (!networkPublishedListeners.empty())
+            {
+                auto serializedNetworkString = serializedNetwork.str();
+                for (auto& listener : networkPublishedListeners)
+                {
+                    listener(serializedNetworkString);
+                }
+            }
+        }
+
+        if (networkContext != nullptr)
+        {
+            networkContext->SetNewNetwork(serializedNetwork);
+        }
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::AddNetworkPublishedListener(std::function<void(const std::string& serializedNetwork)> listener)
+    {
+        std::lock_guard<std::mutex> lock(networkPublishedListenersMutex);
+        networkPublishedListeners.push_back(std::move(listener));
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::CheckpointIfDue(const std::stringstream& serializedNetwork)
+    {
+        if (!checkpoints.isEnabled || batchesTrained % std::max(1, checkpoints.batchesPerCheckpoint) != 0)
+        {
+            return;
+        }
+
+        if (checkpointWriter == nullptr)
+        {
+            checkpointWriter = std::make_unique<CheckpointWriter>(checkpoints);
+        }
+
+        auto pauseStart = std::chrono::steady_clock::now();
+        auto checkpoint = std::make_shared<Checkpoint>();
+        checkpoint->batchesTrained = batchesTrained;
+        checkpoint->SetPart("network", serializedNetwork.str());
+
+        std::stringstream optimizerStream;
+        network->SaveOptimizer(optimizerStream);
+        checkpoint->SetPart("optimizer", optimizerStream.str());
+        checkpoint->SetPart("torch_rng", TorchGetRngState());
+
+        checkpoint->SetValuePart("counters/batches_trained", batchesTrained);
+        checkpoint->SetValuePart("counters/skipped_ticks", (int64_t)skippedTicks.load());
+        checkpoint->SetValuePart("counters/adaptive_trains_per_second", adaptiveTrainsPerSecond);
+        checkpoint->SetValuePart("counters/average_batch_seconds", averageBatchSeconds);
+
+        // Sample sets draw from streams of their own, and are only touched with the sample lock held
+        LockAndRecordWait(sampleLock, sampleLockWaitLatency);
+        auto rngState = rng.GetState();
+        checkpoint->SetPart("rng", std::string((const char*)&rngState, sizeof(rngState)));
+        for (auto sampleSet : sampleRepository.SampleSets())
+        {
+            auto setRngState = sampleSet->GetRandomNumberGenerator().GetState();
+            checkpoint->SetPart("rng/" + sampleSet->Name(), std::string((const char*)&setRngState, sizeof(setRngState)));
+        }
+
+        sampleLock.Unlock();
+
+        checkpointWriter->Write(checkpoint);
+        checkpointPauseLatency->RecordSeconds(std::chrono::duration<float>(std::chrono::steady_clock::now() - pauseStart).count());
+    }
+
+    template<typename TNeuralNetwork>
+    bool Trainer<TNeuralNetwork>::TryResumeFromCheckpoint()
+    {
+        Checkpoint checkpoint;
+        auto networkPart = CheckpointWriter::TryReadNewest(checkpoints, checkpoint) ? checkpoint.TryGetPart("network") : nullptr;
+        if (networkPart == nullptr)
+        {
+            return false;
+        }
+
+        std::stringstream networkStream(*networkPart);
+        TorchLoad(network->module, networkStream);
+
+        if (auto optimizerPart = checkpoint.TryGetPart("optimizer"); optimizerPart != nullptr && !optimizerPart->empty())
+        {
+            std::stringstream optimizerStream(*optimizerPart);
+            network->LoadOptimizer(optimizerStream);
+        }
+
+        if (auto torchRngPart = checkpoint.TryGetPart("torch_rng"); torchRngPart != nullptr && !torchRngPart->empty())
+        {
+            TorchSetRngState(*torchRngPart);
+        }
+
+        checkpoint.TryGetValuePart("counters/batches_trained", batchesTrained);
+        checkpoint.TryGetValuePart("counters/adaptive_trains_per_second", adaptiveTrainsPerSecond);
+        checkpoint.TryGetValuePart("counters/average_batch_seconds", averageBatchSeconds);
+
+        int64_t checkpointedSkippedTicks;
+        if (checkpoint.TryGetValuePart("counters/skipped_ticks", checkpointedSkippedTicks))
+        {
+            skippedTicks = (int)checkpointedSkippedTicks;
+        }
+
+        auto restoreRng = [&](const std::string& name, RandomNumberGenerator& generator)
+        {
+            auto part = checkpoint.TryGetPart(name);
+            if (part != nullptr && part->size() == sizeof(RandomNumberGenerator::State))
+            {
+                RandomNumberGenerator::State state;
+                memcpy(&state, part->data(), sizeof(state));
+                generator.SetState(state);
+            }
+        };
+
+        LockAndRecordWait(sampleLock, sampleLockWaitLatency);
+        restoreRng("rng", rng);
+        for (auto sampleSet : sampleRepository.SampleSets())
+        {
+            restoreRng("rng/" + sampleSet->Name(), sampleSet->GetRandomNumberGenerator());
+        }
+
+        sampleLock.Unlock();
+
+        // Deciders get the resumed network now rather than after the first batch
+        std::stringstream publishStream(*networkPart);
+        PublishNetwork(publishStream);
+        return true;
+    }
+
+    template<typename TNeuralNetwork>
+    bool Trainer<TNeuralNetwork>::CanSplitGradients() const
+    {
+        return !dataParallel.hogwild && network->SupportsGradientSplit();
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::TrainBatch(Grid<const SampleType> input, TrainingBatchResult& outResult)
+    {
+        int shardCount = std::min(dataParallel.replicaCount, input.Rows());
+        network->trainingPrecision = trainingPrecision;
+        MixedPrecisionScope mixedPrecision(trainingPrecision);
+
+        if (shardCount > 1 && CanSplitGradients())
+        {
+            TorchZeroGradients(network->module);
+            ComputeGradients(input, outResult);
+            network->ApplyGradients();
+        }
+        else if (shardCount > 1 && dataParallel.hogwild)
+        {
+            RunOnReplicas(input, outResult, false);
+        }
+        else
+        {
+            network->TrainBatch(input, outResult);
+        }
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::ComputeGradients(Grid<const SampleType> input, TrainingBatchResult& outResult)
+    {
+        int shardCount = std::min(dataParallel.replicaCount, input.Rows());
+        network->trainingPrecision = trainingPrecision;
+        MixedPrecisionScope mixedPrecision(trainingPrecision);
+
+        if (shardCount <= 1)
+        {
+            outResult = TrainingBatchResult();
+            network->ComputeGradients(input, outResult);
+        }
+        else
+        {
+            RunOnReplicas(input, outResult, true);
+        }
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::TrainSequenceBatch(const SequenceBatch<SampleType>& batch, TrainingBatchResult& outResult)
+    {
+        network->trainingPrecision = trainingPrecision;
+        MixedPrecisionScope mixedPrecision(trainingPrecision);
+
+        outResult = TrainingBatchResult();
+        network->TrainSequenceBatch(batch, outResult);
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::ComputeSequenceGradients(const SequenceBatch<SampleType>& batch, TrainingBatchResult& outResult)
+    {
+        network->trainingPrecision = trainingPrecision;
+        MixedPrecisionScope mixedPrecision(trainingPrecision);
+
+        outResult = TrainingBatchResult();
+        network->ComputeSequenceGradients(batch, outResult);
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::RunOnReplicas(Grid<const SampleType> input, TrainingBatchResult& outResult, bool accumulateGradients)
+    {
+        int totalRows = input.Rows();
+        int shardCount = std::min(dataParallel.replicaCount, totalRows);
+
+        while ((int)replicas.size() < shardCount)
+        {
+            auto replica = std::make_shared<TNeuralNetwork>();
+            if (dataParallel.hogwild)
+            {
+                TorchShareParameters(network->module, replica->module);
+            }
+
+            replicas.push_back(replica);
+        }
+
+        replicaResults.resize(shardCount);
+
+        MlUtil::ParallelForShards(shardCount, [&](int shardIndex)
+        {
+            int startRow = totalRows * shardIndex / shardCount;
+            int endRow = totalRows * (shardIndex + 1) / shardCount;
+            Grid<const SampleType> shard(endRow - startRow, input.Cols(), &input[startRow][0]);
+
+            auto& replica = replicas[shardIndex];
+            auto& result = replicaResults[shardIndex];
+            result = TrainingBatchResult();
+
+            // Autocast is per thread, so the scope TrainBatch() opened doesn't reach the helpers
+            replica->trainingPrecision = trainingPrecision;
+            MixedPrecisionScope mixedPrecision(trainingPrecision);
+
+            if (accumulateGradients)
+            {
+                TorchCopyParameters(network->module, replica->module);
+                TorchZeroGradients(replica->module);
+                replica->ComputeGradients(shard, result);
+            }
+            else
+            {
+                replica->TrainBatch(shard, result);
+            }
+        });
+
+        outResult = TrainingBatchResult();
+
+        // Reduce in shard order so the result doesn't depend on which thread finished first
+        for (int i = 0; i < shardCount; ++i)
+        {
+            int startRow = totalRows * i / shardCount;
+            int endRow = totalRows * (i + 1) / shardCount;
+            float weight = (float)(endRow - startRow) / totalRows;
+
+            if (accumulateGradients)
+            {
+                TorchAddGradients(replicas[i]->module, network->module, weight);
+            }
+
+            outResult.loss += replicaResults[i].loss * weight;
+            outResult.isSuccess = outResult.isSuccess && replicaResults[i].isSuccess;
+        }
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::ReportDecisionLatency(float seconds)
+    {
+        lastDecisionLatency.store(seconds, std::memory_order_relaxed);
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::SkipTick()
+    {
+        ++skippedTicks;
+        skippedTicksCounter->Add();
+    }
+
+    template<typename TNeuralNetwork>
+    bool Trainer<TNeuralNetwork>::TryBeginBatch()
+    {
+        if (isBatchRunning.exchange(true, std::memory_order_acquire))
+        {
+            // The previous batch overran its tick, so coalesce this one into it
+            SkipTick();
+            return false;
+        }
+
+        if (adaptiveSchedule.isEnabled && std::chrono::steady_clock::now() < nextBatchTime)
+        {
+            isBatchRunning.store(false, std::memory_order_release);
+            return false;
+        }
+
+        return true;
+    }
+
+    template<typename TNeuralNetwork>
+    void Trainer<TNeuralNetwork>::EndBatch(const TrainingBatchTimings* timings)
+    {
+        if (timings != nullptr)
+        {
+            batchesTrainedCounter->Add();
+            batchAssemblyLatency->RecordSeconds(timings->assemblySeconds);
+            trainBatchLatency->RecordSeconds(timings->trainSeconds);
+            publishLatency->RecordSeconds(timings->publishSeconds);
+        }
+
+        if (timings != nullptr && adaptiveSchedule.isEnabled)
+        {
+            float batchSeconds = timings->TotalSeconds();
+            averageBatchSeconds = averageBatchSeconds == 0
+                ? batchSeconds
+                : averageBatchSeconds + adaptiveSchedule.costSmoothing * (batchSeconds - averageBatchSeconds);
+
+            // The rate at which batches would use exactly the CPU budget
+            float budgetTrainsPerSecond = averageBatchSeconds > 0
+                ? adaptiveSchedule.targetCpuBudget / averageBatchSeconds
+                : adaptiveSchedule.maxTrainsPerSecond;
+
+            float slo = adaptiveSchedule.decisionLatencySloSeconds;
+            if (slo > 0 && lastDecisionLatency.load(std::memory_order_relaxed) > slo)
+            {
+                adaptiveTrainsPerSecond *= 0.5f;
+            }
+            else
+            {
+                // Back off immediately if over budget, but only ramp up gradually
+                adaptiveTrainsPerSecond = std::min(budgetTrainsPerSecond, adaptiveTrainsPerSecond * 1.25f);
+            }
+
+            adaptiveTrainsPerSecond = std::clamp(
+                adaptiveTrainsPerSecond,
+                adaptiveSchedule.minTrainsPerSecond,
+                adaptiveSchedule.maxTrainsPerSecond);
+
+            nextBatchTime = std::chrono::steady_clock::now()
+                + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<float>(1.0f / adaptiveTrainsPerSecond - batchSeconds));
+        }
+
+        isBatchRunning.store(false, std::memory_order_release);
+    }
+
     template<typename TNeuralNetwork>
     void Trainer<TNeuralNetwork>::StartRunning()
     {
+        if (accumulationSteps > 1 && !CanSplitGradients())
+        {
+            throw StrifeException(
+                "accumulationSteps of %d needs a network that supports the gradient split and no hogwild replicas",
+                accumulationSteps);
+        }
+
         auto taskScheduler = TaskScheduler::GetInstance();
         trainTask = std::make_shared<ScheduledTask>();
-        trainTask->workItem = std::make_shared<RunTrainingBatchWorkItem<TNeuralNetwork>>(this->shared_from_this());
-        trainTask->recurringTime = 1.0f / trainsPerSecond;
+        trainTask->workItem = std::make_shared<QueueTrainingBatchWorkItem<TNeuralNetwork>>(this->shared_from_this());
+
+        if (adaptiveSchedule.isEnabled)
+        {
+            adaptiveTrainsPerSecond = std::clamp(trainsPerSecond, adaptiveSchedule.minTrainsPerSecond, adaptiveSchedule.maxTrainsPerSecond);
+            nextBatchTime = std::chrono::steady_clock::now();
+            trainTask->recurringTime = 1.0f / adaptiveSchedule.maxTrainsPerSecond;
+        }
+        else
+        {
+            trainTask->recurringTime = 1.0f / trainsPerSecond;
+        }
+
         trainTask->runTime = 0;
         taskScheduler->Start(trainTask);
     }
 
+    template<typename TNeuralNetwork>
+    bool Trainer<TNeuralNetwork>::TryAssembleBatch()
+    {
+        LockAndRecordWait(sampleLock, sampleLockWaitLatency);
+        DrainStagedSamples();
+        bool successful = isTraining && (shareSequenceFrames
+            ? TryCreateSequenceBatch()
+            : TryCreateBatch(Grid<SampleType>(batchSize, sequenceLength, trainingInput.data.get())));
+        sampleSetsToNotify.assign(sampleRepository.SampleSets().begin(), sampleRepository.SampleSets().end());
+        sampleLock.Unlock();
+
+        // Observers such as sample exporters get the drained samples without holding anyone up
+        for (auto sampleSet : sampleSetsToNotify)
+        {
+            sampleSet->NotifyObservers();
+        }
+
+        return successful;
+    }
+
+    template<typename TNeuralNetwork>
+    void QueueTrainingBatchWorkItem<TNeuralNetwork>::Execute()
+    {
+        if (trainer->isBatchQueued.exchange(true, std::memory_order_acq_rel))
+        {
+            trainer->SkipTick();
+            return;
+        }
+
+        WorkScheduler::GetInstance()->StartItem(batchWorkItem, WorkLane::Training);
+    }
+
     template<typename TNeuralNetwork>
     void RunTrainingBatchWorkItem<TNeuralNetwork>::Execute()
     {
-        if (!trainer->isTraining)
+        using Clock = std::chrono::steady_clock;
+
+        // Cleared before the batch starts, so a tick during the batch queues the next one
+        trainer->isBatchQueued.store(false, std::memory_order_release);
+
+        if (!trainer->TryBeginBatch())
         {
             return;
         }
 
-        trainer->sampleLock.Lock();
-        bool successful = trainer->TryCreateBatch(Grid<SampleType>(trainer->batchSize, trainer->sequenceLength, trainer->trainingInput.data.get()));
-        trainer->sampleLock.Unlock();
+        // Ends the batch if anything below throws, otherwise isBatchRunning would stay set and every later tick would be
+        // skipped
+        struct EndBatchOnThrow
+        {
+            ~EndBatchOnThrow()
+            {
+                if (trainer != nullptr)
+                {
+                    trainer->EndBatch(nullptr);
+                }
+            }
+
+            Trainer<TNeuralNetwork>* trainer;
+        } endBatchOnThrow { trainer.get() };
+
+        int totalSteps = std::max(1, trainer->accumulationSteps);
+        bool splitGradients = totalSteps > 1 && trainer->CanSplitGradients();
+        int completedSteps = 0;
+        TrainingBatchTimings timings;
+        TrainingBatchResult stepResult;
+        _result = TrainingBatchResult();
 
-        if (successful)
+        for (int step = 0; step < totalSteps; ++step)
         {
+            auto assemblyStart = Clock::now();
+            bool successful = trainer->TryAssembleBatch();
+            auto trainStart = Clock::now();
+            timings.assemblySeconds += std::chrono::duration<float>(trainStart - assemblyStart).count();
+
+            if (!successful)
+            {
+                break;
+            }
+
             trainer->OnRunBatch();
             Grid<const SampleType> input(trainer->batchSize, trainer->sequenceLength, trainer->trainingInput.data.get());
-            trainer->network->TrainBatch(input, _result);
-            std::stringstream stream;
-            TorchSave(trainer->network->module, stream);
-            trainer->NotifyTrainingComplete(stream, _result);
+
+            if (splitGradients && step == 0)
+            {
+                TorchZeroGradients(trainer->network->module);
+            }
+
+            if (trainer->shareSequenceFrames)
+            {
+                if (splitGradients)
+                {
+                    trainer->ComputeSequenceGradients(trainer->sequenceBatchBuilder.Batch(), stepResult);
+                }
+                else
+                {
+                    trainer->TrainSequenceBatch(trainer->sequenceBatchBuilder.Batch(), stepResult);
+                }
+            }
+            else if (splitGradients)
+            {
+                trainer->ComputeGradients(input, stepResult);
+            }
+            else
+            {
+                trainer->TrainBatch(input, stepResult);
+            }
+
+            timings.trainSeconds += std::chrono::duration<float>(Clock::now() - trainStart).count();
+
+            _result.loss += stepResult.loss;
+            _result.isSuccess = _result.isSuccess && stepResult.isSuccess;
+            ++completedSteps;
+        }
+
+        if (completedSteps == 0)
+        {
+            endBatchOnThrow.trainer = nullptr;
+            trainer->EndBatch(nullptr);
+            return;
         }
+
+        _result.loss /= completedSteps;
+
+        if (splitGradients)
+        {
+            auto stepStart = Clock::now();
+            TorchScaleGradients(trainer->network->module, 1.0f / completedSteps);
+            trainer->network->ApplyGradients();
+            timings.trainSeconds += std::chrono::duration<float>(Clock::now() - stepStart).count();
+        }
+
+        _result.timings = timings;
+
+        auto saveStart = Clock::now();
+        std::stringstream stream;
+        TorchSave(trainer->network->module, stream);
+        _result.timings.publishSeconds = std::chrono::duration<float>(Clock::now() - saveStart).count();
+        trainer->NotifyTrainingComplete(stream, _result);
+
+        // Before EndBatch(), so the next batch can't start training while the optimizer is being copied
+        trainer->CheckpointIfDue(stream);
+        endBatchOnThrow.trainer = nullptr;
+        trainer->EndBatch(&_result.timings);
     }
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "StrifeML.hpp"
+
+namespace StrifeML
+{
+    struct DispatchWorkItem : IThreadPoolWorkItem
+    {
+        void Execute() override
+        {
+            WorkScheduler::GetInstance()->RunNextItem();
+        }
+    };
+
+    WorkScheduler* WorkScheduler::GetInstance()
+    {
+        static WorkScheduler instance;
+        return &instance;
+    }
+
+    void WorkScheduler::Configure(const WorkSchedulerSettings& settings)
+    {
+        _queueLock.Lock();
+        _maxTrainingWorkers = std::max(1, settings.maxTrainingWorkers);
+        _queueLock.Unlock();
+
+        int intraOpThreads = settings.torchIntraOpThreads;
+        if (intraOpThreads <= 0)
+        {
+            int totalCores = std::max(1, (int)std::thread::hardware_concurrency());
+            intraOpThreads = std::max(1, (totalCores - 1) / std::max(1, settings.maxTrainingWorkers));
+        }
+
+        TorchSetThreadCount(intraOpThreads);
+    }
+
+    void WorkScheduler::StartItem(std::shared_ptr<IThreadPoolWorkItem> workItem, WorkLane lane)
+    {
+        _queueLock.Lock();
+        _queues[(int)lane].push_back(std::move(workItem));
+        _queueLock.Unlock();
+
+        StartDispatch();
+    }
+
+    int WorkScheduler::QueuedItems(WorkLane lane)
+    {
+        _queueLock.Lock();
+        int count = (int)_queues[(int)lane].size();
+        _queueLock.Unlock();
+
+        return count;
+    }
+
+    int WorkScheduler::SpareTrainingWorkers()
+    {
+        _queueLock.Lock();
+        int spareWorkers = _maxTrainingWorkers
+            - _runningTrainingItems.load(std::memory_order_relaxed)
+            - _runningHelperItems.load(std::memory_order_relaxed);
+        _queueLock.Unlock();
+
+        return std::max(0, spareWorkers);
+    }
+
+    void WorkScheduler::StartDispatch()
+    {
+        ThreadPool::GetInstance()->StartItem(std::make_shared<DispatchWorkItem>());
+    }
+
+    bool WorkScheduler::TryTakeItem(std::shared_ptr<IThreadPoolWorkItem>& outWorkItem, WorkLane& outLane)
+    {
+        _queueLock.Lock();
+
+        auto& decisions = _queues[(int)WorkLane::Decision];
+        auto& helpers = _queues[(int)WorkLane::Helper];
+        auto& training = _queues[(int)WorkLane::Training];
+        bool tookItem = false;
+        bool hasSpareTrainingWorker = _runningTrainingItems.load(std::memory_order_relaxed)
+            + _runningHelperItems.load(std::memory_order_relaxed) < _maxTrainingWorkers;
+
+        if (!decisions.empty())
+        {
+            outWorkItem = std::move(decisions.front());
+            outLane = WorkLane::Decision;
+            decisions.pop_front();
+            tookItem = true;
+        }
+        else if (!helpers.empty() && hasSpareTrainingWorker)
+        {
+            outWorkItem = std::move(helpers.front());
+            outLane = WorkLane::Helper;
+            helpers.pop_front();
+            _runningHelperItems.fetch_add(1, std::memory_order_relaxed);
+            tookItem = true;
+        }
+        else if (!training.empty() && hasSpareTrainingWorker)
+        {
+            outWorkItem = std::move(training.front());
+            outLane = WorkLane::Training;
+            training.pop_front();
+            _runningTrainingItems.fetch_add(1, std::memory_order_relaxed);
+            tookItem = true;
+        }
+
+        _queueLock.Unlock();
+        return tookItem;
+    }
+
+    void WorkScheduler::RunNextItem()
+    {
+        std::shared_ptr<IThreadPoolWorkItem> workItem;
+        WorkLane lane;
+
+        // Nothing to do means another dispatch already took the item this one was started for, or it's training that's
+        // waiting for a training worker to free up
+        if (!TryTakeItem(workItem, lane))
+        {
+            return;
+        }
+
+        // The worker is given back even if the item throws, otherwise the lane would stay at its budget for good
+        struct FinishItemOnExit
+        {
+            ~FinishItemOnExit()
+            {
+                scheduler->FinishItem(lane);
+            }
+
+            WorkScheduler* scheduler;
+            WorkLane lane;
+        } finishItem { this, lane };
+
+        workItem->Execute();
+    }
+
+    void WorkScheduler::FinishItem(WorkLane lane)
+    {
+        if (lane == WorkLane::Decision)
+        {
+            return;
+        }
+
+        (lane == WorkLane::Training ? _runningTrainingItems : _runningHelperItems).fetch_sub(1, std::memory_order_relaxed);
+
+        // Work that was held back by the budget has no dispatch of its own left, so give it one
+        if (QueuedItems(WorkLane::Training) > 0 || QueuedItems(WorkLane::Helper) > 0)
+        {
+            StartDispatch();
+        }
+    }
+}
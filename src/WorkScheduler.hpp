@@ -0,0 +1,83 @@
+#pragma once
+
+namespace StrifeML
+{
+    enum class WorkLane
+    {
+        // Latency critical, always taken first
+        Decision,
+
+        // Throughput work that may only occupy a limited number of workers
+        Training,
+
+        // Threads joining a parallel loop that an item which already holds a worker is waiting on, see
+        // MlUtil::ParallelForShards(). They count against the training budget like training items do, so a batch only
+        // spreads over the workers the budget has left, but they're taken ahead of queued training since an item that's
+        // already running is waiting on them.
+        Helper,
+
+        TotalLanes
+    };
+
+    struct WorkSchedulerSettings
+    {
+        // Training items, and the helpers they start, allowed to run at the same time. The rest of the pool stays available
+        // to decisions.
+        int maxTrainingWorkers = 1;
+
+        // Threads torch may use inside a single op. 0 splits the cores left over after one core is kept for decisions
+        // evenly between the training workers, so the two don't oversubscribe the machine.
+        int torchIntraOpThreads = 0;
+    };
+
+    // Sits in front of the engine's thread pool, which runs items in the order they're started. Work is queued per lane,
+    // and every item started here also starts a generic dispatch item on the pool. Whichever dispatch item runs first
+    // takes the most important waiting work, so a decision started behind queued training still runs first.
+    class WorkScheduler
+    {
+    public:
+        static WorkScheduler* GetInstance();
+
+        void Configure(const WorkSchedulerSettings& settings);
+        void StartItem(std::shared_ptr<IThreadPoolWorkItem> workItem, WorkLane lane);
+
+        int QueuedItems(WorkLane lane);
+        int RunningTrainingItems() const { return _runningTrainingItems.load(std::memory_order_relaxed); }
+
+        // Workers the training budget has left for helpers
+        int SpareTrainingWorkers();
+
+    private:
+        friend struct DispatchWorkItem;
+
+        void RunNextItem();
+        bool TryTakeItem(std::shared_ptr<IThreadPoolWorkItem>& outWorkItem, WorkLane& outLane);
+        void FinishItem(WorkLane lane);
+        void StartDispatch();
+
+        SpinLock _queueLock;
+        std::deque<std::shared_ptr<IThreadPoolWorkItem>> _queues[(int)WorkLane::TotalLanes];
+        std::atomic<int> _runningTrainingItems { 0 };
+        std::atomic<int> _runningHelperItems { 0 };
+        int _maxTrainingWorkers = 1;
+    };
+
+    // Lets a task on the engine's scheduler, which always starts items straight on the thread pool, run in a lane instead
+    struct StartInLaneWorkItem : IThreadPoolWorkItem
+    {
+        StartInLaneWorkItem(std::shared_ptr<IThreadPoolWorkItem> workItem_, WorkLane lane_)
+            : workItem(workItem_),
+              lane(lane_)
+        {
+
+        }
+
+        void Execute() override
+        {
+            WorkScheduler::GetInstance()->StartItem(workItem, lane);
+        }
+
+        std::shared_ptr<IThreadPoolWorkItem> workItem;
+        WorkLane lane;
+    };
+}